@@ -0,0 +1,208 @@
+// Compares the old patch cleaning of nes-esp-firmware.ino (one scan of the whole buffer per
+// field, legacy_json_cleaners.h) with the JsonStreamFilter rule set that replaced it
+//
+// json_cleaner_benchmark [-n runs] [-a achievements] [-l] [patch.json ...]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "CharBufferStream.h"
+#include "JsonStreamFilter.h"
+#include "legacy_json_cleaners.h"
+
+#define MEMADDR_MAX_SIZE 8192 // as in handle_req_command
+#define STREAM_CHUNK_SIZE 512 // HTTP read buffer of perform_http_request_buffer
+
+static bool keep_leaderboards = false;
+
+// same rules as patch_rules in nes-esp-firmware.ino, plus the MemAddr limit used when the
+// patch does not fit
+static std::vector<JsonFilterRule> patch_rules()
+{
+  std::vector<JsonFilterRule> rules = {
+    {"Warning", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+    {"BadgeLockedURL", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+    {"BadgeURL", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+    {"ImageIconURL", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+    {"Rarity", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+    {"RarityHardcore", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+    {"Author", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+    {"Flags", JSON_RULE_DROP_IF_EQUAL, "5", 0, "Achievements"},
+    {"MemAddr", JSON_RULE_DROP_IF_LONGER, nullptr, MEMADDR_MAX_SIZE, "Achievements"},
+  };
+  if (!keep_leaderboards) {
+    rules.push_back({"Leaderboards", JSON_RULE_EMPTY_ARRAY, nullptr, 0, nullptr});
+  }
+  return rules;
+}
+
+static void load(CharBufferStream &buf, const std::string &json)
+{
+  buf.clear();
+  buf.write((const uint8_t*)json.data(), json.size());
+}
+
+static std::string run_legacy(const std::string &json)
+{
+  CharBufferStream buf;
+  buf.reserve(json.size());
+  load(buf, json);
+  legacy::remove_json_field_buffer(buf, "Warning");
+  legacy::remove_json_field_buffer(buf, "BadgeLockedURL");
+  legacy::remove_json_field_buffer(buf, "BadgeURL");
+  legacy::remove_json_field_buffer(buf, "ImageIconURL");
+  legacy::remove_json_field_buffer(buf, "Rarity");
+  legacy::remove_json_field_buffer(buf, "RarityHardcore");
+  legacy::remove_json_field_buffer(buf, "Author");
+  if (!keep_leaderboards) {
+    legacy::clean_json_field_array_value_buffer(buf, "Leaderboards");
+  }
+  legacy::remove_achievements_with_flags_5_buffer(buf);
+  legacy::remove_achievements_with_long_MemAddr_buffer(buf, MEMADDR_MAX_SIZE);
+  return std::string(buf.data(), buf.length());
+}
+
+static std::string run_in_place(const std::string &json, JsonStreamFilter &filter)
+{
+  CharBufferStream buf;
+  buf.reserve(json.size());
+  load(buf, json);
+  buf.setLength(filter.cleanInPlace(buf.data(), buf.length()));
+  return std::string(buf.data(), buf.length());
+}
+
+static std::string run_streamed(const std::string &json, JsonStreamFilter &filter)
+{
+  CharBufferStream buf;
+  buf.reserve(json.size());
+  filter.begin(buf.data(), buf.capacity());
+  for (size_t offset = 0; offset < json.size(); offset += STREAM_CHUNK_SIZE) {
+    size_t len = json.size() - offset < STREAM_CHUNK_SIZE ? json.size() - offset : STREAM_CHUNK_SIZE;
+    filter.feed((const uint8_t*)json.data() + offset, len);
+  }
+  filter.finish();
+  buf.setLength(filter.length());
+  return std::string(buf.data(), buf.length());
+}
+
+// patch in the layout of dorequest.php?r=patch, with some unofficial achievements and a few
+// achievements with a very long MemAddr
+static std::string synthetic_patch(int achievements)
+{
+  std::string json = "{\"Success\":true,\"PatchData\":{\"ID\":1496,\"Title\":\"Synthetic\",\"ConsoleID\":7,"
+                     "\"ImageIconURL\":\"https:\\/\\/media.retroachievements.org\\/Images\\/000001.png\","
+                     "\"RichPresencePatch\":\"Display:\\nPlaying\",\"Achievements\":[";
+  char item[512];
+  for (int i = 0; i < achievements; i++) {
+    std::string memaddr = "0xH0010=1_0xH0011=2_d0xH0012=3";
+    if (i % 50 == 25) {
+      memaddr.append(MEMADDR_MAX_SIZE + 16, '0');
+    }
+    snprintf(item, sizeof(item),
+             "%s{\"ID\":%d,\"MemAddr\":\"%%s\",\"Title\":\"Achievement %d\",\"Description\":\"Do the thing number %d\","
+             "\"Points\":%d,\"Author\":\"author%d\",\"Modified\":1700000000,\"Created\":1600000000,\"BadgeName\":\"%05d\","
+             "\"Flags\":%d,\"Type\":null,\"Rarity\":12.5,\"RarityHardcore\":7.25,"
+             "\"BadgeURL\":\"https:\\/\\/media.retroachievements.org\\/Badge\\/%05d.png\","
+             "\"BadgeLockedURL\":\"https:\\/\\/media.retroachievements.org\\/Badge\\/%05d_lock.png\"}",
+             i ? "," : "", 10000 + i, i, i, 5 + i % 4 * 5, i % 7, 20000 + i, i % 10 == 9 ? 5 : 3, 20000 + i, 20000 + i);
+    std::string entry = item;
+    entry.replace(entry.find("%s"), 2, memaddr);
+    json += entry;
+  }
+  json += "],\"Leaderboards\":[";
+  for (int i = 0; i < achievements / 4; i++) {
+    snprintf(item, sizeof(item),
+             "%s{\"ID\":%d,\"Mem\":\"STA:0xH0001=1::CAN:0xH0002=1::SUB:0xH0003=1::VAL:0xH0004\",\"Format\":\"SCORE\","
+             "\"LowerIsBetter\":false,\"Title\":\"Leaderboard %d\",\"Description\":\"Highest score\",\"Hidden\":false}",
+             i ? "," : "", 30000 + i, i);
+    json += item;
+  }
+  json += "]},\"Warning\":\"The server is in maintenance\"}";
+  return json;
+}
+
+template <typename F>
+static double time_ms(int runs, F body)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < runs; i++) {
+    body();
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+}
+
+static bool benchmark(const char* name, const std::string &json, int runs)
+{
+  std::vector<JsonFilterRule> rules = patch_rules();
+  JsonStreamFilter filter;
+  filter.setRules(rules.data(), rules.size());
+
+  std::string legacy_out, in_place_out, streamed_out;
+  double legacy_ms = time_ms(runs, [&] { legacy_out = run_legacy(json); });
+  double in_place_ms = time_ms(runs, [&] { in_place_out = run_in_place(json, filter); });
+  double streamed_ms = time_ms(runs, [&] { streamed_out = run_streamed(json, filter); });
+  bool match = legacy_out == in_place_out && legacy_out == streamed_out;
+
+  printf("%s: %zu -> %zu bytes, %lu fields and %lu achievements removed\n", name, json.size(), streamed_out.size(),
+         (unsigned long)filter.fieldsChanged, (unsigned long)filter.objectsDropped);
+  printf("  legacy (%d scans) %9.3f ms\n", keep_leaderboards ? 9 : 10, legacy_ms);
+  printf("  rule set in place  %9.3f ms  x%.1f\n", in_place_ms, legacy_ms / in_place_ms);
+  printf("  rule set streamed  %9.3f ms  x%.1f\n", streamed_ms, legacy_ms / streamed_ms);
+  printf("  output %s\n", match ? "matches" : "DIFFERS");
+  if (!match) {
+    size_t i = 0;
+    while (i < legacy_out.size() && i < streamed_out.size() && legacy_out[i] == streamed_out[i]) {
+      i++;
+    }
+    size_t from = i > 40 ? i - 40 : 0;
+    printf("  first difference at %zu\n  legacy:   %.80s\n  rule set: %.80s\n", i, legacy_out.c_str() + from,
+           streamed_out.c_str() + from);
+  }
+  return match;
+}
+
+int main(int argc, char** argv)
+{
+  int runs = 20;
+  int achievements = 400;
+  std::vector<const char*> files;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+      achievements = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-l") == 0) {
+      keep_leaderboards = true;
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [-n runs] [-a achievements] [-l] [patch.json ...]\n", argv[0]);
+      return 2;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+
+  bool ok = true;
+  if (files.empty()) {
+    ok = benchmark("synthetic", synthetic_patch(achievements), runs);
+  }
+  for (const char* file : files) {
+    FILE* f = fopen(file, "rb");
+    if (!f) {
+      perror(file);
+      return 1;
+    }
+    std::string json;
+    char chunk[4096];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+      json.append(chunk, len);
+    }
+    fclose(f);
+    ok = benchmark(file, json, runs) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,365 @@
+// JSON cleaners of nes-esp-firmware.ino before the single-pass JsonStreamFilter rule set -
+// kept as the baseline of json_cleaner_benchmark.cpp
+
+#ifndef LEGACY_JSON_CLEANERS_H
+#define LEGACY_JSON_CLEANERS_H
+
+#include "CharBufferStream.h"
+
+namespace legacy {
+
+// Remove spaces, newlines, and tabs outside of strings (in-place on CharBufferStream)
+void remove_space_new_lines_buffer(CharBufferStream &buf)
+{
+  char* data = buf.data();
+  size_t len = buf.length();
+  bool inside_quotes = false;
+  size_t write_idx = 0;
+
+  for (size_t read_idx = 0; read_idx < len; read_idx++)
+  {
+    char c = data[read_idx];
+
+    if (c == '"' && (read_idx == 0 || data[read_idx - 1] != '\\')) {
+      inside_quotes = !inside_quotes;
+    }
+
+    if (inside_quotes || (c != ' ' && c != '\n' && c != '\r' && c != '\t')) {
+      data[write_idx++] = c;
+    }
+  }
+  buf.setLength(write_idx);
+}
+
+// Remove a complete JSON field (in-place on CharBufferStream)
+void remove_json_field_buffer(CharBufferStream &buf, const char* field_to_remove)
+{
+  remove_space_new_lines_buffer(buf);
+  
+  char* data = buf.data();
+  size_t len = buf.length();
+  size_t field_len = strlen(field_to_remove);
+  
+  bool inside_quotes = false;
+  bool inside_array = false;
+  bool skip_field = false;
+  size_t read_idx = 0, write_idx = 0, skip_init = 0;
+
+  while (read_idx < len)
+  {
+    char c = data[read_idx];
+
+    if (c == '"' && (read_idx == 0 || data[read_idx - 1] != '\\')) {
+      inside_quotes = !inside_quotes;
+    }
+
+    if (c == '[' && skip_field) inside_array = true;
+    if (c == ']' && skip_field) inside_array = false;
+
+    // Detect start of field to remove
+    if (inside_quotes && 
+        read_idx + 1 + field_len + 1 < len &&
+        strncmp(data + read_idx + 1, field_to_remove, field_len) == 0 &&
+        data[read_idx + field_len + 1] == '"')
+    {
+      skip_field = true;
+      skip_init = read_idx;
+    }
+
+    if (!skip_field) {
+      data[write_idx++] = c;
+    }
+
+    // End of field
+    if (skip_field && read_idx + 1 < len && data[read_idx + 1] == '}') {
+      skip_field = false;
+      if (skip_init > 0 && data[skip_init - 1] == ',') {
+        write_idx--;
+      }
+    }
+    else if (skip_field && data[read_idx] == ',' && !inside_array && !inside_quotes) {
+      skip_field = false;
+    }
+
+    read_idx++;
+  }
+  buf.setLength(write_idx);
+}
+
+// Clean the string value of a field - replace with "" (in-place on CharBufferStream)
+void clean_json_field_str_value_buffer(CharBufferStream &buf, const char* field_to_remove)
+{
+  remove_space_new_lines_buffer(buf);
+  
+  char* data = buf.data();
+  size_t len = buf.length();
+  size_t field_len = strlen(field_to_remove);
+  
+  bool inside_quotes = false;
+  bool skip_field = false;
+  bool remove_next_str = false;
+  size_t read_idx = 0, write_idx = 0, skip_init = 0;
+
+  while (read_idx < len)
+  {
+    char c = data[read_idx];
+
+    if (c == '"' && (read_idx == 0 || data[read_idx - 1] != '\\'))
+    {
+      inside_quotes = !inside_quotes;
+      if (inside_quotes && remove_next_str) {
+        skip_field = true;
+        data[write_idx++] = '"';
+      }
+      if (!inside_quotes && remove_next_str && read_idx > skip_init) {
+        remove_next_str = false;
+        skip_field = false;
+      }
+    }
+
+    if (inside_quotes &&
+        read_idx + 1 + field_len + 1 < len &&
+        strncmp(data + read_idx + 1, field_to_remove, field_len) == 0 &&
+        data[read_idx + field_len + 1] == '"')
+    {
+      remove_next_str = true;
+      skip_init = read_idx + field_len + 2;
+    }
+
+    if (!skip_field) {
+      data[write_idx++] = c;
+    }
+    read_idx++;
+  }
+  buf.setLength(write_idx);
+}
+
+// Clean the array value of a field - replace with [] (in-place on CharBufferStream)
+void clean_json_field_array_value_buffer(CharBufferStream &buf, const char* field_to_remove)
+{
+  remove_space_new_lines_buffer(buf);
+  
+  char* data = buf.data();
+  size_t len = buf.length();
+  size_t field_len = strlen(field_to_remove);
+  
+  bool inside_quotes = false;
+  bool skip_field = false;
+  bool remove_next_array = false;
+  int array_depth = 0;
+  size_t read_idx = 0, write_idx = 0;
+
+  while (read_idx < len)
+  {
+    char c = data[read_idx];
+
+    // Update quote state first (handling escaped quotes)
+    if (c == '"' && (read_idx == 0 || data[read_idx - 1] != '\\')) {
+      inside_quotes = !inside_quotes;
+    }
+
+    // Only process [ and ] when NOT inside quotes
+    if (!inside_quotes) {
+      if (c == '[') {
+        if (remove_next_array) {
+          if (array_depth == 0) {
+            skip_field = true;
+            data[write_idx++] = '[';
+          }
+          array_depth++;
+        }
+      }
+      if (c == ']') {
+        if (remove_next_array) {
+          array_depth--;
+          if (array_depth == 0) {
+            remove_next_array = false;
+            skip_field = false;
+          }
+        }
+      }
+    }
+
+    // Detect the field name to remove
+    if (inside_quotes &&
+        read_idx + 1 + field_len + 1 < len &&
+        strncmp(data + read_idx + 1, field_to_remove, field_len) == 0 &&
+        data[read_idx + field_len + 1] == '"')
+    {
+      remove_next_array = true;
+    }
+
+    if (!skip_field) {
+      data[write_idx++] = c;
+    }
+    read_idx++;
+  }
+  buf.setLength(write_idx);
+}
+
+// Remove achievements with flags 5 (unofficial) - in-place on CharBufferStream
+void remove_achievements_with_flags_5_buffer(CharBufferStream &buf)
+{
+  remove_space_new_lines_buffer(buf);
+  
+  char* data = buf.data();
+  int achvStart = buf.indexOf("\"Achievements\":[");
+  if (achvStart == -1) return;
+
+  int arrayStart = buf.indexOf("[", achvStart);
+  int arrayEnd = buf.indexOf("]", arrayStart);
+  if (arrayStart == -1 || arrayEnd == -1) return;
+
+  int objCount = 0;
+  int pos = arrayStart + 1;
+  
+  while (pos < arrayEnd)
+  {
+    int objStart = buf.indexOf("{", pos);
+    if (objStart == -1 || objStart > arrayEnd) break;
+
+    int objEnd = objStart;
+    int braces = 1;
+    bool inString = false;
+    while (braces > 0 && objEnd < arrayEnd) {
+      objEnd++;
+      char ch = data[objEnd];
+      if (ch == '"' && (objEnd == 0 || data[objEnd - 1] != '\\')) {
+        inString = !inString;
+      }
+      if (!inString) {
+        if (ch == '{') braces++;
+        else if (ch == '}') braces--;
+      }
+    }
+
+    if (objEnd >= arrayEnd) break;
+    objCount++;
+
+    // Search for "Flags":5 inside the object
+    bool hasFlags5 = false;
+    for (int i = objStart; i < objEnd - 8; i++) {
+      if (strncmp(data + i, "\"Flags\":5", 9) == 0) {
+        hasFlags5 = true;
+        break;
+      }
+    }
+
+    if (hasFlags5)
+    {
+      int removeStart = objStart;
+      while (removeStart > arrayStart && (data[removeStart - 1] == ' ' || data[removeStart - 1] == '\n'))
+        removeStart--;
+      if (data[removeStart - 1] == ',')
+        removeStart--;
+      if (objCount == 1 && objEnd + 1 < (int)buf.length() && data[objEnd + 1] == ',')
+        objEnd++;
+
+      buf.removeRange(removeStart, objEnd - removeStart + 1);
+      arrayEnd = buf.indexOf("]", arrayStart);
+      pos = removeStart;
+    }
+    else
+    {
+      pos = objEnd + 1;
+    }
+  }
+}
+
+// Helper: find closing quote handling escaped quotes
+int findClosingQuote(char* data, int start, int limit) {
+  for (int i = start; i < limit; i++) {
+    if (data[i] == '"' && (i == 0 || data[i - 1] != '\\')) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Remove achievements with very large MemAddr - in-place on CharBufferStream
+void remove_achievements_with_long_MemAddr_buffer(CharBufferStream &buf, uint32_t maxSize)
+{
+  char* data = buf.data();
+  int achievementsPos = buf.indexOf("\"Achievements\"");
+  if (achievementsPos == -1) return;
+
+  int arrayStart = buf.indexOf("[", achievementsPos);
+  int arrayEnd = buf.indexOf("]", arrayStart);
+  if (arrayStart == -1 || arrayEnd == -1) return;
+
+  int pos = arrayStart + 1;
+  
+  while (pos < arrayEnd)
+  {
+    int objStart = buf.indexOf("{", pos);
+    if (objStart == -1 || objStart >= arrayEnd) break;
+
+    int objEnd = objStart;
+    int braceCount = 1;
+    bool inString = false;
+    while (braceCount > 0 && objEnd + 1 < (int)buf.length()) {
+      objEnd++;
+      char ch = data[objEnd];
+      if (ch == '"' && (objEnd == 0 || data[objEnd - 1] != '\\')) {
+        inString = !inString;
+      }
+      if (!inString) {
+        if (ch == '{') braceCount++;
+        else if (ch == '}') braceCount--;
+      }
+    }
+
+    if (objEnd >= arrayEnd) break;
+
+    // Search for "MemAddr"
+    int memAddrPos = -1;
+    for (int i = objStart; i < objEnd - 8; i++) {
+      if (strncmp(data + i, "\"MemAddr\"", 9) == 0) {
+        memAddrPos = i;
+        break;
+      }
+    }
+
+    if (memAddrPos == -1) {
+      pos = objEnd + 1;
+      continue;
+    }
+
+    int valueStart = buf.indexOf("\"", memAddrPos + 9);
+    if (valueStart == -1 || valueStart > objEnd) {
+      pos = objEnd + 1;
+      continue;
+    }
+
+    int valueEnd = findClosingQuote(data, valueStart + 1, objEnd);
+    if (valueEnd == -1 || valueEnd > objEnd) {
+      pos = objEnd + 1;
+      continue;
+    }
+
+    int memAddrLength = valueEnd - valueStart - 1;
+    
+    if (memAddrLength > (int)maxSize)
+    {
+      int removeStart = objStart;
+      int removeEnd = objEnd + 1;
+
+      if (removeEnd < (int)buf.length() && data[removeEnd] == ',')
+        removeEnd++;
+      else if (removeStart > arrayStart + 1 && data[removeStart - 1] == ',')
+        removeStart--;
+
+      buf.removeRange(removeStart, removeEnd - removeStart);
+      arrayEnd -= (removeEnd - removeStart);
+      pos = removeStart;
+    }
+    else
+    {
+      pos = objEnd + 1;
+    }
+  }
+}
+
+} // namespace legacy
+
+#endif
@@ -0,0 +1,9 @@
+// just enough of Arduino.h to build CharBufferStream.h on a PC
+#ifndef ARDUINO_H_STUB
+#define ARDUINO_H_STUB
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#endif
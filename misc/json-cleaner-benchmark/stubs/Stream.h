@@ -0,0 +1,18 @@
+// just enough of Stream.h to build CharBufferStream.h on a PC
+#ifndef STREAM_H_STUB
+#define STREAM_H_STUB
+
+#include "Arduino.h"
+
+class Stream {
+public:
+  virtual ~Stream() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+};
+
+#endif
@@ -0,0 +1,478 @@
+/**********************************************************************************
+ * link_simulator - host simulation of the ESP32 <-> Pico serial link
+ *
+ * Runs the Pico UART path (sim_pico.c: RX FIFO, IRQ-fed ring, line and frame consumers
+ * of main.c) against the ESP32 senders of nes-esp-firmware.ino (fixed pacing, flow ACK
+ * window, framed go-back-N) over a simulated wire with a baud rate, a latency and bit
+ * errors. Both ends use the firmware codecs (ring_buffer.c, link_frame.c, LinkFrame.h).
+ *
+ * For each mode it reports the time to send a patch, the REQ/RESP round trip, the high
+ * water of the Pico RX ring, the bytes lost in the UART FIFO and the frames resent.
+ *
+ * Part of NES RA Adapter - misc tools
+ **********************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "LinkFrame.h"
+#include "link_simulator.h"
+
+// same values as nes-esp-firmware.ino
+#define SERIAL_COMM_CHUNK_SIZE 32
+#define SERIAL_COMM_TX_DELAY_MS 5
+#define LINK_FLOW_ACK 0x06
+#define LINK_FLOW_BLOCK_SIZE 1024
+#define LINK_FLOW_WINDOW_BLOCKS 2
+#define LINK_FLOW_ACK_TIMEOUT_MS 1000
+#define LINK_FRAME_WINDOW 2
+#define LINK_FRAME_ACK_TIMEOUT_MS 1000
+#define LINK_FRAME_MAX_RETRIES 5
+#define ESP_UART_TX_FIFO_SIZE 128 // Serial0.write returns when the rest fits the FIFO
+
+// same value as nes-pico-firmware/src/main.c
+#define PICO_SERIAL_BUFFER_INITIAL_SIZE (100 * 1024 + 64)
+
+#define NES_FRAME_NS 16639267ULL
+#define TICK_NS 1000ULL
+#define SCENARIO_TIMEOUT_NS (120ULL * 1000000000ULL)
+#define RTT_PINGS 20
+
+enum Mode { MODE_PACED, MODE_FLOW, MODE_FRAMED };
+static const char *mode_names[] = {"paced", "flow-ack", "framed"};
+
+struct Config {
+  uint32_t baud = 115200;
+  uint32_t latency_us = 0;
+  double bit_error_rate = 0;
+  uint32_t patch_size = 60000;
+  uint32_t pico_loop_us = 10;
+  uint32_t pico_stall_us = 0; // time in rc_client_do_frame each NES frame
+  uint32_t seed = 1;
+};
+
+static Config config;
+static uint64_t now_ns = 0;
+static std::mt19937 rng;
+
+/**
+ * one direction of the wire: bytes are sent one after the other at the baud rate (10 bits
+ * each) and arrive latency later, maybe with a bit flipped
+ */
+struct Wire {
+  std::deque<std::pair<uint64_t, uint8_t>> in_flight;
+  uint64_t busy_until = 0;
+  uint32_t corrupted = 0;
+
+  void reset() {
+    in_flight.clear();
+    busy_until = 0;
+    corrupted = 0;
+  }
+
+  void send(const uint8_t *data, size_t len) {
+    std::bernoulli_distribution bit_error(config.bit_error_rate);
+    for (size_t i = 0; i < len; i++) {
+      busy_until = std::max<uint64_t>(busy_until, now_ns) + 10ULL * 1000000000ULL / config.baud;
+      uint8_t byte = data[i];
+      if (config.bit_error_rate > 0) {
+        for (int bit = 0; bit < 8; bit++) {
+          if (bit_error(rng)) {
+            byte ^= 1 << bit;
+          }
+        }
+        if (byte != data[i]) corrupted++;
+      }
+      in_flight.push_back(std::make_pair(busy_until + config.latency_us * 1000ULL, byte));
+    }
+  }
+
+  bool receive(uint8_t *byte) {
+    if (in_flight.empty() || in_flight.front().first > now_ns) return false;
+    *byte = in_flight.front().second;
+    in_flight.pop_front();
+    return true;
+  }
+};
+
+static Wire to_pico;
+static Wire to_esp;
+
+// last command dispatched by the Pico
+static std::string pico_command;
+static uint64_t pico_command_ns = 0;
+
+extern "C" void sim_pico_to_wire(const uint8_t *data, uint32_t len) {
+  to_esp.send(data, len);
+}
+
+extern "C" void sim_pico_command(const char *command, uint32_t len) {
+  pico_command.assign(command, len);
+  pico_command_ns = now_ns;
+}
+
+/**
+ * ESP32 side - send_response_to_pico, send_framed_to_pico and poll_pico_frames as state
+ * machines, one loop iteration per step
+ */
+struct Esp {
+  Mode mode;
+  uint64_t wake_ns = 0; // delay() or a blocking Serial0.write
+
+  std::string head, body; // command being sent
+  bool sending = false;
+  uint64_t last_progress_ns = 0;
+
+  // paced and flow ACK
+  uint32_t offset = 0;
+  uint32_t acked_blocks = 0;
+  bool flow_ack = true;
+  std::string line; // bytes from the Pico
+
+  // framed
+  LinkFrameDecoder decoder;
+  uint8_t command[1100];
+  size_t command_len = 0;
+  uint8_t tx_seq = 0, first_seq = 0;
+  uint32_t frames = 0, base = 0, next = 0;
+  int retries = 0;
+  bool ack_received = false, nak_received = false;
+  uint8_t ack_seq = 0, nak_seq = 0;
+  uint32_t retransmits = 0;
+
+  std::vector<std::string> commands; // complete commands from the Pico
+
+  void reset(Mode m) {
+    *this = Esp();
+    mode = m;
+  }
+
+  void write(const void *data, size_t len) {
+    to_pico.send((const uint8_t *)data, len);
+    uint64_t fifo_ns = ESP_UART_TX_FIFO_SIZE * 10ULL * 1000000000ULL / config.baud;
+    if (to_pico.busy_until > fifo_ns) wake_ns = std::max<uint64_t>(wake_ns, to_pico.busy_until - fifo_ns);
+  }
+
+  void start(const std::string &h, const std::string &b) {
+    head = h;
+    body = b;
+    sending = true;
+    last_progress_ns = now_ns;
+    offset = acked_blocks = 0;
+    if (mode == MODE_FRAMED) {
+      size_t total = head.size() + body.size();
+      frames = total == 0 ? 1 : (total + LINK_FRAME_MAX_PAYLOAD - 1) / LINK_FRAME_MAX_PAYLOAD;
+      first_seq = tx_seq;
+      base = next = 0;
+      retries = 0;
+      ack_received = nak_received = false;
+    } else {
+      write(head.data(), head.size());
+    }
+  }
+
+  void read_line_bytes() {
+    uint8_t c;
+    while (to_esp.receive(&c)) {
+      if (c == LINK_FLOW_ACK) {
+        acked_blocks++;
+        continue;
+      }
+      line += (char)c;
+      if (line.size() >= 2 && line.compare(line.size() - 2, 2, "\r\n") == 0) {
+        commands.push_back(line.substr(0, line.size() - 2));
+        line.clear();
+      }
+    }
+  }
+
+  void poll_frames() {
+    uint8_t c;
+    while (to_esp.receive(&c)) {
+      decoder.setBuffer(command + command_len, sizeof(command) - command_len);
+      size_t consumed;
+      int result = decoder.decode(&c, 1, &consumed);
+      if (result == LINK_FRAME_INCOMPLETE || result < 0) continue;
+      if (decoder.type == LINK_FRAME_ACK) {
+        ack_received = true;
+        ack_seq = decoder.seq;
+      } else if (decoder.type == LINK_FRAME_NAK) {
+        nak_received = true;
+        nak_seq = decoder.seq;
+      } else if (result == LINK_FRAME_OVERFLOW) {
+        command_len = 0;
+      } else {
+        command_len += decoder.len;
+        if (decoder.type == LINK_FRAME_CMD) {
+          commands.push_back(std::string((const char *)command, command_len));
+          command_len = 0;
+        }
+      }
+    }
+  }
+
+  void step_line() {
+    if (offset == body.size()) {
+      write("\r\n", 2);
+      sending = false;
+      return;
+    }
+    uint32_t line_pos = head.size() + offset;
+    if (mode == MODE_FLOW && flow_ack) {
+      if (line_pos / LINK_FLOW_BLOCK_SIZE >= acked_blocks + LINK_FLOW_WINDOW_BLOCKS) {
+        if (now_ns - last_progress_ns > LINK_FLOW_ACK_TIMEOUT_MS * 1000000ULL) {
+          printf("  no flow ACK from the Pico - using fixed pacing\n");
+          flow_ack = false;
+        }
+        wake_ns = now_ns + 1000000ULL;
+        return;
+      }
+      last_progress_ns = now_ns;
+      uint32_t chunk_len = std::min<uint32_t>(LINK_FLOW_BLOCK_SIZE - line_pos % LINK_FLOW_BLOCK_SIZE, body.size() - offset);
+      write(body.data() + offset, chunk_len);
+      offset += chunk_len;
+    } else {
+      uint32_t chunk_len = std::min<uint32_t>(SERIAL_COMM_CHUNK_SIZE, body.size() - offset);
+      write(body.data() + offset, chunk_len);
+      offset += chunk_len;
+      // Serial0.flush() and delay(SERIAL_COMM_TX_DELAY_MS)
+      wake_ns = to_pico.busy_until + SERIAL_COMM_TX_DELAY_MS * 1000000ULL;
+    }
+  }
+
+  void write_frame(uint32_t index) {
+    size_t total = head.size() + body.size();
+    size_t start = index * LINK_FRAME_MAX_PAYLOAD;
+    size_t end = std::min<size_t>(start + LINK_FRAME_MAX_PAYLOAD, total);
+    std::string payload = (head + body).substr(start, end - start);
+    uint8_t frame[LINK_FRAME_OVERHEAD + LINK_FRAME_MAX_PAYLOAD];
+    size_t len = link_frame_encode(frame, index == frames - 1 ? LINK_FRAME_CMD : LINK_FRAME_CMD_PART,
+                                   (uint8_t)(first_seq + index), (const uint8_t *)payload.data(), payload.size());
+    write(frame, len);
+  }
+
+  void step_framed() {
+    while (next < frames && next < base + LINK_FRAME_WINDOW) {
+      write_frame(next++);
+    }
+    if (ack_received) {
+      ack_received = false;
+      uint32_t index = (uint8_t)(ack_seq - first_seq);
+      if (index >= base && index < next) {
+        base = index + 1;
+        retries = 0;
+        last_progress_ns = now_ns;
+      }
+    }
+    if (nak_received) {
+      nak_received = false;
+      uint32_t index = (uint8_t)(nak_seq - first_seq);
+      if (index >= base && index < next) {
+        base = next = index;
+        retries++;
+        retransmits++;
+        last_progress_ns = now_ns;
+      }
+    }
+    if (base < frames && now_ns - last_progress_ns > LINK_FRAME_ACK_TIMEOUT_MS * 1000000ULL) {
+      next = base;
+      retries++;
+      retransmits++;
+      last_progress_ns = now_ns;
+    }
+    if (retries > LINK_FRAME_MAX_RETRIES) {
+      printf("  no ACK from the Pico - command dropped\n");
+      tx_seq = first_seq + base;
+      sending = false;
+      return;
+    }
+    if (base == frames) {
+      tx_seq = first_seq + frames;
+      sending = false;
+      return;
+    }
+    if (next == base + LINK_FRAME_WINDOW) {
+      wake_ns = std::max<uint64_t>(wake_ns, now_ns + 1000000ULL);
+    }
+  }
+
+  void step() {
+    if (now_ns < wake_ns) return;
+    if (mode == MODE_FRAMED) {
+      poll_frames();
+    } else {
+      read_line_bytes();
+    }
+    if (sending) {
+      if (mode == MODE_FRAMED) {
+        step_framed();
+      } else {
+        step_line();
+      }
+    }
+  }
+};
+
+static Esp esp;
+
+struct PicoClock {
+  uint64_t next_loop_ns = 0;
+  uint64_t next_frame_ns = 0;
+};
+
+static PicoClock pico_clock;
+
+static void reset(Mode mode) {
+  now_ns = 0;
+  to_pico.reset();
+  to_esp.reset();
+  esp.reset(mode);
+  sim_pico_init(mode == MODE_FRAMED, PICO_SERIAL_BUFFER_INITIAL_SIZE);
+  pico_clock = PicoClock();
+  pico_command.clear();
+}
+
+// advance 1us: deliver the bytes on the wire, then run both loops if they are not busy
+static void tick() {
+  now_ns += TICK_NS;
+  uint8_t byte;
+  while (to_pico.receive(&byte)) {
+    sim_pico_uart_receive(byte);
+  }
+  if (now_ns >= pico_clock.next_loop_ns) {
+    sim_pico_loop();
+    pico_clock.next_loop_ns = now_ns + config.pico_loop_us * 1000ULL;
+    if (config.pico_stall_us > 0 && now_ns >= pico_clock.next_frame_ns) {
+      pico_clock.next_loop_ns += config.pico_stall_us * 1000ULL;
+      pico_clock.next_frame_ns += NES_FRAME_NS;
+    }
+  }
+  esp.step();
+}
+
+static std::string make_patch(uint32_t size) {
+  std::string patch = "{\"Success\":true,\"PatchData\":{\"ID\":1,\"Achievements\":[";
+  for (uint32_t id = 1; patch.size() < size; id++) {
+    char achievement[128];
+    snprintf(achievement, sizeof(achievement), "{\"ID\":%u,\"MemAddr\":\"0xH%04x=%u_0xH%04x>d0xH%04x\",\"Points\":5},",
+             id, (id * 37) & 0x7FF, id % 256, (id * 91) & 0x7FF, (id * 13) & 0x7FF);
+    patch += achievement;
+  }
+  patch.resize(size);
+  return patch;
+}
+
+static void print_pico_stats() {
+  sim_pico_stats_t stats = sim_pico_stats();
+  printf("  RX ring high water %u B, FIFO overruns %u B, wire errors %u B, frame errors %u, NAKs %u, resent %u\n",
+         stats.rx_ring_high_water, stats.fifo_overruns, to_pico.corrupted, stats.frame_errors, stats.naks,
+         esp.retransmits);
+}
+
+static void run_transfer(Mode mode, const std::string &patch) {
+  reset(mode);
+  const std::string header = "RESP=01;200;";
+  esp.start(header, patch);
+  while (pico_command.empty() && now_ns < SCENARIO_TIMEOUT_NS) {
+    tick();
+  }
+  const char *result = "ok";
+  if (pico_command.empty()) {
+    result = "LOST";
+  } else if (pico_command != header + patch) {
+    result = "CORRUPT";
+  }
+  double seconds = pico_command_ns / 1e9;
+  printf("%-8s patch %u B: %s in %.3f s (%.1f KB/s)\n", mode_names[mode], (unsigned)patch.size(), result,
+         pico_command.empty() ? 0.0 : seconds, pico_command.empty() ? 0.0 : patch.size() / 1024.0 / seconds);
+  print_pico_stats();
+}
+
+static void run_round_trips(Mode mode) {
+  reset(mode);
+  uint64_t total_ns = 0, worst_ns = 0;
+  int answered = 0;
+  for (int i = 0; i < RTT_PINGS; i++) {
+    char request[96];
+    snprintf(request, sizeof(request), "REQ=%02X;M:POST;U:https://retroachievements.org/dorequest.php;D:r=ping\r\n", i);
+    pico_command.clear();
+    uint64_t sent_ns = now_ns;
+    sim_pico_send(request);
+    uint64_t deadline = now_ns + 5000000000ULL;
+    while (pico_command.empty() && now_ns < deadline) {
+      tick();
+      // the ESP32 answers at once - the HTTP request is not part of the link
+      for (const std::string &command : esp.commands) {
+        if (command.compare(0, 4, "REQ=") == 0 && !esp.sending) {
+          esp.start("RESP=" + command.substr(4, 2) + ";200;", "{\"Success\":true}");
+        }
+      }
+      esp.commands.clear();
+    }
+    if (!pico_command.empty()) {
+      uint64_t rtt_ns = pico_command_ns - sent_ns;
+      total_ns += rtt_ns;
+      worst_ns = std::max<uint64_t>(worst_ns, rtt_ns);
+      answered++;
+    }
+    // let the link go idle between requests
+    for (uint64_t idle = now_ns + 20000000ULL; now_ns < idle;) tick();
+  }
+  printf("%-8s REQ/RESP round trip: %d/%d answered, average %.2f ms, worst %.2f ms\n", mode_names[mode], answered,
+         RTT_PINGS, answered ? total_ns / 1e6 / answered : 0.0, worst_ns / 1e6);
+}
+
+static void usage(const char *name) {
+  printf("usage: %s [-b baud] [-l latency_us] [-e bit_error_rate] [-s patch_size] [-t stall_us] [-p loop_us] "
+         "[-r seed] [-m paced|flow-ack|framed]\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  int only_mode = -1;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:l:e:s:t:p:r:m:h")) != -1) {
+    switch (opt) {
+      case 'b': config.baud = strtoul(optarg, NULL, 10); break;
+      case 'l': config.latency_us = strtoul(optarg, NULL, 10); break;
+      case 'e': config.bit_error_rate = strtod(optarg, NULL); break;
+      case 's': config.patch_size = strtoul(optarg, NULL, 10); break;
+      case 't': config.pico_stall_us = strtoul(optarg, NULL, 10); break;
+      case 'p': config.pico_loop_us = strtoul(optarg, NULL, 10); break;
+      case 'r': config.seed = strtoul(optarg, NULL, 10); break;
+      case 'm':
+        for (int m = MODE_PACED; m <= MODE_FRAMED; m++) {
+          if (strcmp(optarg, mode_names[m]) == 0) only_mode = m;
+        }
+        if (only_mode < 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (config.baud == 0 || config.pico_loop_us == 0 || config.patch_size > PICO_SERIAL_BUFFER_INITIAL_SIZE - 64) {
+    usage(argv[0]);
+    return 1;
+  }
+  rng.seed(config.seed);
+
+  printf("%u baud, latency %u us, bit error rate %g, Pico loop %u us, stall %u us per NES frame\n\n", config.baud,
+         config.latency_us, config.bit_error_rate, config.pico_loop_us, config.pico_stall_us);
+  std::string patch = make_patch(config.patch_size);
+  for (int m = MODE_PACED; m <= MODE_FRAMED; m++) {
+    if (only_mode >= 0 && m != only_mode) continue;
+    run_transfer((Mode)m, patch);
+    run_round_trips((Mode)m);
+    printf("\n");
+  }
+  return 0;
+}
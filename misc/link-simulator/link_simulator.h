@@ -0,0 +1,45 @@
+#ifndef LINK_SIMULATOR_H
+#define LINK_SIMULATOR_H
+
+/**
+ * interface between the simulated Pico (sim_pico.c, built with the Pico ring_buffer.c and
+ * link_frame.c) and the rest of the simulator (link_simulator.cpp, built with the ESP32
+ * LinkFrame.h). Both headers define the same frame constants, so they are kept in separate
+ * translation units.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint32_t rx_ring_high_water; // bytes
+    uint32_t fifo_overruns;      // bytes lost because the UART FIFO was full
+    uint32_t frames;             // frames decoded
+    uint32_t frame_errors;       // bad CRC or header
+    uint32_t naks;               // NAKs sent
+    uint32_t commands;           // commands dispatched
+} sim_pico_stats_t;
+
+void sim_pico_init(bool framed, uint32_t serial_buffer_size);
+// a byte arrived on the RX pin - it goes to the UART FIFO and the RX interrupt moves it to the ring
+void sim_pico_uart_receive(uint8_t byte);
+// one iteration of the core 0 main loop (UART part)
+void sim_pico_loop(void);
+// uart_tx_puts
+void sim_pico_send(const char *message);
+sim_pico_stats_t sim_pico_stats(void);
+
+// implemented by link_simulator.cpp
+void sim_pico_to_wire(const uint8_t *data, uint32_t len);
+void sim_pico_command(const char *command, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+// Pico side of the link simulator - the UART part of the core 0 main loop of
+// nes-pico-firmware/src/main.c, with the same ring buffer and frame decoder
+
+#include "link_simulator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring_buffer.h"
+#include "link_frame.h"
+
+#define UART_RX_RING_SIZE 4096 // same as main.c
+#define UART_FIFO_SIZE 32      // RP2040 UART RX FIFO
+#define LINK_FLOW_BLOCK_SIZE 1024
+
+static uint8_t uart_rx_storage[UART_RX_RING_SIZE];
+static ring_buffer_t uart_rx_ring;
+static uint8_t uart_fifo[UART_FIFO_SIZE];
+static uint32_t uart_fifo_count = 0;
+
+static uint8_t *serial_buffer = NULL;
+static uint8_t *serial_buffer_head = NULL;
+static uint32_t serial_buffer_size = 0;
+
+static bool link_framing = false;
+static link_frame_decoder_t link_rx_decoder;
+static uint8_t link_rx_seq = 0;
+static uint8_t link_tx_seq = 0;
+static bool link_rx_discard = false;
+static uint8_t link_rx_chunk[256];
+static uint8_t link_tx_frame[LINK_FRAME_OVERHEAD + LINK_FRAME_MAX_PAYLOAD];
+
+static sim_pico_stats_t stats;
+
+// RX interrupt - FIFO to ring while there is room
+static void uart_rx_drain_fifo(void)
+{
+    uint32_t moved = 0;
+    while (moved < uart_fifo_count && ring_buffer_free(&uart_rx_ring) > 0)
+    {
+        ring_buffer_put(&uart_rx_ring, uart_fifo[moved++]);
+    }
+    memmove(uart_fifo, uart_fifo + moved, uart_fifo_count - moved);
+    uart_fifo_count -= moved;
+}
+
+void sim_pico_init(bool framed, uint32_t size)
+{
+    ring_buffer_init(&uart_rx_ring, uart_rx_storage, UART_RX_RING_SIZE);
+    uart_fifo_count = 0;
+    free(serial_buffer);
+    serial_buffer = (uint8_t *)malloc(size);
+    serial_buffer_head = serial_buffer;
+    serial_buffer_size = size;
+    link_framing = framed;
+    link_rx_seq = 0;
+    link_tx_seq = 0;
+    link_rx_discard = false;
+    link_frame_decoder_init(&link_rx_decoder);
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sim_pico_uart_receive(uint8_t byte)
+{
+    // the ESP32 does not use CTS, so a full FIFO loses the byte
+    if (uart_fifo_count == UART_FIFO_SIZE)
+    {
+        stats.fifo_overruns++;
+        return;
+    }
+    uart_fifo[uart_fifo_count++] = byte;
+    uart_rx_drain_fifo();
+}
+
+static void uart_tx_link_frame(uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len)
+{
+    sim_pico_to_wire(link_tx_frame, link_frame_encode(link_tx_frame, type, seq, payload, len));
+}
+
+void sim_pico_send(const char *message)
+{
+    uint32_t len = strlen(message);
+    if (!link_framing)
+    {
+        sim_pico_to_wire((const uint8_t *)message, len);
+        return;
+    }
+    if (len >= 2 && message[len - 2] == '\r' && message[len - 1] == '\n')
+    {
+        len -= 2;
+    }
+    const uint8_t *part = (const uint8_t *)message;
+    do
+    {
+        uint16_t part_len = len > LINK_FRAME_MAX_PAYLOAD ? LINK_FRAME_MAX_PAYLOAD : len;
+        len -= part_len;
+        uart_tx_link_frame(len > 0 ? LINK_FRAME_CMD_PART : LINK_FRAME_CMD, link_tx_seq++, part, part_len);
+        part += part_len;
+    } while (len > 0);
+}
+
+static void dispatch_command(uint32_t command_len)
+{
+    stats.commands++;
+    sim_pico_command((const char *)serial_buffer, command_len);
+}
+
+static void handle_lines(void)
+{
+    uint32_t used = serial_buffer_head - serial_buffer;
+    uint32_t len = ring_buffer_read_until(&uart_rx_ring, serial_buffer_head, serial_buffer_size - used - 1, '\n');
+    uart_rx_drain_fifo();
+    serial_buffer_head += len;
+    used += len;
+    if (used >= 5 && memcmp(serial_buffer, "RESP=", 5) == 0)
+    {
+        for (uint32_t block = (used - len) / LINK_FLOW_BLOCK_SIZE; block < used / LINK_FLOW_BLOCK_SIZE; block++)
+        {
+            sim_pico_to_wire((const uint8_t *)"\x06", 1);
+        }
+    }
+    if (used < 2 || serial_buffer_head[-1] != '\n' || serial_buffer_head[-2] != '\r')
+    {
+        if (used == serial_buffer_size - 1)
+        {
+            serial_buffer_head = serial_buffer;
+        }
+        return;
+    }
+    uint32_t command_len = used - 2;
+    serial_buffer[command_len] = '\0';
+    serial_buffer_head = serial_buffer;
+    if (command_len > 0)
+    {
+        dispatch_command(command_len);
+    }
+}
+
+static void handle_link_frames(void)
+{
+    uint32_t len = ring_buffer_read(&uart_rx_ring, link_rx_chunk, sizeof(link_rx_chunk));
+    uart_rx_drain_fifo();
+    uint32_t offset = 0;
+    while (offset < len)
+    {
+        uint32_t room = serial_buffer_size - (serial_buffer_head - serial_buffer) - 1;
+        link_frame_decoder_set_buffer(&link_rx_decoder, serial_buffer_head, room < LINK_FRAME_MAX_PAYLOAD ? room : LINK_FRAME_MAX_PAYLOAD);
+        uint32_t consumed;
+        int result = link_frame_decode(&link_rx_decoder, link_rx_chunk + offset, len - offset, &consumed);
+        offset += consumed;
+        if (result == LINK_FRAME_INCOMPLETE)
+        {
+            break;
+        }
+        if (result < 0)
+        {
+            stats.naks++;
+            uart_tx_link_frame(LINK_FRAME_NAK, link_rx_seq, NULL, 0);
+            continue;
+        }
+        uint8_t type = link_rx_decoder.type;
+        if (type != LINK_FRAME_CMD && type != LINK_FRAME_CMD_PART)
+        {
+            continue;
+        }
+        if (link_rx_decoder.seq != link_rx_seq)
+        {
+            if ((uint8_t)(link_rx_seq - link_rx_decoder.seq) < 128)
+            {
+                uart_tx_link_frame(LINK_FRAME_ACK, link_rx_seq - 1, NULL, 0);
+            }
+            else
+            {
+                stats.naks++;
+                uart_tx_link_frame(LINK_FRAME_NAK, link_rx_seq, NULL, 0);
+            }
+            continue;
+        }
+        uart_tx_link_frame(LINK_FRAME_ACK, link_rx_seq, NULL, 0);
+        link_rx_seq++;
+        if (result == LINK_FRAME_OVERFLOW || link_rx_discard)
+        {
+            serial_buffer_head = serial_buffer;
+            link_rx_discard = type == LINK_FRAME_CMD_PART;
+            continue;
+        }
+        serial_buffer_head += link_rx_decoder.len;
+        if (type == LINK_FRAME_CMD)
+        {
+            uint32_t command_len = serial_buffer_head - serial_buffer;
+            serial_buffer[command_len] = '\0';
+            serial_buffer_head = serial_buffer;
+            if (command_len > 0)
+            {
+                dispatch_command(command_len);
+            }
+        }
+    }
+}
+
+void sim_pico_loop(void)
+{
+    if (ring_buffer_is_empty(&uart_rx_ring))
+    {
+        return;
+    }
+    if (link_framing)
+    {
+        handle_link_frames();
+    }
+    else
+    {
+        handle_lines();
+    }
+}
+
+sim_pico_stats_t sim_pico_stats(void)
+{
+    stats.rx_ring_high_water = uart_rx_ring.high_water;
+    stats.frames = link_rx_decoder.frames;
+    stats.frame_errors = link_rx_decoder.errors;
+    return stats;
+}
@@ -0,0 +1,274 @@
+# this script is a local stand-in for the RetroAchievements server (dorequest.php and the media host)
+# used to benchmark the adapter offline: patch download, JSON filtering and retries, with the same
+# responses every run
+#
+# it serves recorded responses from the responses folder and falls back to generated ones (login,
+# patch with N achievements, award, unlocks, ...), with optional delay, bandwidth limit, chunked
+# encoding and failure injection
+#
+# usage examples:
+#   python ra-mock-server.py --tls --cert cert.pem --key key.pem --port 8443
+#   python ra-mock-server.py --record                      # forward to retroachievements.org and save the responses
+#   python ra-mock-server.py --delay 300 --chunked --rate 20000 --fail-rate 0.2 --fail-mode reset --fail-only patch
+#
+# in the ESP32 firmware, set ENABLE_RA_MOCK_SERVER to 1 and RA_MOCK_SERVER_URL to this server
+
+import argparse
+import json
+import os
+import random
+import socket
+import ssl
+import struct
+import sys
+import threading
+import time
+import urllib.parse
+import urllib.request
+import zlib
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+RA_URL = "https://retroachievements.org"
+RA_MEDIA_URL = "https://media.retroachievements.org"
+
+options = None
+request_count = 0
+request_count_lock = threading.Lock()
+
+# key used to save/find the recorded response of a request, e.g. patch-1496 or login2
+def response_name(params):
+    r = params.get("r", "unknown")
+    for key in ("g", "a", "m", "i"):
+        if key in params:
+            return "%s-%s" % (r, params[key])
+    return r
+
+def recorded_response(params):
+    for name in (response_name(params), params.get("r", "unknown")):
+        path = os.path.join(options.responses, name + ".json")
+        if os.path.isfile(path):
+            with open(path, "rb") as f:
+                return f.read()
+    return None
+
+# responses generated when there is no recording - only the fields the adapter uses
+def generated_response(params):
+    r = params.get("r", "")
+    user = params.get("u", "player")
+    if r in ("login", "login2"):
+        body = {"Success": True, "User": user, "AvatarUrl": RA_MEDIA_URL + "/UserPic/" + user + ".png",
+                "Token": "mocktoken0123456789", "Score": 1234, "SoftcoreScore": 0, "Messages": 0,
+                "Permissions": 1, "AccountType": "Registered"}
+    elif r == "gameid":
+        body = {"Success": True, "GameID": 1496}
+    elif r == "patch":
+        body = {"Success": True, "PatchData": generated_patch(int(params.get("g", "1496")))}
+    elif r in ("startsession", "unlocks"):
+        body = {"Success": True, "HardcoreUnlocks": [], "Unlocks": [], "UserUnlocks": [],
+                "ServerNow": int(time.time())}
+    elif r == "awardachievement":
+        body = {"Success": True, "Score": 1239, "SoftcoreScore": 0,
+                "AchievementID": int(params.get("a", "0")), "AchievementsRemaining": options.achievements - 1}
+    elif r == "submitlbentry":
+        score = int(params.get("s", "0"))
+        body = {"Success": True, "Response": {"Score": score, "BestScore": score,
+                "RankInfo": {"Rank": 1, "NumEntries": "1"},
+                "TopEntries": [{"User": user, "Score": score, "Rank": 1}]}}
+    elif r == "ping":
+        body = {"Success": True}
+    else:
+        body = {"Success": False, "Error": "Unknown request: '%s'" % r}
+    return json.dumps(body).encode()
+
+def generated_patch(game_id):
+    achievements = []
+    for i in range(options.achievements):
+        achievement_id = game_id * 1000 + i
+        badge = "%05d" % (achievement_id % 100000)
+        address = (i * 37) & 0x7FF
+        achievements.append({
+            "ID": achievement_id,
+            "MemAddr": "0xH%04x=%d_0xH%04x>d0xH%04x_R:0xH%04x=255" % (address, i % 256, address + 1, address + 1, address + 2),
+            "Title": "Achievement %d" % (i + 1),
+            "Description": "Mock achievement number %d of game %d, long enough to look like a real one" % (i + 1, game_id),
+            "Points": 5, "Author": "mock", "Modified": 1700000000, "Created": 1600000000,
+            "BadgeName": badge, "Flags": 3, "Type": None, "Rarity": 50.0, "RarityHardcore": 25.0,
+            "BadgeURL": RA_MEDIA_URL + "/Badge/" + badge + ".png",
+            "BadgeLockedURL": RA_MEDIA_URL + "/Badge/" + badge + "_lock.png"})
+    leaderboards = [{"ID": game_id * 100 + i, "Mem": "STA:0xH0010=1::CAN:0xH0011=1::SUB:0xH0012=1::VAL:0xH0013",
+                     "Format": "SCORE", "LowerIsBetter": False, "Title": "Leaderboard %d" % (i + 1),
+                     "Description": "Mock leaderboard", "Hidden": False} for i in range(options.leaderboards)]
+    return {"ID": game_id, "Title": "Mock Game %d" % game_id, "ConsoleID": 7,
+            "ImageIcon": "/Images/%06d.png" % game_id,
+            "ImageIconURL": RA_MEDIA_URL + "/Images/%06d.png" % game_id,
+            "RichPresencePatch": "", "Achievements": achievements, "Leaderboards": leaderboards}
+
+# 64x64 PNG of a single color - used for badges and game images that were not recorded
+def generated_png(path):
+    color = zlib.crc32(path.encode()) & 0xFFFFFF
+    pixel = bytes(((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF))
+    raw = b"".join(b"\x00" + pixel * 64 for _ in range(64))
+
+    def chunk(kind, data):
+        return struct.pack(">I", len(data)) + kind + data + struct.pack(">I", zlib.crc32(kind + data) & 0xFFFFFFFF)
+
+    return (b"\x89PNG\r\n\x1a\n" + chunk(b"IHDR", struct.pack(">IIBBBBB", 64, 64, 8, 2, 0, 0, 0)) +
+            chunk(b"IDAT", zlib.compress(raw)) + chunk(b"IEND", b""))
+
+def record(url, data, name):
+    request = urllib.request.Request(url, data=data, headers={"User-Agent": "NES_RA_ADAPTER/1.2 rcheevos/11.6"})
+    with urllib.request.urlopen(request, timeout=30) as upstream:
+        body = upstream.read()
+    path = os.path.join(options.responses, name)
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "wb") as f:
+        f.write(body)
+    return body
+
+def should_fail(params):
+    global request_count
+    if options.fail_only and params.get("r") not in options.fail_only.split(","):
+        return False
+    with request_count_lock:
+        request_count += 1
+        count = request_count
+    if options.fail_every > 0:
+        return count % options.fail_every == 0
+    return random.random() < options.fail_rate
+
+class MockHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1" # keep-alive, like the real server
+
+    def do_GET(self):
+        self.handle_request(b"")
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", "0"))
+        self.handle_request(self.rfile.read(length))
+
+    def handle_request(self, data):
+        begin = time.time()
+        url = urllib.parse.urlsplit(self.path)
+        params = dict(urllib.parse.parse_qsl(url.query))
+        params.update(urllib.parse.parse_qsl(data.decode(errors="replace")))
+
+        if url.path.startswith(("/Badge/", "/Images/", "/UserPic/")):
+            content_type = "image/png"
+            path = os.path.join(options.responses, "media", url.path.lstrip("/"))
+            if os.path.isfile(path):
+                with open(path, "rb") as f:
+                    body = f.read()
+            elif options.record:
+                body = record(RA_MEDIA_URL + url.path, None, os.path.join("media", url.path.lstrip("/")))
+            else:
+                body = generated_png(url.path)
+        else:
+            # any other path is dorequest.php - so the shrink lambda URL can point here too
+            content_type = "application/json"
+            if options.record:
+                body = record(RA_URL + "/dorequest.php", data or url.query.encode(), response_name(params) + ".json")
+            else:
+                body = recorded_response(params) or generated_response(params)
+
+        delay = options.delay + random.uniform(0, options.jitter)
+        if delay > 0:
+            time.sleep(delay / 1000.0)
+
+        if should_fail(params):
+            self.fail(body)
+            self.log_request_result(params, "FAIL " + options.fail_mode, len(body), begin)
+            return
+
+        self.send_response(200)
+        self.send_header("Content-Type", content_type)
+        if options.chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        for offset in range(0, len(body), options.chunk_size):
+            part = body[offset:offset + options.chunk_size]
+            if options.chunked:
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(part), part))
+            else:
+                self.wfile.write(part)
+            self.wfile.flush()
+            if options.rate > 0:
+                time.sleep(len(part) / options.rate)
+        if options.chunked:
+            self.wfile.write(b"0\r\n\r\n")
+        self.log_request_result(params, "200", len(body), begin)
+
+    def fail(self, body):
+        mode = options.fail_mode
+        if mode in ("500", "503", "429"):
+            error = b'{"Success":false,"Error":"mock failure"}'
+            self.send_response(int(mode))
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(error)))
+            self.end_headers()
+            self.wfile.write(error)
+        elif mode == "timeout":
+            time.sleep(options.timeout / 1000.0)
+            self.close_connection = True
+        elif mode == "truncate":
+            self.send_response(200)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body[:len(body) // 2])
+            self.wfile.flush()
+            self.close_connection = True
+        else: # reset
+            self.connection.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+            self.close_connection = True
+
+    def log_request_result(self, params, result, size, begin):
+        name = params.get("r", self.path)
+        print("%s %-16s %-12s %7d bytes %7.0f ms" % (self.command, name, result, size, (time.time() - begin) * 1000))
+        sys.stdout.flush()
+
+    def log_message(self, format, *args):
+        pass # log_request_result prints one line per request
+
+def main():
+    global options
+    parser = argparse.ArgumentParser(description="local stand-in for the RetroAchievements server")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--responses", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "responses"),
+                        help="folder with the recorded responses (<r>-<id>.json, <r>.json and media/...)")
+    parser.add_argument("--record", action="store_true", help="forward to retroachievements.org and save the responses")
+    parser.add_argument("--achievements", type=int, default=60, help="achievements of a generated patch")
+    parser.add_argument("--leaderboards", type=int, default=5, help="leaderboards of a generated patch")
+    parser.add_argument("--delay", type=float, default=0, help="ms before each response")
+    parser.add_argument("--jitter", type=float, default=0, help="random ms added to the delay")
+    parser.add_argument("--rate", type=float, default=0, help="body bandwidth in bytes/s (0 - unlimited)")
+    parser.add_argument("--chunked", action="store_true", help="use Transfer-Encoding: chunked (images included)")
+    parser.add_argument("--chunk-size", type=int, default=1024, help="bytes written at once (size of each chunk)")
+    parser.add_argument("--fail-rate", type=float, default=0, help="probability of failing a request")
+    parser.add_argument("--fail-every", type=int, default=0, help="fail every Nth request instead (deterministic)")
+    parser.add_argument("--fail-mode", default="500", choices=["500", "503", "429", "timeout", "reset", "truncate"])
+    parser.add_argument("--fail-only", default="", help="only fail these requests, e.g. patch,awardachievement")
+    parser.add_argument("--timeout", type=float, default=60000, help="ms a 'timeout' failure holds the connection")
+    parser.add_argument("--tls", action="store_true", help="serve HTTPS (the ESP32 firmware needs it)")
+    parser.add_argument("--cert", default="cert.pem")
+    parser.add_argument("--key", default="key.pem")
+    parser.add_argument("--seed", type=int, default=None, help="random seed, for repeatable failures")
+    options = parser.parse_args()
+    random.seed(options.seed)
+
+    server = ThreadingHTTPServer((options.host, options.port), MockHandler)
+    if options.tls:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(options.cert, options.key)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+    print("RA mock server on %s://%s:%d (responses: %s%s)" % ("https" if options.tls else "http", options.host,
+          options.port, options.responses, ", recording" if options.record else ""))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+if __name__ == "__main__":
+    main()
@@ -20,9 +20,15 @@ private:
   size_t _capacity;
   size_t _length;
   size_t _readPos;
+  // deferred removal (markRemove) - data before _gapWrite is compacted, data from _gapRead on
+  // is still at its original position
+  size_t _gapWrite;
+  size_t _gapRead;
+  size_t _pendingRemoved;
 
 public:
-  CharBufferStream() : _buffer(nullptr), _capacity(0), _length(0), _readPos(0) {}
+  CharBufferStream() : _buffer(nullptr), _capacity(0), _length(0), _readPos(0),
+                       _gapWrite(0), _gapRead(0), _pendingRemoved(0) {}
   
   ~CharBufferStream() {
     release();
@@ -61,6 +67,20 @@ public:
     return false;
   }
 
+  // Exchange buffers and contents with other (e.g. to lend a big buffer to another task)
+  void swap(CharBufferStream &other) {
+    CharBufferStream* a = this;
+    CharBufferStream* b = &other;
+    char* buffer = a->_buffer; a->_buffer = b->_buffer; b->_buffer = buffer;
+    size_t value;
+    value = a->_capacity; a->_capacity = b->_capacity; b->_capacity = value;
+    value = a->_length; a->_length = b->_length; b->_length = value;
+    value = a->_readPos; a->_readPos = b->_readPos; b->_readPos = value;
+    value = a->_gapWrite; a->_gapWrite = b->_gapWrite; b->_gapWrite = value;
+    value = a->_gapRead; a->_gapRead = b->_gapRead; b->_gapRead = value;
+    value = a->_pendingRemoved; a->_pendingRemoved = b->_pendingRemoved; b->_pendingRemoved = value;
+  }
+
   // Free all memory
   void release() {
     if (_buffer) {
@@ -70,6 +90,7 @@ public:
     _capacity = 0;
     _length = 0;
     _readPos = 0;
+    _pendingRemoved = 0;
   }
 
   // Shrink the buffer - free excess memory
@@ -82,6 +103,7 @@ public:
   void clear() { 
     _length = 0; 
     _readPos = 0;
+    _pendingRemoved = 0;
     if (_buffer) _buffer[0] = '\0';
   }
   
@@ -93,6 +115,7 @@ public:
   
   // Stream write interface
   size_t write(uint8_t c) override {
+    commitRemovals();
     if (_buffer && _length < _capacity) {
       _buffer[_length++] = c;
       _buffer[_length] = '\0';
@@ -103,6 +126,7 @@ public:
   
   size_t write(const uint8_t* buf, size_t size) override {
     if (!_buffer) return 0;
+    commitRemovals();
     size_t toWrite = (size < (_capacity - _length)) ? size : (_capacity - _length);
     memcpy(_buffer + _length, buf, toWrite);
     _length += toWrite;
@@ -141,12 +165,46 @@ public:
 
   // Remove characters (in-place)
   void removeRange(size_t index, size_t count) {
+    commitRemovals();
     if (!_buffer || index >= _length) return;
     if (index + count > _length) count = _length - index;
     memmove(_buffer + index, _buffer + index + count, _length - index - count + 1);
     _length -= count;
   }
 
+  // Remove characters later, in commitRemovals() - for many removals in one scan.
+  // Ranges must be marked from the start of the buffer to the end. Until the commit, indexes
+  // and length() stay those of the original content, but only the data from the end of the
+  // last marked range on can be read or changed. Each call moves only the data between the
+  // previous range and this one, so the whole scan moves every byte at most once.
+  void markRemove(size_t index, size_t count) {
+    if (!_buffer || index >= _length) return;
+    if (index + count > _length) count = _length - index;
+    if (_pendingRemoved == 0) {
+      _gapWrite = index;
+    } else {
+      if (index + count <= _gapRead) return; // already removed
+      if (index < _gapRead) {
+        count -= _gapRead - index;
+        index = _gapRead;
+      }
+      memmove(_buffer + _gapWrite, _buffer + _gapRead, index - _gapRead);
+      _gapWrite += index - _gapRead;
+    }
+    _gapRead = index + count;
+    _pendingRemoved += count;
+  }
+
+  // Apply the ranges marked with markRemove()
+  void commitRemovals() {
+    if (_pendingRemoved == 0) return;
+    memmove(_buffer + _gapWrite, _buffer + _gapRead, _length - _gapRead + 1);
+    _length -= _pendingRemoved;
+    _pendingRemoved = 0;
+  }
+
+  size_t pendingRemovals() const { return _pendingRemoved; }
+
   // Search substring (returns -1 if not found)
   int indexOf(const char* str, size_t from = 0) const {
     if (!_buffer || !str || from >= _length) return -1;
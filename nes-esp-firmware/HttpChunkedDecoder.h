@@ -0,0 +1,129 @@
+/**********************************************************************************
+ * HttpChunkedDecoder - removes the chunked transfer encoding framing from an HTTP body
+ *
+ *   <size hex>[;extensions]\r\n <size bytes> \r\n ... 0\r\n [trailers\r\n] \r\n
+ *
+ * The body is decoded in place, block by block as it is read from the socket: decode()
+ * moves the data bytes of the block to its start (they never get ahead of the framing
+ * they replace) and returns how many there are. The state is kept between blocks, so a
+ * block can end anywhere, even in the middle of a size line.
+ *
+ * Only standard headers are used, so it can also be built on a PC.
+ *
+ * Part of NES RA Adapter - ESP32 Firmware
+ **********************************************************************************/
+
+#ifndef HTTP_CHUNKED_DECODER_H
+#define HTTP_CHUNKED_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define HTTP_CHUNK_MAX_SIZE 0x7FFFFFF // 128 MB - anything bigger is a framing error
+
+class HttpChunkedDecoder {
+private:
+  enum State : uint8_t {
+    SIZE,          // hex digits of the chunk size
+    EXTENSION,     // ";name=value" after the size - ignored up to the '\n'
+    DATA,
+    DATA_CR,       // "\r\n" after the data
+    DATA_LF,
+    TRAILER_START, // after the last chunk: "\r\n" ends the body, anything else is a trailer
+    TRAILER,
+    LAST_LF,
+    DONE,
+    ERROR
+  };
+
+  State _state;
+  uint32_t _chunkRemaining;
+  uint8_t _sizeDigits;
+
+public:
+  uint32_t chunks; // chunks decoded, including the last (empty) one
+
+  HttpChunkedDecoder() { begin(); }
+
+  void begin() {
+    _state = SIZE;
+    _chunkRemaining = 0;
+    _sizeDigits = 0;
+    chunks = 0;
+  }
+
+  // Decode len bytes of the body in place. Returns the number of data bytes, now at the
+  // start of data. Bytes after the end of the body are ignored.
+  size_t decode(uint8_t* data, size_t len) {
+    size_t write = 0;
+    size_t read = 0;
+    while (read < len && _state != DONE && _state != ERROR) {
+      if (_state == DATA) {
+        size_t count = len - read;
+        if (count > _chunkRemaining) count = _chunkRemaining;
+        memmove(data + write, data + read, count);
+        write += count;
+        read += count;
+        _chunkRemaining -= count;
+        if (_chunkRemaining == 0) _state = DATA_CR;
+        continue;
+      }
+
+      uint8_t c = data[read++];
+      switch (_state) {
+        case SIZE: {
+          int digit = -1;
+          if (c >= '0' && c <= '9') digit = c - '0';
+          else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+          else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+          if (digit >= 0) {
+            _chunkRemaining = _chunkRemaining * 16 + digit;
+            if (_chunkRemaining > HTTP_CHUNK_MAX_SIZE) _state = ERROR;
+            _sizeDigits++;
+          } else if (_sizeDigits == 0) {
+            _state = ERROR;
+          } else if (c == '\n') {
+            endSizeLine();
+          } else {
+            _state = EXTENSION; // ';', ' ' or the '\r'
+          }
+          break;
+        }
+        case EXTENSION:
+          if (c == '\n') endSizeLine();
+          break;
+        case DATA_CR:
+          _state = c == '\r' ? DATA_LF : c == '\n' ? SIZE : ERROR;
+          break;
+        case DATA_LF:
+          _state = c == '\n' ? SIZE : ERROR;
+          break;
+        case TRAILER_START:
+          _state = c == '\r' ? LAST_LF : c == '\n' ? DONE : TRAILER;
+          break;
+        case TRAILER:
+          if (c == '\n') _state = TRAILER_START;
+          break;
+        case LAST_LF:
+          _state = c == '\n' ? DONE : ERROR;
+          break;
+        default:
+          break;
+      }
+    }
+    return write;
+  }
+
+  bool done() const { return _state == DONE; }
+  bool error() const { return _state == ERROR; }
+
+private:
+  void endSizeLine() {
+    chunks++;
+    _sizeDigits = 0;
+    _state = _chunkRemaining > 0 ? DATA : TRAILER_START;
+  }
+};
+
+#endif
@@ -0,0 +1,383 @@
+/**********************************************************************************
+ * JsonStreamFilter - cleans a JSON document in a single pass, following a rule set
+ *
+ * Rules (JsonFilterRule) are matched by field name, at any depth:
+ *   JSON_RULE_REMOVE         - remove the field, whatever its value
+ *   JSON_RULE_BLANK_STRING   - keep the field with "" as value
+ *   JSON_RULE_EMPTY_ARRAY    - keep the field with [] as value
+ *   JSON_RULE_DROP_IF_EQUAL  - drop the object holding the field, if it is an element of the
+ *                              array named scope and the (scalar) value is value
+ *   JSON_RULE_DROP_IF_LONGER - same, if the string value is longer than maxLength
+ * Whitespace outside strings is always removed.
+ *
+ * The bytes can be fed as they arrive (e.g. from the HTTP stream) and the result is written
+ * straight to the output buffer, so it only has to fit the filtered document. The output
+ * never gets ahead of the input, so cleanInPlace() can use the same buffer for both.
+ *
+ * Keys and objects are written as they come and rolled back (the output length goes back
+ * to where they started) when they turn out to be dropped, so nothing is buffered apart
+ * from the output. Commas are written before each child kept, never after.
+ *
+ * Only standard headers are used, so it can also be built on a PC.
+ *
+ * Part of NES RA Adapter - ESP32 Firmware
+ **********************************************************************************/
+
+#ifndef JSON_STREAM_FILTER_H
+#define JSON_STREAM_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define JSON_FILTER_MAX_DEPTH 32
+#define JSON_FILTER_KEY_SIZE 24 // longer keys never match a rule
+#define JSON_FILTER_SCALAR_SIZE 16
+
+#define JSON_RULE_REMOVE 0
+#define JSON_RULE_BLANK_STRING 1
+#define JSON_RULE_EMPTY_ARRAY 2
+#define JSON_RULE_DROP_IF_EQUAL 3
+#define JSON_RULE_DROP_IF_LONGER 4
+
+struct JsonFilterRule {
+  const char* field;
+  uint8_t action;
+  const char* value;  // JSON_RULE_DROP_IF_EQUAL
+  uint32_t maxLength; // JSON_RULE_DROP_IF_LONGER
+  const char* scope;  // JSON_RULE_DROP_*: array whose objects are dropped
+};
+
+class JsonStreamFilter {
+private:
+  struct Container {
+    bool isObject;
+    bool scope;   // array named in the scope of a drop rule
+    bool element; // object in a scope array
+    bool drop;    // a drop rule matched
+    uint16_t children;       // children written (a comma goes before the next one)
+    uint16_t parentChildren; // children of the parent before this one - restored on rollback
+    size_t mark;             // output length before this container
+  };
+
+  // what happens to the value of the current field
+  enum { VALUE_KEEP, VALUE_REMOVE, VALUE_BLANK, VALUE_EMPTY };
+
+  const JsonFilterRule* _rules;
+  size_t _ruleCount;
+
+  char* _out;
+  size_t _capacity;
+  size_t _length;
+  size_t _lostAt; // first byte that did not fit (SIZE_MAX if none)
+
+  Container _stack[JSON_FILTER_MAX_DEPTH];
+  int _depth;
+  bool _malformed;
+
+  bool _expectKey;
+  bool _inString;
+  bool _stringIsKey;
+  bool _escape;
+  bool _inScalar;
+  uint8_t _valueAction;
+  bool _skipString; // string value not written (removed or blanked)
+  int _skipDepth;   // nesting of a skipped object/array value
+  bool _skipClose;  // write ']' when the skipped array ends (emptied)
+
+  char _key[JSON_FILTER_KEY_SIZE];
+  size_t _keyLen;
+  size_t _keyMark;
+  uint16_t _keyChildren;
+  const JsonFilterRule* _keyRule;
+  char _scalar[JSON_FILTER_SCALAR_SIZE];
+  size_t _valueLen; // scalar or string value
+
+  void put(char c) {
+    if (_length < _capacity) {
+      _out[_length] = c;
+    } else if (_lostAt == SIZE_MAX) {
+      _lostAt = _length;
+    }
+    _length++;
+  }
+
+  void rollback(size_t mark) {
+    _length = mark;
+    if (_lostAt >= mark) _lostAt = SIZE_MAX;
+  }
+
+  Container* top() { return _depth > 0 ? &_stack[_depth - 1] : nullptr; }
+
+  // a comma before every child but the first
+  void beginChild() {
+    Container* parent = top();
+    if (parent != nullptr && parent->children++ > 0) put(',');
+  }
+
+  bool keyIs(const char* name) const {
+    size_t len = strlen(name);
+    return _keyLen == len && memcmp(_key, name, len) == 0;
+  }
+
+  const JsonFilterRule* findRule() const {
+    if (_keyLen > JSON_FILTER_KEY_SIZE) return nullptr;
+    for (size_t i = 0; i < _ruleCount; i++) {
+      if (keyIs(_rules[i].field)) return &_rules[i];
+    }
+    return nullptr;
+  }
+
+  bool isScopeKey() const {
+    for (size_t i = 0; i < _ruleCount; i++) {
+      if (_rules[i].scope != nullptr && _rules[i].action >= JSON_RULE_DROP_IF_EQUAL && keyIs(_rules[i].scope)) return true;
+    }
+    return false;
+  }
+
+  void endKey() {
+    _keyRule = findRule();
+    _valueAction = VALUE_KEEP;
+    if (_keyRule != nullptr) {
+      switch (_keyRule->action) {
+        case JSON_RULE_REMOVE: _valueAction = VALUE_REMOVE; break;
+        case JSON_RULE_BLANK_STRING: _valueAction = VALUE_BLANK; break;
+        case JSON_RULE_EMPTY_ARRAY: _valueAction = VALUE_EMPTY; break;
+      }
+    }
+    if (_valueAction == VALUE_REMOVE) {
+      rollback(_keyMark);
+      top()->children = _keyChildren;
+      fieldsChanged++;
+    } else {
+      put('"');
+    }
+    _expectKey = false;
+  }
+
+  // a value (string, scalar or container) ended
+  void endValue(bool isString) {
+    Container* parent = top();
+    if (_valueAction == VALUE_KEEP && _keyRule != nullptr && parent != nullptr && parent->element &&
+        parent->isObject) {
+      if (_keyRule->action == JSON_RULE_DROP_IF_EQUAL && !isString && _valueLen <= JSON_FILTER_SCALAR_SIZE &&
+          _valueLen == strlen(_keyRule->value) &&
+          memcmp(_scalar, _keyRule->value, _valueLen) == 0) {
+        parent->drop = true;
+      } else if (_keyRule->action == JSON_RULE_DROP_IF_LONGER && isString && _valueLen > _keyRule->maxLength) {
+        parent->drop = true;
+      }
+    }
+    _valueAction = VALUE_KEEP;
+    _keyRule = nullptr;
+  }
+
+  void endScalar() {
+    _inScalar = false;
+    endValue(false);
+  }
+
+  void beginContainer(char c) {
+    Container* parent = top();
+    if (_depth == JSON_FILTER_MAX_DEPTH) {
+      _malformed = true;
+      return;
+    }
+    Container& container = _stack[_depth];
+    container.isObject = c == '{';
+    container.scope = c == '[' && parent != nullptr && parent->isObject && isScopeKey();
+    container.element = c == '{' && parent != nullptr && parent->scope;
+    container.drop = false;
+    container.parentChildren = parent != nullptr ? parent->children : 0;
+    container.children = 0;
+    container.mark = _length;
+    if (parent == nullptr || !parent->isObject) beginChild();
+    put(c);
+    _depth++;
+    _expectKey = container.isObject;
+    _valueAction = VALUE_KEEP;
+    _keyRule = nullptr;
+  }
+
+  void endContainer(char c) {
+    if (_depth == 0) {
+      _malformed = true;
+      return;
+    }
+    Container container = _stack[--_depth];
+    Container* parent = top();
+    if (container.drop) {
+      rollback(container.mark);
+      if (parent != nullptr) parent->children = container.parentChildren;
+      objectsDropped++;
+    } else {
+      put(c);
+    }
+    endValue(false);
+  }
+
+  // inside a removed (or emptied) object/array value
+  void skipChar(char c) {
+    if (_inString) {
+      if (_escape) _escape = false;
+      else if (c == '\\') _escape = true;
+      else if (c == '"') _inString = false;
+    } else if (c == '"') {
+      _inString = true;
+    } else if (c == '{' || c == '[') {
+      _skipDepth++;
+    } else if ((c == '}' || c == ']') && --_skipDepth == 0) {
+      if (_skipClose) put(']');
+      endValue(false);
+    }
+  }
+
+  void stringChar(char c) {
+    if (_escape) {
+      _escape = false;
+    } else if (c == '\\') {
+      _escape = true;
+    } else if (c == '"') {
+      _inString = false;
+      if (_stringIsKey) {
+        endKey();
+      } else {
+        if (_valueAction != VALUE_REMOVE) put('"');
+        endValue(true);
+      }
+      return;
+    }
+    if (_stringIsKey) {
+      if (_keyLen < JSON_FILTER_KEY_SIZE) _key[_keyLen] = c;
+      _keyLen++;
+      put(c);
+    } else {
+      _valueLen++;
+      if (!_skipString) put(c);
+    }
+  }
+
+public:
+  // counters of the last document
+  uint32_t bytesIn;
+  uint32_t fieldsChanged;  // removed, blanked or emptied
+  uint32_t objectsDropped;
+
+  JsonStreamFilter() : _rules(nullptr), _ruleCount(0) { begin(nullptr, 0); }
+
+  // the rules must stay valid while the filter is used
+  void setRules(const JsonFilterRule* rules, size_t count) {
+    _rules = rules;
+    _ruleCount = count;
+  }
+
+  // call before each document
+  void begin(char* out, size_t capacity) {
+    _out = out;
+    _capacity = out != nullptr ? capacity : 0;
+    _length = 0;
+    _lostAt = SIZE_MAX;
+    _depth = 0;
+    _malformed = false;
+    _expectKey = false;
+    _inString = _stringIsKey = _escape = _inScalar = _skipString = _skipClose = false;
+    _valueAction = VALUE_KEEP;
+    _skipDepth = 0;
+    _keyLen = _keyMark = _valueLen = 0;
+    _keyChildren = 0;
+    _keyRule = nullptr;
+    bytesIn = fieldsChanged = objectsDropped = 0;
+  }
+
+  void feed(const uint8_t* data, size_t len) {
+    bytesIn += len;
+    for (size_t i = 0; i < len && !_malformed; i++) {
+      char c = (char)data[i];
+      if (_skipDepth > 0) {
+        skipChar(c);
+        continue;
+      }
+      if (_inString) {
+        stringChar(c);
+        continue;
+      }
+      if (_inScalar && (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\n' || c == '\r' || c == '\t')) {
+        endScalar();
+      }
+      switch (c) {
+        case ' ': case '\n': case '\r': case '\t':
+          break;
+        case '"':
+          _inString = true;
+          _stringIsKey = _expectKey && top() != nullptr && top()->isObject;
+          _valueLen = 0;
+          if (_stringIsKey) {
+            _keyLen = 0;
+            _keyMark = _length;
+            _keyChildren = top()->children;
+            beginChild();
+            put('"');
+          } else {
+            _skipString = _valueAction == VALUE_REMOVE || _valueAction == VALUE_BLANK;
+            if (_valueAction == VALUE_BLANK) fieldsChanged++;
+            if (_valueAction != VALUE_REMOVE) {
+              if (top() == nullptr || !top()->isObject) beginChild();
+              put('"');
+            }
+          }
+          break;
+        case '{': case '[':
+          if (_valueAction == VALUE_REMOVE || (_valueAction == VALUE_EMPTY && c == '[')) {
+            _skipDepth = 1;
+            _skipClose = _valueAction == VALUE_EMPTY;
+            if (_skipClose) {
+              put('[');
+              fieldsChanged++;
+            }
+          } else {
+            beginContainer(c);
+          }
+          break;
+        case '}': case ']':
+          endContainer(c);
+          break;
+        case ':':
+          if (_valueAction != VALUE_REMOVE) put(':');
+          break;
+        case ',':
+          if (top() != nullptr && top()->isObject) _expectKey = true;
+          break;
+        default:
+          // number, true, false or null
+          if (!_inScalar) {
+            _inScalar = true;
+            _valueLen = 0;
+            if (_valueAction != VALUE_REMOVE && (top() == nullptr || !top()->isObject)) beginChild();
+          }
+          if (_valueLen < JSON_FILTER_SCALAR_SIZE) _scalar[_valueLen] = c;
+          _valueLen++;
+          if (_valueAction != VALUE_REMOVE) put(c);
+          break;
+      }
+    }
+  }
+
+  // call after the last byte (a scalar at the very end has no delimiter)
+  void finish() {
+    if (_inScalar) endScalar();
+  }
+
+  // filter a whole document in data itself - returns the new length
+  size_t cleanInPlace(char* data, size_t len) {
+    begin(data, len);
+    feed((const uint8_t*)data, len);
+    finish();
+    return length();
+  }
+
+  size_t length() const { return _length < _capacity ? _length : _capacity; }
+  bool overflow() const { return _lostAt != SIZE_MAX; }
+  bool malformed() const { return _malformed; }
+};
+
+#endif
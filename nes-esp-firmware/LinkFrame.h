@@ -0,0 +1,196 @@
+/**********************************************************************************
+ * LinkFrame - framing of the ESP32 <-> Pico serial link
+ *
+ *   SOF (0xA5) | type | seq | len (2 bytes, little endian) | payload | crc32 (4 bytes, little endian)
+ *
+ * The CRC32 covers type, seq, len and payload. Same format as link_frame.c in the Pico
+ * firmware - both must be changed together. Only standard headers are used, so it can
+ * also be built on a PC.
+ *
+ * Part of NES RA Adapter - ESP32 Firmware
+ **********************************************************************************/
+
+#ifndef LINK_FRAME_H
+#define LINK_FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define LINK_FRAME_SOF 0xA5
+#define LINK_FRAME_HEADER_SIZE 5 // SOF, type, seq, len
+#define LINK_FRAME_CRC_SIZE 4
+#define LINK_FRAME_OVERHEAD (LINK_FRAME_HEADER_SIZE + LINK_FRAME_CRC_SIZE)
+#define LINK_FRAME_MAX_PAYLOAD 1024
+
+// frame types
+#define LINK_FRAME_CMD 0x01      // last (or only) part of a command
+#define LINK_FRAME_CMD_PART 0x02 // more parts of the command follow
+#define LINK_FRAME_ACK 0x10      // seq = last frame received in order
+#define LINK_FRAME_NAK 0x11      // seq = frame expected - resend from it
+#define LINK_FRAME_RESET 0x20    // reset the receiver, whatever the seq
+
+// LinkFrameDecoder::decode results
+#define LINK_FRAME_INCOMPLETE 0
+#define LINK_FRAME_OK 1
+#define LINK_FRAME_OVERFLOW 2    // valid frame, but the payload did not fit the buffer
+#define LINK_FRAME_BAD_CRC -1
+#define LINK_FRAME_BAD_HEADER -2 // length above LINK_FRAME_MAX_PAYLOAD
+
+// CRC32 (IEEE, reflected) - start with 0xFFFFFFFF and invert at the end
+inline uint32_t link_frame_crc32(uint32_t crc, const uint8_t *data, size_t len) {
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return crc;
+}
+
+// header of a frame whose payload is written separately - crc receives the running CRC
+inline void link_frame_header(uint8_t out[LINK_FRAME_HEADER_SIZE], uint8_t type, uint8_t seq, uint16_t len, uint32_t *crc) {
+  out[0] = LINK_FRAME_SOF;
+  out[1] = type;
+  out[2] = seq;
+  out[3] = (uint8_t)(len & 0xFF);
+  out[4] = (uint8_t)(len >> 8);
+  *crc = link_frame_crc32(0xFFFFFFFF, out + 1, LINK_FRAME_HEADER_SIZE - 1);
+}
+
+inline void link_frame_trailer(uint8_t out[LINK_FRAME_CRC_SIZE], uint32_t crc) {
+  crc = ~crc;
+  out[0] = (uint8_t)crc;
+  out[1] = (uint8_t)(crc >> 8);
+  out[2] = (uint8_t)(crc >> 16);
+  out[3] = (uint8_t)(crc >> 24);
+}
+
+// writes the whole frame in out (LINK_FRAME_OVERHEAD + len bytes) and returns its size
+inline size_t link_frame_encode(uint8_t *out, uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len) {
+  uint32_t crc;
+  link_frame_header(out, type, seq, len, &crc);
+  if (len > 0) {
+    memcpy(out + LINK_FRAME_HEADER_SIZE, payload, len);
+    crc = link_frame_crc32(crc, payload, len);
+  }
+  link_frame_trailer(out + LINK_FRAME_HEADER_SIZE + len, crc);
+  return LINK_FRAME_OVERHEAD + len;
+}
+
+class LinkFrameDecoder {
+private:
+  enum { STATE_SOF, STATE_HEADER, STATE_PAYLOAD, STATE_TRAILER };
+  uint8_t _state;
+  uint8_t _header[4]; // type, seq, len
+  uint8_t _trailer[LINK_FRAME_CRC_SIZE];
+  uint16_t _pos;
+  uint32_t _crc;
+  uint8_t *_buffer;
+  uint16_t _bufferSize;
+
+public:
+  // last frame decoded
+  uint8_t type;
+  uint8_t seq;
+  uint16_t len;
+
+  // counters
+  uint32_t frames;
+  uint32_t errors;       // bad CRC or header
+  uint32_t skippedBytes; // bytes outside a frame
+
+  LinkFrameDecoder() { reset(); }
+
+  void reset() {
+    _state = STATE_SOF;
+    _pos = 0;
+    _crc = 0;
+    _buffer = nullptr;
+    _bufferSize = 0;
+    type = seq = 0;
+    len = 0;
+    frames = errors = skippedBytes = 0;
+  }
+
+  // set before each frame - the payload is written straight there
+  void setBuffer(uint8_t *buffer, uint16_t size) {
+    _buffer = buffer;
+    _bufferSize = size;
+  }
+
+  // consumes bytes until a frame ends (or data ends) - returns a LINK_FRAME_* result and
+  // the number of bytes used in consumed
+  int decode(const uint8_t *data, size_t dataLen, size_t *consumed) {
+    size_t i = 0;
+    while (i < dataLen) {
+      switch (_state) {
+        case STATE_SOF:
+          if (data[i++] == LINK_FRAME_SOF) {
+            _state = STATE_HEADER;
+            _pos = 0;
+          } else {
+            skippedBytes++;
+          }
+          break;
+
+        case STATE_HEADER:
+          _header[_pos++] = data[i++];
+          if (_pos == sizeof(_header)) {
+            len = (uint16_t)(_header[2] | (_header[3] << 8));
+            if (len > LINK_FRAME_MAX_PAYLOAD) {
+              _state = STATE_SOF;
+              errors++;
+              *consumed = i;
+              return LINK_FRAME_BAD_HEADER;
+            }
+            _crc = link_frame_crc32(0xFFFFFFFF, _header, sizeof(_header));
+            _pos = 0;
+            _state = len > 0 ? STATE_PAYLOAD : STATE_TRAILER;
+          }
+          break;
+
+        case STATE_PAYLOAD: {
+          size_t count = len - _pos;
+          if (count > dataLen - i) count = dataLen - i;
+          _crc = link_frame_crc32(_crc, data + i, count);
+          // bytes that do not fit are only checked, not stored
+          if (_pos < _bufferSize) {
+            size_t room = _bufferSize - _pos;
+            memcpy(_buffer + _pos, data + i, count < room ? count : room);
+          }
+          _pos += count;
+          i += count;
+          if (_pos == len) {
+            _pos = 0;
+            _state = STATE_TRAILER;
+          }
+          break;
+        }
+
+        case STATE_TRAILER:
+          _trailer[_pos++] = data[i++];
+          if (_pos == LINK_FRAME_CRC_SIZE) {
+            _state = STATE_SOF;
+            *consumed = i;
+            uint32_t crc = (uint32_t)_trailer[0] | ((uint32_t)_trailer[1] << 8) |
+                           ((uint32_t)_trailer[2] << 16) | ((uint32_t)_trailer[3] << 24);
+            if (crc != ~_crc) {
+              errors++;
+              return LINK_FRAME_BAD_CRC;
+            }
+            type = _header[0];
+            seq = _header[1];
+            frames++;
+            return len > _bufferSize ? LINK_FRAME_OVERFLOW : LINK_FRAME_OK;
+          }
+          break;
+      }
+    }
+    *consumed = i;
+    return LINK_FRAME_INCOMPLETE;
+  }
+};
+
+#endif
@@ -60,6 +60,108 @@
 #define ENABLE_SHRINK_LAMBDA 0 // 0 - disable / 1 - enable
 #define SHRINK_LAMBDA_URL "https://xxxxxxxxxx.execute-api.us-east-1.amazonaws.com/default/NES_RA_ADAPTER?"
 
+/**
+ * defines to send the RetroAchievements requests (and the image downloads of its media host)
+ * to a local server instead, e.g. misc/ra-mock-server - to benchmark downloads, JSON filtering
+ * and retries offline. Only the scheme and host are replaced, path and query are kept.
+ * The HTTP clients always use TLS, so run the server with --tls
+ */
+
+#define ENABLE_RA_MOCK_SERVER 0 // 0 - disable / 1 - enable
+#define RA_MOCK_SERVER_URL "https://192.168.0.100:8443"
+
+/**
+ * fetch the user's hardcore unlocks before the patch and stub the conditions of the
+ * achievements already unlocked, so the Pico does not parse/keep triggers that will
+ * never be evaluated (they are kept with ID/title for display)
+ */
+
+#define ENABLE_SKIP_UNLOCKED_ACHIEVEMENTS 1 // 0 - disable / 1 - enable
+
+/**
+ * clean the patch while it is downloaded (JsonStreamFilter.h): whitespace, the fields the Pico
+ * does not use and the unofficial achievements never reach the response buffer, so a raw
+ * patch bigger than the buffer can still be loaded if it fits once filtered
+ */
+
+#define ENABLE_STREAMING_JSON_FILTER 1 // 0 - disable / 1 - enable
+
+/**
+ * keep the leaderboards in the patch (the Pico firmware needs ENABLE_LEADERBOARD_SUPPORT).
+ * They are still stripped when the patch does not fit the Pico serial buffer
+ */
+
+#define ENABLE_LEADERBOARDS 1 // 0 - disable / 1 - enable
+
+/**
+ * keep the cleaned patch of each game on LittleFS (with its CRC32) and answer the next
+ * r=patch of the same game from it, without downloading and cleaning it again. After
+ * PATCH_CACHE_REVALIDATE_SESSIONS sessions served from the cache, the patch is downloaded
+ * again and the cache updated. The hardcore unlocks are still requested every session
+ */
+
+#define ENABLE_PATCH_CACHE 1 // 0 - disable / 1 - enable
+#define PATCH_CACHE_REVALIDATE_SESSIONS 5
+
+/**
+ * as soon as the cartridge is identified (CRC_FOUND_MD5), resolve the game ID and download and
+ * clean the patch in a background task, while the Pico logs in and loads the game. The Pico's
+ * r=gameid and r=patch requests are then answered with what the task staged
+ */
+
+#define ENABLE_PATCH_PREFETCH 1 // 0 - disable / 1 - enable
+
+/**
+ * keep the login (user, token and the Pico's login answer) on LittleFS, so the power-on skips
+ * the password login and the Pico's login is answered locally. The cached token is checked
+ * with the server in the background once the adapter is up; it is dropped if the server
+ * rejects it or an award, and renewed with the password after LOGIN_CACHE_MAX_BOOTS power-ons
+ */
+
+#define ENABLE_LOGIN_CACHE 1 // 0 - disable / 1 - enable
+#define LOGIN_CACHE_MAX_BOOTS 20
+
+/**
+ * send the awards and leaderboard entries through an HTTPS connection of their own, so they
+ * never wait behind a patch, a badge download or a ping. Costs the heap of a second TLS session
+ */
+
+#define ENABLE_AWARD_CONNECTION 1 // 0 - disable / 1 - enable
+
+/**
+ * keep award/leaderboard requests that fail for lack of connectivity in an append-only
+ * journal on LittleFS, answer the Pico locally and replay them in order (with backoff)
+ * when the connection is back, instead of stopping the session
+ */
+
+#define ENABLE_OFFLINE_JOURNAL 1 // 0 - disable / 1 - enable
+
+/**
+ * after syncing, ask the Pico for a faster UART (BAUD=<rate>) and verify it with a test
+ * pattern. Rates are tried in order; the link stays at 115200 if none is verified
+ * (the Pico firmware needs ENABLE_LINK_BAUD_NEGOTIATION)
+ */
+
+#define ENABLE_FAST_LINK 1 // 0 - disable / 1 - enable
+
+/**
+ * stream RESP bodies with a credit window: the Pico sends an ACK byte (0x06) for every
+ * LINK_FLOW_BLOCK_SIZE bytes it consumed and at most LINK_FLOW_WINDOW_BLOCKS blocks are
+ * unacknowledged. A stalled response goes on with the fixed 32B/5ms pacing until the ACKs
+ * come back; if the Pico never acknowledged a block the pacing is kept for the session
+ * (the Pico firmware needs ENABLE_LINK_FLOW_ACK)
+ */
+
+#define ENABLE_LINK_FLOW_CONTROL 1 // 0 - disable / 1 - enable
+
+/**
+ * after syncing, switch the link to CRC32 checked frames (LinkFrame.h). Commands to the Pico
+ * are split in frames acknowledged one by one and only the frames after a corrupted one are
+ * resent (the Pico firmware needs ENABLE_LINK_FRAMING)
+ */
+
+#define ENABLE_LINK_FRAMING 1 // 0 - disable / 1 - enable
+
 /**
  enable internal web app (comment to disable)
 */
@@ -94,6 +196,10 @@
 #include <Wire.h>
 #include <Ticker.h>
 #include "CharBufferStream.h"
+#include "LinkFrame.h"
+#include "JsonStreamFilter.h"
+#include "HttpChunkedDecoder.h"
+#include <lwip/sockets.h>
 
 #ifdef ENABLE_LCD
   #include <PNGdec.h>
@@ -125,11 +231,29 @@
 #define ANALOG_SWITCH_DISABLE_BUS LOW
 
 /**
- * defines for sending big serial data into chunks with a delay
+ * defines for sending big serial data into chunks with a delay (used when the Pico does
+ * not acknowledge blocks)
  */
 #define SERIAL_COMM_CHUNK_SIZE 32
 #define SERIAL_COMM_TX_DELAY_MS 5
 
+/**
+ * defines for the credit window used to stream responses to the Pico - the window must
+ * fit in the Pico RX ring (4KB)
+ */
+#define LINK_FLOW_ACK 0x06
+#define LINK_FLOW_BLOCK_SIZE 1024
+#define LINK_FLOW_WINDOW_BLOCKS 2
+#define LINK_FLOW_ACK_TIMEOUT_MS 1000
+
+/**
+ * defines for the framed link - frames sent to the Pico without ACK (window) and how many
+ * times the same frame is resent before the command is dropped
+ */
+#define LINK_FRAME_WINDOW 2
+#define LINK_FRAME_ACK_TIMEOUT_MS 1000
+#define LINK_FRAME_MAX_RETRIES 5
+
 #define SERIAL_MAX_PICO_BUFFER 102400
 /**
  * defines for the fifo used to store achievements to be showed on screen
@@ -205,6 +329,7 @@ typedef enum HttpRequestResult
   HTTP_ERR_HTTP_4XX = -3,
   HTTP_ERR_TIMEOUT = -4,
   HTTP_ERR_REPONSE_TOO_BIG = -5,
+  HTTP_ERR_CANCELLED = -6,
 };
 
 // Device state machine states
@@ -248,6 +373,7 @@ typedef struct
   uint32_t id;
   String title;
   String url;
+  unsigned long queued_at; // millis() of the A= command - its badge is downloaded meanwhile
 } achievements_t;
 
 // type to store the achievement fifo
@@ -292,7 +418,9 @@ bool fifo_is_empty(achievements_FIFO_t *fifo);
 bool fifo_is_full(achievements_FIFO_t *fifo);
 bool fifo_enqueue(achievements_FIFO_t *fifo, achievements_t value);
 bool fifo_dequeue(achievements_FIFO_t *fifo, achievements_t *value);
+achievements_t* fifo_peek(achievements_FIFO_t *fifo);
 void show_achievement(achievements_t achievement);
+bool achievement_image_ready(achievements_t *achievement);
 
 
 // global variables for LED control
@@ -342,31 +470,204 @@ uint16_t unlocked_achievements = 0;
 
 // global variables for storing states, timestamps and useful information
 String ra_user_token;
+char ra_user_name[64] = ""; // the EEPROM is closed after setup
 
 // Buffer fixo para comunicação serial com o Pico (evita fragmentação de memória)
 // Reduzido para economizar RAM - comandos típicos são < 512 bytes
 #define SERIAL_BUFFER_SIZE 768
 char serial_buffer[SERIAL_BUFFER_SIZE];
 size_t serial_buffer_len = 0;
+bool link_flow_ack = ENABLE_LINK_FLOW_CONTROL == 1; // cleared when the Pico never acknowledged a block
+bool link_flow_ack_seen = false;                    // the Pico acknowledged a block at least once
+
+// framed link state
+bool link_framing = false;
+LinkFrameDecoder pico_frame_decoder;
+uint8_t pico_command[SERIAL_BUFFER_SIZE]; // command from the Pico being put together from its frames
+size_t pico_command_len = 0;
+bool pico_command_discard = false;
+uint8_t link_tx_seq = 0;
+bool link_ack_received = false;
+uint8_t link_ack_seq = 0;
+bool link_nak_received = false;
+uint8_t link_nak_seq = 0;
+uint32_t link_retransmits = 0;
 
 // Flexible buffer for large HTTP responses 
 #define LARGE_BUFFER_SIZE 102400 // 100 KB 
 #define SMALL_BUFFER_SIZE 10240 // 10 KB
+#define HTTP_READ_BLOCK_SIZE 4096 // raw body staged at the end of the buffer when it is filtered
 CharBufferStream response;
-// HTTP client global to reuse SSL buffers (avoids fragmentation)
-NetworkClientSecure globalSecureClient;
-HTTPClient globalHttpClient;
+// JSON cleaner - on the patch while it is downloaded (ENABLE_STREAMING_JSON_FILTER) and on
+// whole buffers (clean_json_buffer)
+JsonStreamFilter json_filter;
+// HTTPS client and its kept-alive connection - the TLS connection stays open between requests
+// to the same host (e.g. a burst of awards) and is only closed when the host changes or it
+// fails. A TLS session cannot be shared, so each task doing requests has its own
+struct HttpConnection {
+  const char* name;
+  NetworkClientSecure client;
+  HTTPClient http;
+  char host[64]; // host the client is connected to
+  // metrics - a TLS handshake takes hundreds of ms and a big chunk of heap on the C3
+  uint32_t requests;
+  uint32_t handshakes;
+  uint32_t handshake_total_ms;
+  uint32_t handshake_last_ms; // 0 when the last request reused the connection
+  volatile bool cancelled;    // set by loop() to stop the request in progress
+  int status;                 // HTTP status of the last attempt, 0 when no answer came
+
+  HttpConnection(const char* name) : name(name), requests(0), handshakes(0), handshake_total_ms(0), handshake_last_ms(0),
+                                     cancelled(false), status(0) {
+    host[0] = '\0';
+  }
+};
+// connection of loop() - global to reuse SSL buffers (avoids fragmentation)
+HttpConnection http_main("main");
+
+// Patch prefetch (ENABLE_PATCH_PREFETCH) - the task owns the prefetch_* variables while
+// prefetch_state is PREFETCH_RUNNING, except prefetch_gameid_response once prefetch_gameid_ready
+#define PREFETCH_IDLE 0
+#define PREFETCH_RUNNING 1
+#define PREFETCH_READY 2
+#define PREFETCH_FAILED 3
+#define PREFETCH_TASK_STACK_SIZE 8192
+volatile uint8_t prefetch_state = PREFETCH_IDLE;
+volatile bool prefetch_gameid_ready = false;
+char prefetch_md5[34];
+char prefetch_token[64];
+char prefetch_game[16];
+char prefetch_gameid_response[96]; // answer to the Pico's r=gameid
+CharBufferStream prefetch_buffer;  // the large buffer, lent by loop() while the task runs
+JsonStreamFilter prefetch_filter;
+HttpConnection http_prefetch("prefetch");
+
+// Forward declarations for functions using HttpConnection (see Led above)
+int perform_http_request_buffer(HttpConnection &conn, const char* url, HttpRequestMethod method, const char* payload,
+                                size_t payload_len, CharBufferStream &resp, bool isIdempotent, int maxRetries,
+                                int timeoutMs, int retryDelayMs, JsonStreamFilter* filter);
+bool prepare_http_connection(HttpConnection &conn, const char* url);
+void log_http_metrics(HttpConnection &conn, unsigned long request_start);
+void close_http_connection(HttpConnection &conn);
+void wait_http_data(HttpConnection &conn, uint32_t timeoutMs);
+
+// HTTP scheduler - the HTTP requests run in worker tasks, so loop() keeps serving the Pico, the
+// LCD and the web app during a download. loop() fills a job slot and queues it with a priority
+// class; whenever a worker is idle, loop() gives it the most urgent job it may run (the oldest
+// one within a class). The worker runs it and hands it back, and loop() calls its done callback.
+// Each worker has its own connection and response buffer, which the job uses from the start of
+// run to the end of done - so at most HTTP_WORKERS connections are open (plus the prefetch's).
+// With ENABLE_AWARD_CONNECTION the second worker only runs awards, and the first one never does.
+#define HTTP_WORKERS (1 + ENABLE_AWARD_CONNECTION)
+#define HTTP_WORKER_STACK_SIZE 12288
+#define HTTP_JOB_SLOTS 6
+#define HTTP_JOB_SLOTS_RESERVED 2 // never taken by background jobs (e.g. a burst of badges)
+#define AWARD_BUFFER_SIZE 4096
+#define ACHIEVEMENT_IMAGE_WAIT_MS 5000 // longest an achievement waits for its badge
+#define IMAGE_READ_TIMEOUT_MS 20000 // download given up when no byte came for this long
+#define HTTP_KEEPALIVE_MS 10000 // WAIT=<request id> to the Pico - its requests time out after 30s
+#define PICO_BUSY_TIMEOUT_MS 10000 // longest the answers are held after BUSY if READY is lost
+enum HttpPriority : uint8_t {
+  HTTP_PRIORITY_AWARD,     // awards, leaderboard entries and their journal replay
+  HTTP_PRIORITY_PATCH,     // login, game ID, patch and the other requests of the Pico
+  HTTP_PRIORITY_BACKGROUND // presence pings, badge images, login check
+};
+enum HttpJobState : uint8_t {
+  HTTP_JOB_FREE,
+  HTTP_JOB_QUEUED,
+  HTTP_JOB_RUNNING // or waiting for its done callback
+};
+struct HttpJob;
+typedef void (*http_job_handler_t)(HttpJob &job);
+struct HttpJob {
+  http_job_handler_t run;  // in a worker task
+  http_job_handler_t done; // in loop() - also when the job is cancelled before it runs
+  HttpJobState state;
+  HttpPriority priority;
+  uint32_t seq;            // queue order
+  HttpConnection* conn;    // of the worker running the job
+  CharBufferStream* resp;  // of the worker running the job - NULL if it never ran
+  int result;
+  DeviceState error_state; // set by run when the session cannot go on, STATE_UNINITIALIZED otherwise
+  char request_id[16];
+  char url[256];
+  char data[512];
+  size_t data_len;
+};
+struct HttpWorker {
+  const char* name;
+  HttpConnection* conn;
+  CharBufferStream* resp;
+  bool awards_only;
+  QueueHandle_t queue;     // the job given by loop()
+  TaskHandle_t handle;
+  HttpJob* job;            // running or waiting for its done callback - changed by loop() only
+};
+#if ENABLE_AWARD_CONNECTION == 1
+HttpConnection http_award("award");
+CharBufferStream award_response;
+#endif
+HttpWorker http_workers[HTTP_WORKERS] = {
+  {"http", &http_main, &response, false, NULL, NULL, NULL},
+#if ENABLE_AWARD_CONNECTION == 1
+  {"http_award", &http_award, &award_response, true, NULL, NULL, NULL},
+#endif
+};
+HttpJob http_jobs[HTTP_JOB_SLOTS];
+uint32_t http_job_seq = 0;
+unsigned long http_keepalive_at = 0;
+// BUSY from the Pico: it writes its flash with the interrupts off and would lose what we send,
+// so the answers and keepalives are held until READY
+bool pico_busy = false;
+unsigned long pico_busy_since = 0;
+QueueHandle_t http_done_queue = NULL; // jobs run, waiting for their done callback
+
+// Forward declarations for functions using HttpJob / HttpWorker
+HttpJob* http_job_alloc(HttpPriority priority);
+void http_job_submit(HttpJob* job, HttpPriority priority, http_job_handler_t run, http_job_handler_t done);
+void http_job_cancel(HttpJob* job);
+HttpJob* http_job_find(http_job_handler_t run, const char* data);
+bool http_job_queued(http_job_handler_t run);
+bool http_worker_accepts(HttpWorker &worker, HttpJob &job);
+void http_job_pico_request(HttpJob &job);
+void http_job_pico_response(HttpJob &job);
+void http_job_download_image(HttpJob &job);
+void http_job_image_done(HttpJob &job);
+void journal_replay_run(HttpJob &job);
+void journal_replay_done(HttpJob &job);
+void login_verify_run(HttpJob &job);
+void login_verify_done(HttpJob &job);
+int try_download_file(HttpConnection &conn, String url, String file_name);
+int download_file_to_littleFS(HttpConnection &conn, String url, String file_name);
 bool httpClientInitialized = false;
 
 // Cartridge MD5 - use fixed buffer instead of String to avoid fragmentation
 char md5_global[34] = {0};
 
+// Hardcore unlocks of the current game (sorted) - used to stub unlocked achievements in the patch
+#define MAX_UNLOCKED_ACHIEVEMENTS 512
+uint32_t unlocked_ids[MAX_UNLOCKED_ACHIEVEMENTS];
+uint16_t unlocked_ids_count = 0;
+
+// Index of the achievements of the patch, built by reduce_patch_achievements_buffer
+#define MAX_PATCH_ACHIEVEMENTS 512 // later achievements are never dropped
+#define PATCH_MEMADDR_MAX_SIZE 8192 // longer triggers are always dropped
+struct PatchAchievement {
+  uint32_t start;      // '{'
+  uint32_t length;     // up to and including '}'
+  uint32_t memAddrLen;
+  bool unlocked;
+  bool drop;
+};
+PatchAchievement patch_achievements[MAX_PATCH_ACHIEVEMENTS];
+
 String game_name;
 String game_image;
 String game_id;
 String game_session;
 bool go_back_to_title_screen = false;
 bool already_showed_title_screen = false;
+char rich_presence[128] = ""; // last rich presence text received from the Pico (RP=)
 long go_back_to_title_screen_timestamp;
 unsigned long last_wifi_status_update = 0;
 
@@ -539,294 +840,327 @@ bool get_MD5(const char* crc, bool first_bank, char* md5_out, size_t md5_out_siz
 }
 // ============================================================================
 // JSON cleaning functions that operate directly on CharBufferStream (in-place)
-// They do not copy memory - they modify the original buffer
+// They do not copy memory - each one is a single JsonStreamFilter scan of the buffer
 // ============================================================================
 
-// Remove spaces, newlines, and tabs outside of strings (in-place on CharBufferStream)
-void remove_space_new_lines_buffer(CharBufferStream &buf)
-{
-  char* data = buf.data();
-  size_t len = buf.length();
-  bool inside_quotes = false;
-  size_t write_idx = 0;
-
-  for (size_t read_idx = 0; read_idx < len; read_idx++)
-  {
-    char c = data[read_idx];
-
-    if (c == '"' && (read_idx == 0 || data[read_idx - 1] != '\\')) {
-      inside_quotes = !inside_quotes;
-    }
+// fields and objects of the patch the Pico does not use - one JsonStreamFilter pass applies
+// them all, while the patch downloads (ENABLE_STREAMING_JSON_FILTER) or after it
+const JsonFilterRule patch_rules[] = {
+  {"Warning", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+  {"BadgeLockedURL", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+  {"BadgeURL", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+  {"ImageIconURL", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+  {"Rarity", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+  {"RarityHardcore", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+  {"Author", JSON_RULE_REMOVE, nullptr, 0, nullptr},
+  {"Flags", JSON_RULE_DROP_IF_EQUAL, "5", 0, "Achievements"}, // unofficial achievements
+#if ENABLE_LEADERBOARDS == 0
+  {"Leaderboards", JSON_RULE_EMPTY_ARRAY, nullptr, 0, nullptr},
+#endif
+};
 
-    if (inside_quotes || (c != ' ' && c != '\n' && c != '\r' && c != '\t')) {
-      data[write_idx++] = c;
-    }
-  }
-  buf.setLength(write_idx);
+// Apply a rule set to the whole buffer in a single scan (in-place on CharBufferStream)
+void clean_json_buffer(CharBufferStream &buf, const JsonFilterRule* rules, size_t rule_count)
+{
+  json_filter.setRules(rules, rule_count);
+  buf.setLength(json_filter.cleanInPlace(buf.data(), buf.length()));
 }
 
 // Remove a complete JSON field (in-place on CharBufferStream)
 void remove_json_field_buffer(CharBufferStream &buf, const char* field_to_remove)
 {
-  remove_space_new_lines_buffer(buf);
-  
-  char* data = buf.data();
-  size_t len = buf.length();
-  size_t field_len = strlen(field_to_remove);
-  
-  bool inside_quotes = false;
-  bool inside_array = false;
-  bool skip_field = false;
-  size_t read_idx = 0, write_idx = 0, skip_init = 0;
-
-  while (read_idx < len)
-  {
-    char c = data[read_idx];
-
-    if (c == '"' && (read_idx == 0 || data[read_idx - 1] != '\\')) {
-      inside_quotes = !inside_quotes;
-    }
-
-    if (c == '[' && skip_field) inside_array = true;
-    if (c == ']' && skip_field) inside_array = false;
-
-    // Detect start of field to remove
-    if (inside_quotes && 
-        read_idx + 1 + field_len + 1 < len &&
-        strncmp(data + read_idx + 1, field_to_remove, field_len) == 0 &&
-        data[read_idx + field_len + 1] == '"')
-    {
-      skip_field = true;
-      skip_init = read_idx;
-    }
-
-    if (!skip_field) {
-      data[write_idx++] = c;
-    }
-
-    // End of field
-    if (skip_field && read_idx + 1 < len && data[read_idx + 1] == '}') {
-      skip_field = false;
-      if (skip_init > 0 && data[skip_init - 1] == ',') {
-        write_idx--;
-      }
-    }
-    else if (skip_field && data[read_idx] == ',' && !inside_array && !inside_quotes) {
-      skip_field = false;
-    }
-
-    read_idx++;
-  }
-  buf.setLength(write_idx);
+  const JsonFilterRule rule = {field_to_remove, JSON_RULE_REMOVE, nullptr, 0, nullptr};
+  clean_json_buffer(buf, &rule, 1);
 }
 
 // Clean the string value of a field - replace with "" (in-place on CharBufferStream)
 void clean_json_field_str_value_buffer(CharBufferStream &buf, const char* field_to_remove)
 {
-  remove_space_new_lines_buffer(buf);
-  
-  char* data = buf.data();
-  size_t len = buf.length();
-  size_t field_len = strlen(field_to_remove);
-  
-  bool inside_quotes = false;
-  bool skip_field = false;
-  bool remove_next_str = false;
-  size_t read_idx = 0, write_idx = 0, skip_init = 0;
-
-  while (read_idx < len)
-  {
-    char c = data[read_idx];
-
-    if (c == '"' && (read_idx == 0 || data[read_idx - 1] != '\\'))
-    {
-      inside_quotes = !inside_quotes;
-      if (inside_quotes && remove_next_str) {
-        skip_field = true;
-        data[write_idx++] = '"';
-      }
-      if (!inside_quotes && remove_next_str && read_idx > skip_init) {
-        remove_next_str = false;
-        skip_field = false;
-      }
-    }
-
-    if (inside_quotes &&
-        read_idx + 1 + field_len + 1 < len &&
-        strncmp(data + read_idx + 1, field_to_remove, field_len) == 0 &&
-        data[read_idx + field_len + 1] == '"')
-    {
-      remove_next_str = true;
-      skip_init = read_idx + field_len + 2;
-    }
-
-    if (!skip_field) {
-      data[write_idx++] = c;
-    }
-    read_idx++;
-  }
-  buf.setLength(write_idx);
+  const JsonFilterRule rule = {field_to_remove, JSON_RULE_BLANK_STRING, nullptr, 0, nullptr};
+  clean_json_buffer(buf, &rule, 1);
 }
 
 // Clean the array value of a field - replace with [] (in-place on CharBufferStream)
 void clean_json_field_array_value_buffer(CharBufferStream &buf, const char* field_to_remove)
 {
-  remove_space_new_lines_buffer(buf);
-  
-  char* data = buf.data();
-  size_t len = buf.length();
-  size_t field_len = strlen(field_to_remove);
-  
-  bool inside_quotes = false;
-  bool skip_field = false;
-  bool remove_next_array = false;
-  int array_depth = 0;
-  size_t read_idx = 0, write_idx = 0;
-
-  while (read_idx < len)
-  {
-    char c = data[read_idx];
+  const JsonFilterRule rule = {field_to_remove, JSON_RULE_EMPTY_ARRAY, nullptr, 0, nullptr};
+  clean_json_buffer(buf, &rule, 1);
+}
 
-    // Update quote state first (handling escaped quotes)
-    if (c == '"' && (read_idx == 0 || data[read_idx - 1] != '\\')) {
-      inside_quotes = !inside_quotes;
+// Helper: find closing quote handling escaped quotes
+int findClosingQuote(char* data, int start, int limit) {
+  for (int i = start; i < limit; i++) {
+    if (data[i] == '"' && (i == 0 || data[i - 1] != '\\')) {
+      return i;
     }
+  }
+  return -1;
+}
 
-    // Only process [ and ] when NOT inside quotes
-    if (!inside_quotes) {
-      if (c == '[') {
-        if (remove_next_array) {
-          if (array_depth == 0) {
-            skip_field = true;
-            data[write_idx++] = '[';
-          }
-          array_depth++;
-        }
-      }
-      if (c == ']') {
-        if (remove_next_array) {
-          array_depth--;
-          if (array_depth == 0) {
-            remove_next_array = false;
-            skip_field = false;
-          }
-        }
-      }
+// Position of needle in data[from, to), or -1
+int find_in_range(const char* data, int from, int to, const char* needle)
+{
+  int needle_len = strlen(needle);
+  for (int i = from; i + needle_len <= to; i++) {
+    if (data[i] == needle[0] && memcmp(data + i, needle, needle_len) == 0) {
+      return i;
     }
+  }
+  return -1;
+}
 
-    // Detect the field name to remove
-    if (inside_quotes &&
-        read_idx + 1 + field_len + 1 < len &&
-        strncmp(data + read_idx + 1, field_to_remove, field_len) == 0 &&
-        data[read_idx + field_len + 1] == '"')
-    {
-      remove_next_array = true;
-    }
+// Order of the drop candidates: unlocked achievements first, then the biggest ones
+int compare_patch_achievement_drop(const void* a, const void* b)
+{
+  const PatchAchievement* x = (const PatchAchievement*)a;
+  const PatchAchievement* y = (const PatchAchievement*)b;
+  if (x->unlocked != y->unlocked) return x->unlocked ? -1 : 1;
+  return (x->length < y->length) - (x->length > y->length);
+}
 
-    if (!skip_field) {
-      data[write_idx++] = c;
-    }
-    read_idx++;
-  }
-  buf.setLength(write_idx);
+int compare_patch_achievement_start(const void* a, const void* b)
+{
+  const PatchAchievement* x = (const PatchAchievement*)a;
+  const PatchAchievement* y = (const PatchAchievement*)b;
+  return (x->start > y->start) - (x->start < y->start);
 }
 
-// Remove achievements with flags 5 (unofficial) - in-place on CharBufferStream
-void remove_achievements_with_flags_5_buffer(CharBufferStream &buf)
+// Drop achievements until the patch fits in budget bytes - in-place on CharBufferStream.
+// One scan indexes the size and MemAddr length of every achievement, the fewest achievements
+// that free enough bytes are chosen (unlocked ones first, then the biggest) and the array is
+// compacted once. Achievements with a MemAddr longer than maxMemAddr are always dropped.
+// Returns the number of achievements dropped.
+int reduce_patch_achievements_buffer(CharBufferStream &buf, size_t budget, uint32_t maxMemAddr)
 {
-  remove_space_new_lines_buffer(buf);
-  
   char* data = buf.data();
-  int achvStart = buf.indexOf("\"Achievements\":[");
-  if (achvStart == -1) return;
+  int achievementsPos = buf.indexOf("\"Achievements\"");
+  if (achievementsPos == -1) return 0;
 
-  int arrayStart = buf.indexOf("[", achvStart);
-  int arrayEnd = buf.indexOf("]", arrayStart);
-  if (arrayStart == -1 || arrayEnd == -1) return;
+  int arrayStart = buf.indexOf('[', achievementsPos);
+  if (arrayStart == -1) return 0;
 
-  int objCount = 0;
+  // index
+  int count = 0;
+  int arrayEnd = -1;
+  size_t freed = 0;
   int pos = arrayStart + 1;
-  
-  while (pos < arrayEnd)
+  while (pos < (int)buf.length())
   {
-    int objStart = buf.indexOf("{", pos);
-    if (objStart == -1 || objStart > arrayEnd) break;
+    char ch = data[pos];
+    if (ch == ']') {
+      arrayEnd = pos;
+      break;
+    }
+    if (ch != '{') {
+      pos++; // ',' and whitespace
+      continue;
+    }
 
-    int objEnd = objStart;
-    int braces = 1;
+    int objEnd = pos;
+    int braceCount = 1;
     bool inString = false;
-    while (braces > 0 && objEnd < arrayEnd) {
+    while (braceCount > 0 && objEnd + 1 < (int)buf.length()) {
       objEnd++;
-      char ch = data[objEnd];
-      if (ch == '"' && (objEnd == 0 || data[objEnd - 1] != '\\')) {
+      ch = data[objEnd];
+      if (ch == '"' && data[objEnd - 1] != '\\') {
         inString = !inString;
       }
       if (!inString) {
-        if (ch == '{') braces++;
-        else if (ch == '}') braces--;
+        if (ch == '{') braceCount++;
+        else if (ch == '}') braceCount--;
       }
     }
+    if (braceCount > 0) return 0; // truncated JSON - leave it as it is
+    if (count == MAX_PATCH_ACHIEVEMENTS) {
+      pos = objEnd + 1;
+      continue;
+    }
 
-    if (objEnd >= arrayEnd) break;
-    objCount++;
-
-    // Search for "Flags":5 inside the object
-    bool hasFlags5 = false;
-    for (int i = objStart; i < objEnd - 8; i++) {
-      if (strncmp(data + i, "\"Flags\":5", 9) == 0) {
-        hasFlags5 = true;
-        break;
+    PatchAchievement* achievement = &patch_achievements[count++];
+    achievement->start = pos;
+    achievement->length = objEnd + 1 - pos;
+    achievement->memAddrLen = 0;
+    int memAddrPos = find_in_range(data, pos, objEnd, "\"MemAddr\":\"");
+    if (memAddrPos != -1) {
+      int valueEnd = findClosingQuote(data, memAddrPos + 11, objEnd);
+      if (valueEnd != -1) achievement->memAddrLen = valueEnd - memAddrPos - 11;
+    }
+    int idPos = find_in_range(data, pos, objEnd, "\"ID\":");
+    achievement->unlocked = idPos != -1 && is_achievement_unlocked(strtoul(data + idPos + 5, NULL, 10));
+    achievement->drop = achievement->memAddrLen > maxMemAddr;
+    if (achievement->drop) freed += achievement->length + 1; // and a ','
+    pos = objEnd + 1;
+  }
+  if (arrayEnd == -1) return 0;
+
+  // choose
+  if (buf.length() - freed > budget) {
+    qsort(patch_achievements, count, sizeof(PatchAchievement), compare_patch_achievement_drop);
+    for (int i = 0; i < count && buf.length() - freed > budget; i++) {
+      if (!patch_achievements[i].drop) {
+        patch_achievements[i].drop = true;
+        freed += patch_achievements[i].length + 1;
       }
     }
+    qsort(patch_achievements, count, sizeof(PatchAchievement), compare_patch_achievement_start);
+  }
 
-    if (hasFlags5)
-    {
-      int removeStart = objStart;
-      while (removeStart > arrayStart && (data[removeStart - 1] == ' ' || data[removeStart - 1] == '\n'))
-        removeStart--;
-      if (data[removeStart - 1] == ',')
-        removeStart--;
-      if (objCount == 1 && objEnd + 1 < (int)buf.length() && data[objEnd + 1] == ',')
-        objEnd++;
-
-      buf.removeRange(removeStart, objEnd - removeStart + 1);
-      arrayEnd = buf.indexOf("]", arrayStart);
-      pos = removeStart;
+  // compact
+  int dropped = 0;
+  int unlockedDropped = 0;
+  for (int i = 0; i < count; i++) {
+    if (patch_achievements[i].drop) {
+      dropped++;
+      if (patch_achievements[i].unlocked) unlockedDropped++;
     }
-    else
+  }
+  if (dropped == 0) return 0;
+
+  size_t before = buf.length();
+  size_t write = arrayStart + 1;
+  for (int i = 0; i < count; i++) {
+    if (patch_achievements[i].drop) continue;
+    if (write > (size_t)arrayStart + 1) data[write++] = ',';
+    memmove(data + write, data + patch_achievements[i].start, patch_achievements[i].length);
+    write += patch_achievements[i].length;
+  }
+  if (count == MAX_PATCH_ACHIEVEMENTS) {
+    // achievements past the index are kept as they are
+    size_t rest = patch_achievements[count - 1].start + patch_achievements[count - 1].length;
+    while (rest < (size_t)arrayEnd && data[rest] != '{') rest++;
+    if (rest < (size_t)arrayEnd) {
+      if (write > (size_t)arrayStart + 1) data[write++] = ',';
+      memmove(data + write, data + rest, arrayEnd - rest);
+      write += arrayEnd - rest;
+    }
+  }
+  memmove(data + write, data + arrayEnd, buf.length() - arrayEnd);
+  buf.setLength(write + buf.length() - arrayEnd);
+
+  Serial.printf("REDUCE: dropped %d achievements (%d unlocked), %lu -> %lu bytes\n", dropped, unlockedDropped,
+                (unsigned long)before, (unsigned long)buf.length());
+  return dropped;
+}
+
+// ============================================================================
+// Hardcore unlocks - used to stub achievements the user already has
+// ============================================================================
+
+// Copy the value of a form-encoded parameter (e.g. "g" in "r=patch&u=x&g=1") into out
+// Returns true if the parameter was found
+bool get_request_param(const char* data, const char* key, char* out, size_t out_size)
+{
+  size_t key_len = strlen(key);
+  const char* p = data;
+  while (p != NULL && *p != '\0')
+  {
+    if (strncmp(p, key, key_len) == 0 && p[key_len] == '=')
     {
-      pos = objEnd + 1;
+      const char* value = p + key_len + 1;
+      size_t len = strcspn(value, "&");
+      if (len >= out_size) len = out_size - 1;
+      memcpy(out, value, len);
+      out[len] = '\0';
+      return true;
     }
+    p = strchr(p, '&');
+    if (p != NULL) p++;
   }
+  out[0] = '\0';
+  return false;
 }
 
-// Helper: find closing quote handling escaped quotes
-int findClosingQuote(char* data, int start, int limit) {
-  for (int i = start; i < limit; i++) {
-    if (data[i] == '"' && (i == 0 || data[i - 1] != '\\')) {
-      return i;
+int compare_uint32(const void* a, const void* b)
+{
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+// binary search in the sorted unlocked_ids list
+bool is_achievement_unlocked(uint32_t id)
+{
+  return bsearch(&id, unlocked_ids, unlocked_ids_count, sizeof(uint32_t), compare_uint32) != NULL;
+}
+
+// Parse "UserUnlocks":[1,2,3] from an r=unlocks response into unlocked_ids (sorted)
+void parse_unlocked_ids_buffer(CharBufferStream &buf)
+{
+  unlocked_ids_count = 0;
+  int start = buf.indexOf("\"UserUnlocks\":[");
+  if (start == -1) return;
+
+  const char* p = buf.c_str() + start + 15;
+  while (*p != '\0' && *p != ']' && unlocked_ids_count < MAX_UNLOCKED_ACHIEVEMENTS)
+  {
+    char* end;
+    uint32_t id = strtoul(p, &end, 10);
+    if (end == p) {
+      p++; // skip ',' and anything unexpected
+      continue;
     }
+    unlocked_ids[unlocked_ids_count++] = id;
+    p = end;
   }
-  return -1;
+  qsort(unlocked_ids, unlocked_ids_count, sizeof(uint32_t), compare_uint32);
+}
+
+// Request the hardcore unlocks of the game being loaded, using the user/token/game of the
+// patch request. Uses the shared response buffer, so call it before downloading the patch.
+void fetch_hardcore_unlocks(const char* url, const char* patch_data)
+{
+  unlocked_ids_count = 0;
+
+  char user[64];
+  char token[64];
+  char game_id_str[16];
+  if (!get_request_param(patch_data, "u", user, sizeof(user)) ||
+      !get_request_param(patch_data, "t", token, sizeof(token)) ||
+      !get_request_param(patch_data, "g", game_id_str, sizeof(game_id_str)))
+  {
+    Serial.println(F("UNLOCKS: missing u/t/g in patch request"));
+    return;
+  }
+
+  char data[192];
+  int data_len = snprintf(data, sizeof(data), "r=unlocks&u=%s&t=%s&g=%s&h=1", user, token, game_id_str);
+
+  response.clear();
+  int ret = perform_http_request_buffer(http_main, url, POST, data, data_len, response, true, 1, 5000, 500, nullptr);
+  if (ret < 0) {
+    Serial.print(F("UNLOCKS: request failed: "));
+    Serial.println(http_request_result_to_cstr(ret));
+  } else {
+    parse_unlocked_ids_buffer(response);
+  }
+  response.clear();
+
+  Serial.print(F("UNLOCKS: "));
+  Serial.print(unlocked_ids_count);
+  Serial.println(F(" hardcore unlocks"));
 }
 
-// Remove achievements with very large MemAddr - in-place on CharBufferStream
-void remove_achievements_with_long_MemAddr_buffer(CharBufferStream &buf, uint32_t maxSize)
+// Replace MemAddr with a never-true trigger ("0=1") and blank the Description of every
+// achievement already unlocked in hardcore - in-place on CharBufferStream.
+// rcheevos still gets the ID/title (for counters and display) but parses a 1-condition
+// trigger instead of the real one.
+void stub_unlocked_achievements_buffer(CharBufferStream &buf)
 {
+  if (unlocked_ids_count == 0) return;
+
   char* data = buf.data();
   int achievementsPos = buf.indexOf("\"Achievements\"");
   if (achievementsPos == -1) return;
 
   int arrayStart = buf.indexOf("[", achievementsPos);
-  int arrayEnd = buf.indexOf("]", arrayStart);
-  if (arrayStart == -1 || arrayEnd == -1) return;
+  if (arrayStart == -1) return;
 
+  int stubbed = 0;
   int pos = arrayStart + 1;
-  
-  while (pos < arrayEnd)
+  while (pos < (int)buf.length() && data[pos] != ']')
   {
     int objStart = buf.indexOf("{", pos);
-    if (objStart == -1 || objStart >= arrayEnd) break;
+    if (objStart == -1) break;
 
     int objEnd = objStart;
     int braceCount = 1;
@@ -834,7 +1168,7 @@ void remove_achievements_with_long_MemAddr_buffer(CharBufferStream &buf, uint32_
     while (braceCount > 0 && objEnd + 1 < (int)buf.length()) {
       objEnd++;
       char ch = data[objEnd];
-      if (ch == '"' && (objEnd == 0 || data[objEnd - 1] != '\\')) {
+      if (ch == '"' && data[objEnd - 1] != '\\') {
         inString = !inString;
       }
       if (!inString) {
@@ -842,66 +1176,177 @@ void remove_achievements_with_long_MemAddr_buffer(CharBufferStream &buf, uint32_
         else if (ch == '}') braceCount--;
       }
     }
+    if (braceCount > 0) break;
 
-    if (objEnd >= arrayEnd) break;
-
-    // Search for "MemAddr"
-    int memAddrPos = -1;
-    for (int i = objStart; i < objEnd - 8; i++) {
-      if (strncmp(data + i, "\"MemAddr\"", 9) == 0) {
-        memAddrPos = i;
-        break;
+    int idPos = find_in_range(data, objStart, objEnd, "\"ID\":");
+    if (idPos != -1 && is_achievement_unlocked(strtoul(data + idPos + 5, NULL, 10)))
+    {
+      // "Description":"..." -> "Description":""
+      int descStart = -1, descEnd = -1;
+      int descPos = find_in_range(data, objStart, objEnd, "\"Description\":\"");
+      if (descPos != -1) {
+        descStart = descPos + 15;
+        descEnd = findClosingQuote(data, descStart, objEnd);
       }
-    }
-
-    if (memAddrPos == -1) {
-      pos = objEnd + 1;
-      continue;
-    }
 
-    int valueStart = buf.indexOf("\"", memAddrPos + 9);
-    if (valueStart == -1 || valueStart > objEnd) {
-      pos = objEnd + 1;
-      continue;
-    }
+      // "MemAddr":"..." -> "MemAddr":"0=1"
+      int memStart = -1, memEnd = -1;
+      int memAddrPos = find_in_range(data, objStart, objEnd, "\"MemAddr\":\"");
+      if (memAddrPos != -1) {
+        memStart = memAddrPos + 11;
+        memEnd = findClosingQuote(data, memStart, objEnd);
+        if (memEnd - memStart > 3) {
+          memcpy(data + memStart, "0=1", 3);
+          memStart += 3;
+        } else {
+          memEnd = memStart; // already short
+        }
+      }
 
-    int valueEnd = findClosingQuote(data, valueStart + 1, objEnd);
-    if (valueEnd == -1 || valueEnd > objEnd) {
-      pos = objEnd + 1;
-      continue;
+      // removals are deferred, so they must be marked in buffer order
+      if (memStart > descStart) {
+        if (descEnd > descStart) buf.markRemove(descStart, descEnd - descStart);
+        if (memEnd > memStart) buf.markRemove(memStart, memEnd - memStart);
+      } else {
+        if (memEnd > memStart) buf.markRemove(memStart, memEnd - memStart);
+        if (descEnd > descStart) buf.markRemove(descStart, descEnd - descStart);
+      }
+      stubbed++;
     }
+    pos = objEnd + 1;
+    while (pos < (int)buf.length() && (data[pos] == ',' || data[pos] == ' ')) pos++;
+  }
+  buf.commitRemovals();
 
-    int memAddrLength = valueEnd - valueStart - 1;
-    
-    if (memAddrLength > (int)maxSize)
-    {
-      int removeStart = objStart;
-      int removeEnd = objEnd + 1;
+  Serial.print(F("UNLOCKS: stubbed "));
+  Serial.print(stubbed);
+  Serial.println(F(" unlocked achievements"));
+}
 
-      if (removeEnd < (int)buf.length() && data[removeEnd] == ',')
-        removeEnd++;
-      else if (removeStart > arrayStart + 1 && data[removeStart - 1] == ',')
-        removeStart--;
+// ============================================================================
+// Rich presence compaction
+// ============================================================================
 
-      buf.removeRange(removeStart, removeEnd - removeStart);
-      arrayEnd -= (removeEnd - removeStart);
-      pos = removeStart;
-    }
-    else
-    {
-      pos = objEnd + 1;
-    }
+// Decode one character of a JSON string value starting at pos (escape aware)
+// Returns the position of the next character
+int json_string_char(const char* data, int pos, int end, char* out)
+{
+  if (data[pos] != '\\' || pos + 1 >= end) {
+    *out = data[pos];
+    return pos + 1;
+  }
+  switch (data[pos + 1]) {
+    case 'n': *out = '\n'; break;
+    case 'r': *out = '\r'; break;
+    case 't': *out = '\t'; break;
+    case 'u': *out = '?'; return min(pos + 6, end); // never a separator/comment/space
+    default: *out = data[pos + 1]; break; // \" \\ \/
   }
+  return pos + 2;
 }
 
+// Strip what the rcheevos rich presence parser ignores from RichPresencePatch, in-place:
+// "//" comments (and the whitespace before them) and the '\r' of each line ending.
+// Line breaks are kept, so a comment-only line becomes an empty line, which rcheevos
+// already treats the same way - the parsed script is unchanged.
+void compact_rich_presence_buffer(CharBufferStream &buf)
+{
+  int fieldPos = buf.indexOf("\"RichPresencePatch\":\"");
+  if (fieldPos == -1) return;
 
-void print_memory_stats(const char* label = "") {
-  Serial.println(F("=== MEMORY STATS ==="));
-  if (label[0] != '\0') { Serial.print(F("Label: ")); Serial.println(label); }
-  Serial.print(F("Free heap: ")); Serial.print(ESP.getFreeHeap()); Serial.println(F(" bytes"));
-  Serial.print(F("Largest block: ")); Serial.print(ESP.getMaxAllocHeap()); Serial.println(F(" bytes"));
-  Serial.print(F("Min free heap: ")); Serial.print(ESP.getMinFreeHeap()); Serial.println(F(" bytes"));
-  Serial.print(F("Buffer capacity: ")); Serial.print(response.capacity()); Serial.println(F(" bytes"));
+  char* data = buf.data();
+  int valueStart = fieldPos + 21;
+  int end = (int)buf.length();
+
+  // find the closing quote of the value
+  int valueEnd = valueStart;
+  while (valueEnd < end && data[valueEnd] != '"') {
+    valueEnd += (data[valueEnd] == '\\') ? 2 : 1;
+  }
+  if (valueEnd >= end) return;
+
+  int write = valueStart;
+  int read = valueStart;
+  while (read < valueEnd) {
+    // scan one line: keep_end is the raw end of what must be kept
+    int lineStart = read;
+    int keepEnd = -1;
+    int lastNonSpaceEnd = lineStart;
+    int lastCharStart = lineStart;
+    char prev = 0;
+    char c = 0;
+    int p = lineStart;
+    int newlineStart = valueEnd;
+    while (p < valueEnd) {
+      int next = json_string_char(data, p, valueEnd, &c);
+      if (c == '\n') {
+        newlineStart = p;
+        break;
+      }
+      if (c == '/' && prev != '\\' && next < valueEnd) {
+        char c2;
+        json_string_char(data, next, valueEnd, &c2);
+        if (c2 == '/') {
+          keepEnd = lastNonSpaceEnd; // comment: drop it and the whitespace before it
+        }
+      }
+      if (keepEnd != -1) {
+        // skip the rest of the line
+        while (p < valueEnd) {
+          next = json_string_char(data, p, valueEnd, &c);
+          if (c == '\n') break;
+          p = next;
+        }
+        newlineStart = p;
+        break;
+      }
+      if (c != ' ' && c != '\t' && c != '\r') {
+        lastNonSpaceEnd = next;
+      }
+      lastCharStart = p;
+      prev = c;
+      p = next;
+    }
+    if (keepEnd == -1) {
+      // no comment: trailing whitespace may be significant, only drop the '\r'
+      keepEnd = (prev == '\r') ? lastCharStart : newlineStart;
+    }
+
+    int keepLen = keepEnd - lineStart;
+    if (keepLen > 0 && write != lineStart) {
+      memmove(data + write, data + lineStart, keepLen);
+    }
+    write += keepLen;
+
+    read = newlineStart;
+    if (read < valueEnd) {
+      // copy the line break itself
+      int next = json_string_char(data, read, valueEnd, &c);
+      if (write != read) {
+        memmove(data + write, data + read, next - read);
+      }
+      write += next - read;
+      read = next;
+    }
+  }
+
+  if (write < valueEnd) {
+    int removed = valueEnd - write;
+    buf.removeRange(write, removed);
+    Serial.print(F("RICH PRESENCE: removed "));
+    Serial.print(removed);
+    Serial.println(F(" bytes"));
+  }
+}
+
+
+void print_memory_stats(const char* label = "") {
+  Serial.println(F("=== MEMORY STATS ==="));
+  if (label[0] != '\0') { Serial.print(F("Label: ")); Serial.println(label); }
+  Serial.print(F("Free heap: ")); Serial.print(ESP.getFreeHeap()); Serial.println(F(" bytes"));
+  Serial.print(F("Largest block: ")); Serial.print(ESP.getMaxAllocHeap()); Serial.println(F(" bytes"));
+  Serial.print(F("Min free heap: ")); Serial.print(ESP.getMinFreeHeap()); Serial.println(F(" bytes"));
+  Serial.print(F("Buffer capacity: ")); Serial.print(response.capacity()); Serial.println(F(" bytes"));
   Serial.print(F("Buffer length: ")); Serial.print(response.length()); Serial.println(F(" bytes"));
   Serial.println(F("===================="));
 }
@@ -1016,6 +1461,16 @@ bool fifo_enqueue(achievements_FIFO_t *fifo, achievements_t value)
   return true;
 }
 
+// the next achievement of the fifo, NULL if it is empty
+achievements_t* fifo_peek(achievements_FIFO_t *fifo)
+{
+  if (fifo_is_empty(fifo))
+  {
+    return NULL;
+  }
+  return &fifo->buffer[fifo->head];
+}
+
 // dequeue a achievement from the fifo
 bool fifo_dequeue(achievements_FIFO_t *fifo, achievements_t *value)
 {
@@ -1284,6 +1739,26 @@ void showAchievementCounter()
 #endif
 }
 
+// Show the rich presence text between the title box and the footer
+void showRichPresence()
+{
+#ifdef ENABLE_LCD
+  char text[40];
+  strncpy(text, rich_presence, sizeof(text) - 1);
+  text[sizeof(text) - 1] = '\0';
+  if (strlen(rich_presence) > 36) {
+    strcpy(text + 33, "...");
+  }
+  tft.setTextColor(TFT_BLACK, TFT_YELLOW, true);
+  tft.setTextDatum(MC_DATUM);
+  tft.setTextSize(1);
+  tft.setTextPadding(240);
+  tft.drawString(text, 120, 210, 2);
+  tft.setTextPadding(0);
+  tft.setTextDatum(TL_DATUM);
+#endif
+}
+
 // show the title screen
 void show_title_screen()
 {
@@ -1326,6 +1801,8 @@ void show_title_screen()
   // Show status indicators
   showWifiStatus();
   showAchievementCounter();
+  showRichPresence();
+  show_journal_status();
   
   already_showed_title_screen = true;
   setCpuFrequencyMhz(80);
@@ -1352,10 +1829,9 @@ void show_achievement(achievements_t achievement)
 
   setCpuFrequencyMhz(160);
   
-  // Download achievement image first
+  // downloaded by the HTTP worker since the A= command (see achievement_image_ready)
   char file_name[64];
   sprintf(file_name, "/achievement_%d.png", achievement.id);
-  try_download_file(achievement.url, file_name);
   
   // Helper lambda to redraw the achievement screen with a specific background color
   auto redrawAchievementScreen = [&](uint16_t bgColor) {
@@ -1549,7 +2025,7 @@ String try_login_RA(String ra_user, String ra_pass)
   
   // print_memory_stats("BEFORE HTTP REQUEST (login)");
   
-  int ret = perform_http_request_buffer(login_url, GET, "", 0, response, true, 3, 5000, 500);
+  int ret = perform_http_request_buffer(http_main, login_url, GET, "", 0, response, true, 3, 5000, 500, nullptr);
   
   // print_memory_stats("AFTER HTTP REQUEST (login)");
   
@@ -1558,7 +2034,7 @@ String try_login_RA(String ra_user, String ra_pass)
     Serial.print(F("request error: "));
     Serial.println(http_request_result_to_cstr(ret));
     state = STATE_ERROR_LOGIN_FAILED;
-    Serial0.print(F("ERROR=253-LOGIN_FAILED\r\n"));
+    send_to_pico("ERROR=253-LOGIN_FAILED\r\n");
     Serial.print(F("ERROR=253-LOGIN_FAILED\r\n"));
     return String("null");
   }
@@ -1642,14 +2118,18 @@ void handle_reset()
  */
 
 // retry download a file up to 3 times with exponential backoff
-int try_download_file(String url, String file_name)
+int try_download_file(HttpConnection &conn, String url, String file_name)
 {
   int attempt = 0;
   int maxRetries = 3;
   int retryDelayMs = 250;
   while (attempt < maxRetries)
   {
-    int ret = download_file_to_littleFS(url, file_name);
+    if (conn.cancelled)
+    {
+      return -1;
+    }
+    int ret = download_file_to_littleFS(conn, url, file_name);
     if (ret == 0)
     {
       return 0; // File downloaded successfully
@@ -1667,9 +2147,9 @@ int try_download_file(String url, String file_name)
   return -1;
 }
 
-// Fetch a file from the URL given and save it in LittleFS
-// Return 1 if a web fetch was needed or 0 if file already exists
-int download_file_to_littleFS(String url, String file_name)
+// Fetch a file from the URL given and save it in LittleFS, through the kept-alive connection
+// of the HTTP worker. Return 0 if the file exists or was fetched, -1 otherwise
+int download_file_to_littleFS(HttpConnection &conn, String url, String file_name)
 {
   int ret = 0;
   // If it exists then no need to fetch it
@@ -1682,24 +2162,32 @@ int download_file_to_littleFS(String url, String file_name)
   // before use LittleFS, check if we have enough space and delete files if necessary
   check_free_space_littleFS();
 
+  char mock_url[256];
+  if (ra_mock_server_url(url.c_str(), mock_url, sizeof(mock_url))) {
+    url = mock_url;
+  }
+
   Serial.print("Downloading " + file_name + " from " + url + "\n"); // debug
 
   // Check WiFi connection
   if ((WiFi.status() == WL_CONNECTED))
   {
-    NetworkClientSecure client;
-    HTTPClient http;
-    client.setInsecure();
-    http.begin(client, url);
+    conn.client.setInsecure();
+    if (!prepare_http_connection(conn, url.c_str()) || !conn.http.begin(conn.client, url))
+    {
+      return -1;
+    }
 
     // Start connection and send HTTP header
-    int http_code = http.GET();
+    int http_code = conn.http.GET();
     if (http_code == 200)
     {
       fs::File f = LittleFS.open(file_name, "w+");
       if (!f)
       {
         Serial.print(F("file open failed\n")); // debug
+        close_http_connection(conn);
+        conn.http.end();
         return -1;
       }
 
@@ -1707,18 +2195,23 @@ int download_file_to_littleFS(String url, String file_name)
       if (http_code == HTTP_CODE_OK)
       {
 
-        // Get length of document (is -1 when Server sends no Content-Length header)
-        int total = http.getSize();
+        // Get length of document (is -1 when Server sends no Content-Length header, which
+        // means a chunked body, as in perform_http_request_buffer)
+        int total = conn.http.getSize();
         int len = total;
+        bool is_chunked = total == -1;
+        HttpChunkedDecoder chunked;
+        unsigned long last_data = millis();
 
         // Create buffer for read
         uint8_t buff[128] = {0};
 
         // Get tcp stream
-        WiFiClient *stream = http.getStreamPtr();
+        WiFiClient *stream = conn.http.getStreamPtr();
 
-        // Read all data from server
-        while (http.connected() && (len > 0 || len == -1))
+        // Read all data from server - a chunked body ends with its last chunk, the connection
+        // is kept alive
+        while (conn.http.connected() && (len > 0 || (is_chunked && !chunked.done())) && !conn.cancelled)
         {
           // Get available data size
           size_t size = stream->available();
@@ -1727,6 +2220,17 @@ int download_file_to_littleFS(String url, String file_name)
           {
             // Read up to 128 bytes
             int c = stream->readBytes(buff, ((size > sizeof(buff)) ? sizeof(buff) : size));
+            last_data = millis();
+
+            if (is_chunked)
+            {
+              c = chunked.decode(buff, c);
+              if (chunked.error())
+              {
+                Serial.print(F("Bad chunked encoding\n")); // debug
+                break;
+              }
+            }
 
             // Write it to file
             f.write(buff, c);
@@ -1737,21 +2241,81 @@ int download_file_to_littleFS(String url, String file_name)
               len -= c;
             }
           }
+          else if (millis() - last_data > IMAGE_READ_TIMEOUT_MS)
+          {
+            Serial.print(F("download stalled\n")); // debug
+            break;
+          }
           yield();
         }
+        if (is_chunked ? !chunked.done() : len != 0)
+        {
+          // cancelled or cut - the rest of the body would be read as the next response
+          close_http_connection(conn);
+          ret = -1;
+        }
       }
       f.close();
+      if (ret != 0)
+      {
+        LittleFS.remove(file_name);
+      }
     }
     else
     {
-      Serial.print(F("download failed, error: ")); Serial.println(http.errorToString(http_code)); // debug
+      Serial.print(F("download failed, error: ")); Serial.println(conn.http.errorToString(http_code)); // debug
+      close_http_connection(conn);
       ret = -1;
     }
-    http.end();
+    conn.http.end();
   }
   return ret;
 }
 
+// Image download job - url is the image, data the LittleFS file
+void http_job_download_image(HttpJob &job)
+{
+  job.result = try_download_file(*job.conn, String(job.url), String(job.data));
+}
+
+void http_job_image_done(HttpJob &job)
+{
+  // the game image arrived after the title screen was drawn
+  if (job.result == 0 && prefix("/title_", job.data) && already_showed_title_screen && !go_back_to_title_screen) {
+    show_title_screen();
+  }
+}
+
+// Queue the download of an image to LittleFS (as a background job), unless it is there already
+void queue_image_download(const char* url, const char* file_name)
+{
+  if (LittleFS.exists(file_name) || http_job_find(http_job_download_image, file_name) != NULL) return;
+  HttpJob* job = http_job_alloc(HTTP_PRIORITY_BACKGROUND);
+  if (job == NULL) {
+    Serial.print(F("No free HTTP job, not downloaded: ")); Serial.println(file_name);
+    return;
+  }
+  snprintf(job->url, sizeof(job->url), "%s", url);
+  snprintf(job->data, sizeof(job->data), "%s", file_name);
+  job->data_len = strlen(job->data);
+  http_job_submit(job, HTTP_PRIORITY_BACKGROUND, http_job_download_image, http_job_image_done);
+}
+
+// Is the badge of the achievement downloaded (or given up)? The achievement waits for it up to
+// ACHIEVEMENT_IMAGE_WAIT_MS after its A= command, then its download is cancelled
+bool achievement_image_ready(achievements_t *achievement)
+{
+  char file_name[64];
+  sprintf(file_name, "/achievement_%d.png", achievement->id);
+  HttpJob* job = http_job_find(http_job_download_image, file_name);
+  if (job == NULL) return true;
+  if (millis() - achievement->queued_at < ACHIEVEMENT_IMAGE_WAIT_MS) return false;
+  if (job->state == HTTP_JOB_RUNNING && job->conn->cancelled) return false; // stopping
+  Serial.print(F("Badge download cancelled: ")); Serial.println(file_name);
+  http_job_cancel(job);
+  return job->state == HTTP_JOB_FREE;
+}
+
 // auxiliary function to implement startsWith for char*
 bool prefix(const char *pre, const char *str)
 {
@@ -1995,13 +2559,34 @@ const char* http_request_result_to_cstr(int code)
     return "HTTP_ERR_TIMEOUT";
   case HTTP_ERR_REPONSE_TOO_BIG:
     return "HTTP_ERR_REPONSE_TOO_BIG";
+  case HTTP_ERR_CANCELLED:
+    return "HTTP_ERR_CANCELLED";
   default:
     return "UNKNOWN_ERROR";
   }
 }
 
-// perform an HTTP request writing directly to CharBufferStream with retries and exponential backoff
+// with ENABLE_RA_MOCK_SERVER, writes in out the url with the RetroAchievements host replaced by
+// RA_MOCK_SERVER_URL - returns false (out untouched) when the url is kept
+bool ra_mock_server_url(const char* url, char* out, size_t out_size)
+{
+#if ENABLE_RA_MOCK_SERVER == 1
+  static const char* const ra_hosts[] = {"https://retroachievements.org", "https://media.retroachievements.org"};
+  for (const char* ra_host : ra_hosts) {
+    size_t host_len = strlen(ra_host);
+    if (strncmp(url, ra_host, host_len) == 0 && (url[host_len] == '/' || url[host_len] == '\0')) {
+      snprintf(out, out_size, "%s%s", RA_MOCK_SERVER_URL, url + host_len);
+      return true;
+    }
+  }
+#endif
+  return false;
+}
+
+// perform an HTTP request writing directly to CharBufferStream with retries and exponential backoff.
+// With a filter, the body goes through it and the size limit applies to the filtered body
 int perform_http_request_buffer(
+    HttpConnection &conn,
     const char* url,
     HttpRequestMethod method,
     const char* payload,
@@ -2010,14 +2595,24 @@ int perform_http_request_buffer(
     bool isIdempotent,
     int maxRetries,
     int timeoutMs,
-    int retryDelayMs)
+    int retryDelayMs,
+    JsonStreamFilter* filter)
 {
   int attempt = 0;
   int wifiRetries = 3;
   int code = HTTP_ERR_REQUEST_FAILED;
+  conn.status = 0;
+
+  char mock_url[384];
+  if (ra_mock_server_url(url, mock_url, sizeof(mock_url))) {
+    url = mock_url;
+  }
 
   while (attempt <= maxRetries)
   {
+    if (conn.cancelled) {
+      return HTTP_ERR_CANCELLED;
+    }
     if (attempt != 0) {
       Serial.print(F("Attempt ")); Serial.print(attempt); Serial.println(F(" to request"));
     }
@@ -2036,14 +2631,23 @@ int perform_http_request_buffer(
     }
 
     
-    globalSecureClient.setInsecure();
-    globalSecureClient.setTimeout(timeoutMs / 1000 + 30); // +30s extra for chunked encoding
-    globalHttpClient.setTimeout(timeoutMs);
+    conn.client.setInsecure();
+    conn.client.setTimeout(timeoutMs / 1000 + 30); // +30s extra for chunked encoding
+    conn.http.setTimeout(timeoutMs);
     
     Serial.print(F("Connecting to: ")); Serial.println(url);
     Serial.print(F("data: ")); Serial.println(payload);
     
-    if (!globalHttpClient.begin(globalSecureClient, url)) {
+    unsigned long request_start = millis();
+    if (!prepare_http_connection(conn, url)) {
+      code = HTTP_ERR_TIMEOUT;
+      attempt++;
+      if (attempt <= maxRetries) {
+        delay(retryDelayMs * pow(2, attempt));
+      }
+      continue;
+    }
+    if (!conn.http.begin(conn.client, url)) {
       Serial.println(F("HTTPClient begin failed"));
       attempt++;
       delay(retryDelayMs * pow(2, attempt));
@@ -2051,173 +2655,173 @@ int perform_http_request_buffer(
     }
     
     const char user_agent[] = "NES_RA_ADAPTER/1.2 rcheevos/11.6";
-    globalHttpClient.setUserAgent(user_agent);
+    conn.http.setUserAgent(user_agent);
 
     Serial.println(F("Sending request..."));
     
     if (method == GET) {
-      code = globalHttpClient.GET();
+      code = conn.http.GET();
     } else {
-      globalHttpClient.addHeader("Content-Type", "application/x-www-form-urlencoded");
+      conn.http.addHeader("Content-Type", "application/x-www-form-urlencoded");
       // POST with const char* and explicit length
-      code = globalHttpClient.POST((uint8_t*)payload, payload_len);
+      code = conn.http.POST((uint8_t*)payload, payload_len);
     }
 
     Serial.print(F("HTTP code: ")); Serial.println(code);
+    conn.status = code > 0 ? code : 0;
 
     if (code > 0)
     {
       if (code >= 200 && code < 300)
       {
-        WiFiClient* stream = globalHttpClient.getStreamPtr();
-        int contentLength = globalHttpClient.getSize();
+        WiFiClient* stream = conn.http.getStreamPtr();
+        int contentLength = conn.http.getSize();
         bool isChunked = (contentLength == -1);
         
         Serial.print(F("Content-Length: ")); Serial.print(contentLength); Serial.print(F(" (chunked: ")); Serial.print(isChunked); Serial.println(F(")"));
         
         // Check if it fits in the buffer (if Content-Length is known)
-        if (contentLength > 0 && contentLength > (int)resp.capacity()) {
+        if (filter == nullptr && contentLength > 0 && contentLength > (int)resp.capacity()) {
           Serial.print(F("Response too big: ")); Serial.print(contentLength); Serial.print(F(" > ")); Serial.println(resp.capacity());
-          globalHttpClient.end();
+          close_http_connection(conn); // the body was not read
+          conn.http.end();
           return HTTP_ERR_REPONSE_TOO_BIG;
         }
         
+        // The body is read straight into the free part of resp, in blocks as big as what
+        // the TLS layer has ready, and chunked framing is removed in place. With a filter, the
+        // last HTTP_READ_BLOCK_SIZE bytes of resp receive the raw body and the filter writes
+        // the result from the start.
         resp.clear();
-        // Smaller read buffer to reduce stack usage (256 is enough for chunked)
-        uint8_t buff[256];
+        size_t outCapacity = resp.capacity();
+        if (filter != nullptr) {
+          outCapacity -= min((size_t)HTTP_READ_BLOCK_SIZE, outCapacity / 4);
+          filter->begin(resp.data(), outCapacity);
+        }
+        uint8_t spare[16]; // for the end of the chunked framing when resp is full
+        HttpChunkedDecoder chunked;
         size_t totalRead = 0;
+        bool complete = contentLength == 0; // whole body read - the connection can be reused
+        bool tooBig = false;
         unsigned long lastDataTime = millis();
         unsigned long lastProgressTime = millis();
         
-        // For chunked encoding, we need to read the chunk size first
-        size_t chunkRemaining = 0;
-        bool chunkSizeRead = !isChunked; // If not chunked, no need to read size
-        
         // Longer timeout for large payloads (60s total, 20s without progress)
         const unsigned long readTimeoutMs = 20000;
         const unsigned long totalTimeoutMs = 60000;
         unsigned long startTime = millis();
         
-        while (globalHttpClient.connected() || stream->available())
+        while (!complete)
         {
+          if (conn.cancelled) {
+            Serial.println(F("Request cancelled"));
+            close_http_connection(conn);
+            conn.http.end();
+            return HTTP_ERR_CANCELLED;
+          }
           // Timeout total
           if (millis() - startTime > totalTimeoutMs) {
             Serial.println(F("Total timeout exceeded (60s)"));
             break;
           }
           
-          // Timeout if no data received for a long time
-          if (stream->available() == 0) {
+          int available = stream->available();
+          if (available <= 0) {
+            // Timeout if no data received for a long time
             if (millis() - lastDataTime > readTimeoutMs) {
               Serial.print(F("Read timeout - no data for ")); Serial.print(readTimeoutMs/1000); Serial.println(F("s"));
               break;
             }
             // Check if connection is still active
-            if (!globalHttpClient.connected()) {
+            if (!conn.http.connected()) {
               Serial.println(F("Connection lost while waiting for data"));
               break;
             }
-            delay(10);
-            yield();
+            wait_http_data(conn, 100);
             continue;
           }
           
-          lastDataTime = millis();
-          
-          if (isChunked && !chunkSizeRead) {
-            // Read chunk size with timeout - fixed buffer to avoid fragmentation
-            char chunkSizeBuf[16];
-            int chunkSizeIdx = 0;
-            unsigned long chunkSizeStart = millis();
-            while (millis() - chunkSizeStart < 5000 && chunkSizeIdx < 15) {
-              if (stream->available()) {
-                char c = stream->read();
-                if (c == '\n') break;
-                if (c != '\r' && c != ' ') {
-                  chunkSizeBuf[chunkSizeIdx++] = c;
-                }
-              } else {
-                if (!globalHttpClient.connected()) break;
-                delay(1);
-                yield();
-              }
-            }
-            chunkSizeBuf[chunkSizeIdx] = '\0';
-            
-            if (chunkSizeIdx == 0) {
-              continue; // Empty line, skip
-            }
-            chunkRemaining = strtoul(chunkSizeBuf, NULL, 16);
-            chunkSizeRead = true;
-            
-            if (chunkRemaining == 0) {
-              // Final chunk (size 0) - end of response
-              Serial.println(F("Final chunk received"));
-              break;
-            }
-            
-            // Progress log every 5 seconds
-            if (millis() - lastProgressTime > 5000) {
-              Serial.print(F("Progress: ")); Serial.print(totalRead);
-              Serial.print(F(" bytes, chunk: ")); Serial.println(chunkRemaining);
-              lastProgressTime = millis();
-            }
+          uint8_t* block;
+          size_t room;
+          if (filter != nullptr) {
+            block = (uint8_t*)resp.data() + outCapacity;
+            room = resp.capacity() - outCapacity;
+          } else {
+            block = (uint8_t*)resp.data() + resp.length();
+            room = resp.capacity() - resp.length();
           }
-          
-          // Determine how much to read
-          size_t toRead = sizeof(buff);
-          if (isChunked && chunkRemaining > 0) {
-            if (toRead > chunkRemaining) toRead = chunkRemaining;
-          } else if (!isChunked && contentLength > 0) {
-            size_t remaining = contentLength - totalRead;
-            if (toRead > remaining) toRead = remaining;
+          if (room == 0) {
+            block = spare;
+            room = sizeof(spare);
+          }
+          size_t toRead = min((size_t)available, room);
+          if (!isChunked && contentLength > 0) {
+            toRead = min(toRead, (size_t)contentLength - totalRead);
           }
           
-          size_t available = stream->available();
-          if (toRead > available) toRead = available;
-          if (toRead == 0) continue;
-          
-          size_t readBytes = stream->readBytes(buff, toRead);
-          size_t written = resp.write(buff, readBytes);
-          totalRead += written;
+          int readBytes = stream->read(block, toRead);
+          if (readBytes <= 0) continue;
+          lastDataTime = millis();
           
+          size_t payload = readBytes;
           if (isChunked) {
-            chunkRemaining -= readBytes;
-            if (chunkRemaining == 0) {
-              // End of chunk, read the \r\n that comes after with timeout
-              unsigned long crlfStart = millis();
-              while (stream->available() < 2 && globalHttpClient.connected()) {
-                if (millis() - crlfStart > 5000) {
-                  Serial.println(F("Timeout waiting for chunk CRLF"));
-                  break;
-                }
-                delay(1);
-                yield();
-              }
-              if (stream->available() >= 2) {
-                stream->read(); // \r
-                stream->read(); // \n
-              }
-              chunkSizeRead = false; 
+            payload = chunked.decode(block, readBytes);
+            if (chunked.error()) {
+              Serial.println(F("Bad chunked encoding"));
+              break;
             }
+            complete = chunked.done();
           }
           
-          if (written < readBytes) {
+          if (filter != nullptr) {
+            filter->feed(block, payload);
+            tooBig = filter->overflow();
+          } else if (block == spare) {
+            tooBig = payload > 0;
+          } else {
+            resp.setLength(resp.length() + payload);
+          }
+          if (tooBig) {
             Serial.println(F("Buffer full during HTTP read"));
-            globalHttpClient.end();
+            close_http_connection(conn);
+            conn.http.end();
             return HTTP_ERR_REPONSE_TOO_BIG;
           }
+          totalRead += payload;
           
-          // Se não é chunked e já leu tudo
           if (!isChunked && contentLength > 0 && totalRead >= (size_t)contentLength) {
-            break;
+            complete = true;
           }
           
-          yield();
+          // Progress log every 5 seconds
+          if (millis() - lastProgressTime > 5000) {
+            Serial.print(F("Progress: ")); Serial.print(totalRead); Serial.println(F(" bytes"));
+            lastProgressTime = millis();
+          }
+        }
+        if (isChunked) {
+          Serial.print(F("Chunks: ")); Serial.println(chunked.chunks);
         }
         
         Serial.print(F("Total read: ")); Serial.print(totalRead); Serial.println(F(" bytes"));
-        globalHttpClient.end();
+        if (filter != nullptr) {
+          filter->finish();
+          resp.setLength(filter->length());
+          Serial.printf("Filtered: %lu -> %lu bytes (%lu fields, %lu objects removed)\n",
+                        (unsigned long)filter->bytesIn, (unsigned long)resp.length(),
+                        (unsigned long)filter->fieldsChanged, (unsigned long)filter->objectsDropped);
+          if (filter->malformed()) {
+            Serial.println(F("Malformed JSON response"));
+            close_http_connection(conn);
+            conn.http.end();
+            return HTTP_ERR_REQUEST_FAILED;
+          }
+        }
+        if (!complete) {
+          close_http_connection(conn); // the rest of the body would be read as the next response
+        }
+        conn.http.end();
+        log_http_metrics(conn, request_start);
         
         if (totalRead > 0) {
           return HTTP_SUCCESS;
@@ -2225,11 +2829,13 @@ int perform_http_request_buffer(
         code = HTTP_ERR_REQUEST_FAILED;
       }
       else if (code >= 400 && code < 500) {
-        globalHttpClient.end();
+        close_http_connection(conn); // error bodies are not read
+        conn.http.end();
         return HTTP_ERR_HTTP_4XX;
       }
       else {
-        globalHttpClient.end();
+        close_http_connection(conn);
+        conn.http.end();
         if (!isIdempotent && method == HTTP_POST) {
           return HTTP_ERR_REQUEST_FAILED;
         }
@@ -2238,6 +2844,7 @@ int perform_http_request_buffer(
     else
     {
       Serial.print(F("HTTP error code: ")); Serial.println(code);
+      close_http_connection(conn); // a stale kept-alive connection also ends up here - retry with a new one
       if (code == HTTPC_ERROR_CONNECTION_REFUSED ||
           code == HTTPC_ERROR_READ_TIMEOUT ||
           code == HTTPC_ERROR_CONNECTION_LOST) {
@@ -2247,7 +2854,7 @@ int perform_http_request_buffer(
       }
     }
 
-    globalHttpClient.end();
+    conn.http.end();
     attempt++;
     if (attempt <= maxRetries) {
       delay(retryDelayMs * pow(2, attempt));
@@ -2257,6 +2864,707 @@ int perform_http_request_buffer(
   return code;
 }
 
+// ============================================================================
+// Offline journal - award/leaderboard requests waiting for connectivity
+// ============================================================================
+
+// Records are appended as "<url>\t<data>\n" and never rewritten. The replay cursor is kept
+// in a tiny separate file, and both files are removed once everything was replayed.
+#define JOURNAL_FILE "/journal.txt"
+#define JOURNAL_POS_FILE "/journal.pos"
+#define JOURNAL_MAX_SIZE 32768
+#define JOURNAL_RETRY_MIN_MS 5000
+#define JOURNAL_RETRY_MAX_MS 300000
+
+uint16_t journal_pending = 0;
+uint32_t journal_read_pos = 0;
+uint32_t journal_backoff_ms = JOURNAL_RETRY_MIN_MS;
+unsigned long journal_next_replay = 0;
+
+// requests that change the user's progress and must reach the server
+bool is_journaled_request(const char* data)
+{
+  return strncmp(data, "r=awardachievement", 18) == 0 || strncmp(data, "r=submitlbentry", 15) == 0;
+}
+
+// count the records not replayed yet (called at boot)
+void journal_init()
+{
+  journal_pending = 0;
+  journal_read_pos = 0;
+  if (!LittleFS.exists(JOURNAL_FILE)) return;
+
+  File pos_file = LittleFS.open(JOURNAL_POS_FILE, "r");
+  if (pos_file) {
+    char pos_str[16];
+    size_t len = pos_file.readBytesUntil('\n', pos_str, sizeof(pos_str) - 1);
+    pos_str[len] = '\0';
+    journal_read_pos = strtoul(pos_str, NULL, 10);
+    pos_file.close();
+  }
+
+  File file = LittleFS.open(JOURNAL_FILE, "r");
+  if (!file) return;
+  file.seek(journal_read_pos);
+  while (file.available()) {
+    if (file.read() == '\n') journal_pending++;
+  }
+  file.close();
+
+  Serial.print(F("JOURNAL: ")); Serial.print(journal_pending); Serial.println(F(" pending requests"));
+  if (journal_pending == 0) {
+    journal_clear();
+  }
+}
+
+void journal_clear()
+{
+  LittleFS.remove(JOURNAL_FILE);
+  LittleFS.remove(JOURNAL_POS_FILE);
+  journal_pending = 0;
+  journal_read_pos = 0;
+}
+
+bool journal_append(const char* url, const char* data)
+{
+  File file = LittleFS.open(JOURNAL_FILE, "a");
+  if (!file) {
+    Serial.println(F("JOURNAL: cannot open file"));
+    return false;
+  }
+  if (file.size() + strlen(url) + strlen(data) + 2 > JOURNAL_MAX_SIZE) {
+    file.close();
+    Serial.println(F("JOURNAL: full"));
+    return false;
+  }
+  file.print(url);
+  file.print('\t');
+  file.print(data);
+  file.print('\n');
+  file.close();
+
+  journal_pending++;
+  Serial.print(F("JOURNAL: queued, pending=")); Serial.println(journal_pending);
+  return true;
+}
+
+// Build the local answer of a journaled request, so rc_client goes on as if it was accepted.
+// The award answer has no Score/SoftcoreScore/AchievementsRemaining: rc_client keeps its own
+// score, and AchievementsRemaining 0 would be taken as the game being mastered
+void journal_local_response(const char* data, CharBufferStream &buf)
+{
+  char value[24];
+  char aux[192];
+  buf.clear();
+  if (strncmp(data, "r=awardachievement", 18) == 0) {
+    get_request_param(data, "a", value, sizeof(value));
+    snprintf(aux, sizeof(aux), "{\"Success\":true,\"AchievementID\":%s}", value);
+  } else {
+    get_request_param(data, "s", value, sizeof(value));
+    snprintf(aux, sizeof(aux), "{\"Success\":true,\"Response\":{\"Score\":%s,\"BestScore\":%s,\"RankInfo\":{\"Rank\":0,\"NumEntries\":0},\"TopEntries\":[]}}", value, value);
+  }
+  buf.write((const uint8_t*)aux, strlen(aux));
+}
+
+// Queue the replay of the oldest pending record - called from loop(), one record per job
+void journal_replay_step()
+{
+  if (journal_pending == 0 || WiFi.status() != WL_CONNECTED) return;
+  if ((long)(millis() - journal_next_replay) < 0 || http_job_queued(journal_replay_run)) return;
+  HttpJob* job = http_job_alloc(HTTP_PRIORITY_AWARD);
+  if (job != NULL) {
+    http_job_submit(job, HTTP_PRIORITY_AWARD, journal_replay_run, journal_replay_done);
+  }
+}
+
+// Replay the oldest pending record - in the HTTP worker
+void journal_replay_run(HttpJob &job)
+{
+  if (journal_pending == 0) return;
+
+  File file = LittleFS.open(JOURNAL_FILE, "r");
+  if (!file) {
+    journal_clear();
+    return;
+  }
+  file.seek(journal_read_pos);
+  char line[768];
+  size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+  file.close();
+  line[len] = '\0';
+
+  char* tab = strchr(line, '\t');
+  int ret = HTTP_ERR_HTTP_4XX; // malformed record - skip it
+  if (tab != NULL) {
+    *tab = '\0';
+    const char* data = tab + 1;
+    Serial.print(F("JOURNAL: replaying ")); Serial.println(data);
+    job.resp->clear();
+    ret = perform_http_request_buffer(*job.conn, line, POST, data, strlen(data), *job.resp, false, 0, 5000, 500, nullptr);
+    if (ENABLE_LOGIN_CACHE == 1 && strncmp(data, "r=awardachievement", 18) == 0) {
+      login_cache_check_award(ret, job.conn->status, *job.resp);
+    }
+    job.resp->clear();
+  }
+
+  if (ret >= 0 || ret == HTTP_ERR_HTTP_4XX) {
+    // accepted (or rejected by the server - retrying would not change it)
+    journal_read_pos += len + 1;
+    journal_pending--;
+    journal_backoff_ms = JOURNAL_RETRY_MIN_MS;
+    journal_next_replay = millis();
+    if (journal_pending == 0) {
+      journal_clear();
+    } else {
+      File pos_file = LittleFS.open(JOURNAL_POS_FILE, "w");
+      if (pos_file) {
+        pos_file.print(journal_read_pos);
+        pos_file.print('\n');
+        pos_file.close();
+      }
+    }
+  } else {
+    Serial.print(F("JOURNAL: replay failed, retry in ")); Serial.print(journal_backoff_ms / 1000); Serial.println(F("s"));
+    journal_next_replay = millis() + journal_backoff_ms;
+    journal_backoff_ms = min((uint32_t)(journal_backoff_ms * 2), (uint32_t)JOURNAL_RETRY_MAX_MS);
+  }
+}
+
+void journal_replay_done(HttpJob &job)
+{
+  show_journal_status();
+}
+
+// ============================================================================
+// Patch cache - cleaned patches on LittleFS, one per game
+// ============================================================================
+
+// "/patch_<game>.json" has the patch as it is before the per-session steps (unlock stubs,
+// size reduction). "/patch_<game>.txt" has "<format> <crc32> <sessions>": format changes
+// with the cleaning rules, sessions counts the sessions served since the download.
+#define PATCH_CACHE_FORMAT (2 + ENABLE_LEADERBOARDS)
+#define PATCH_CACHE_MIN_FREE 65536 // bytes of LittleFS left for images
+
+void patch_cache_paths(const char* game, char* json_path, char* meta_path, size_t size)
+{
+  snprintf(json_path, size, "/patch_%s.json", game);
+  snprintf(meta_path, size, "/patch_%s.txt", game);
+}
+
+void patch_cache_remove(const char* game)
+{
+  char json_path[48], meta_path[48];
+  patch_cache_paths(game, json_path, meta_path, sizeof(json_path));
+  LittleFS.remove(json_path);
+  LittleFS.remove(meta_path);
+}
+
+// remove the patches of all games
+void patch_cache_clear()
+{
+  fs::File root = LittleFS.open("/");
+  fs::File file = root.openNextFile();
+  while (file)
+  {
+    char file_name[48];
+    snprintf(file_name, sizeof(file_name), "/%s", file.name());
+    file.close();
+    if (prefix("patch_", file_name + 1))
+    {
+      LittleFS.remove(file_name);
+    }
+    file = root.openNextFile();
+  }
+}
+
+bool patch_cache_write_meta(const char* meta_path, uint32_t crc, uint32_t sessions)
+{
+  File meta = LittleFS.open(meta_path, "w");
+  if (!meta) return false;
+  char line[40];
+  snprintf(line, sizeof(line), "%d %08lx %lu\n", PATCH_CACHE_FORMAT, (unsigned long)crc, (unsigned long)sessions);
+  meta.print(line);
+  meta.close();
+  return true;
+}
+
+// Load the cached patch of game into buf. Returns false (buf empty) when there is none, it
+// is corrupted or it is due to be downloaded again
+bool patch_cache_load(const char* game, CharBufferStream &buf)
+{
+  char json_path[48], meta_path[48];
+  patch_cache_paths(game, json_path, meta_path, sizeof(json_path));
+  if (!LittleFS.exists(meta_path)) return false;
+
+  File meta = LittleFS.open(meta_path, "r");
+  if (!meta) return false;
+  char line[40];
+  size_t len = meta.readBytesUntil('\n', line, sizeof(line) - 1);
+  meta.close();
+  line[len] = '\0';
+  int format = 0;
+  unsigned long crc = 0, sessions = 0;
+  if (sscanf(line, "%d %lx %lu", &format, &crc, &sessions) != 3 || format != PATCH_CACHE_FORMAT) {
+    patch_cache_remove(game);
+    return false;
+  }
+  if (sessions >= PATCH_CACHE_REVALIDATE_SESSIONS) {
+    Serial.println(F("PATCH CACHE: revalidating"));
+    return false;
+  }
+
+  File file = LittleFS.open(json_path, "r");
+  if (!file) return false;
+  buf.clear();
+  if (file.size() <= buf.capacity()) {
+    buf.setLength(file.read((uint8_t*)buf.data(), file.size()));
+  }
+  bool valid = buf.length() == file.size() &&
+               (link_frame_crc32(0xFFFFFFFF, (const uint8_t*)buf.data(), buf.length()) ^ 0xFFFFFFFF) == crc;
+  file.close();
+  if (!valid) {
+    Serial.println(F("PATCH CACHE: corrupted entry removed"));
+    buf.clear();
+    patch_cache_remove(game);
+    return false;
+  }
+
+  patch_cache_write_meta(meta_path, crc, sessions + 1);
+  Serial.printf("PATCH CACHE: hit, %lu bytes, session %lu of %d\n", (unsigned long)buf.length(), sessions + 1,
+                PATCH_CACHE_REVALIDATE_SESSIONS);
+  return true;
+}
+
+// Steps applied once to a patch just downloaded, before it is cached: the rule set (unless
+// the streaming filter already applied it) and the rich presence compaction
+void clean_downloaded_patch(CharBufferStream &buf, JsonStreamFilter &filter, bool filtered, const char* game)
+{
+  if (!filtered) {
+    filter.setRules(patch_rules, sizeof(patch_rules) / sizeof(patch_rules[0]));
+    buf.setLength(filter.cleanInPlace(buf.data(), buf.length()));
+  }
+  compact_rich_presence_buffer(buf);
+  if (ENABLE_PATCH_CACHE == 1 && game[0] != '\0' && buf.indexOf("\"Success\":true") != -1) {
+    patch_cache_store(game, buf);
+  }
+}
+
+// Save the patch of game just downloaded and cleaned
+void patch_cache_store(const char* game, CharBufferStream &buf)
+{
+  char json_path[48], meta_path[48];
+  patch_cache_paths(game, json_path, meta_path, sizeof(json_path));
+  uint32_t crc = link_frame_crc32(0xFFFFFFFF, (const uint8_t*)buf.data(), buf.length()) ^ 0xFFFFFFFF;
+
+  // same patch as the cached one - only restart the session count
+  File meta = LittleFS.open(meta_path, "r");
+  if (meta) {
+    char line[40];
+    size_t len = meta.readBytesUntil('\n', line, sizeof(line) - 1);
+    meta.close();
+    line[len] = '\0';
+    int format = 0;
+    unsigned long old_crc = 0, sessions = 0;
+    if (sscanf(line, "%d %lx %lu", &format, &old_crc, &sessions) == 3 && format == PATCH_CACHE_FORMAT &&
+        old_crc == crc && LittleFS.exists(json_path)) {
+      patch_cache_write_meta(meta_path, crc, 0);
+      Serial.println(F("PATCH CACHE: unchanged on the server"));
+      return;
+    }
+  }
+
+  patch_cache_remove(game);
+  if (LittleFS.totalBytes() - LittleFS.usedBytes() < buf.length() + PATCH_CACHE_MIN_FREE) {
+    Serial.println(F("PATCH CACHE: low space, removing the patches of other games"));
+    patch_cache_clear();
+    if (LittleFS.totalBytes() - LittleFS.usedBytes() < buf.length() + PATCH_CACHE_MIN_FREE) return;
+  }
+
+  File file = LittleFS.open(json_path, "w");
+  if (!file) return;
+  size_t written = file.write((const uint8_t*)buf.data(), buf.length());
+  file.close();
+  if (written != buf.length() || !patch_cache_write_meta(meta_path, crc, 0)) {
+    Serial.println(F("PATCH CACHE: write failed"));
+    patch_cache_remove(game);
+    return;
+  }
+  Serial.printf("PATCH CACHE: stored %lu bytes\n", (unsigned long)buf.length());
+}
+
+// ============================================================================
+// Login cache - token and login answer of the last user on LittleFS
+// ============================================================================
+
+// "/login.txt" has "<boots> <user> <token>": boots counts the power-ons served since the
+// password login. "/login.json" has the Pico's login answer, as sent to it.
+#define LOGIN_CACHE_FILE "/login.txt"
+#define LOGIN_CACHE_RESPONSE_FILE "/login.json"
+#define LOGIN_VERIFY_DELAY_MS 20000  // after boot, so the Pico's requests go first
+#define LOGIN_VERIFY_RETRY_MS 60000
+
+bool login_verify_pending = false;
+unsigned long login_verify_at = 0;
+
+void login_cache_save(const char* user, const char* token, unsigned long boots)
+{
+  File file = LittleFS.open(LOGIN_CACHE_FILE, "w");
+  if (!file) return;
+  char line[160];
+  snprintf(line, sizeof(line), "%lu %s %s\n", boots, user, token);
+  file.print(line);
+  file.close();
+}
+
+void login_cache_clear()
+{
+  LittleFS.remove(LOGIN_CACHE_FILE);
+  LittleFS.remove(LOGIN_CACHE_RESPONSE_FILE);
+  login_verify_pending = false;
+}
+
+// Get the cached token of user and count this power-on. Returns false when there is none,
+// it is from another user or it is due to be renewed
+bool login_cache_load(const char* user, String &token)
+{
+  File file = LittleFS.open(LOGIN_CACHE_FILE, "r");
+  if (!file) return false;
+  char line[160];
+  size_t len = file.readBytesUntil('\n', line, sizeof(line) - 1);
+  file.close();
+  line[len] = '\0';
+  unsigned long boots = 0;
+  char cached_user[64], cached_token[64];
+  if (sscanf(line, "%lu %63s %63s", &boots, cached_user, cached_token) != 3 || strcmp(cached_user, user) != 0) {
+    login_cache_clear();
+    return false;
+  }
+  if (boots >= LOGIN_CACHE_MAX_BOOTS) {
+    Serial.println(F("LOGIN CACHE: renewing"));
+    login_cache_clear();
+    return false;
+  }
+  login_cache_save(cached_user, cached_token, boots + 1);
+  token = cached_token;
+  Serial.printf("LOGIN CACHE: hit, power-on %lu of %d\n", boots + 1, LOGIN_CACHE_MAX_BOOTS);
+  return true;
+}
+
+// Answer the Pico's token login (r=login2&u=<user>&t=<token>) with the cached answer, when
+// it is for the cached token
+bool login_cache_answer(const char* data, CharBufferStream &buf)
+{
+  char token[64];
+  if (!get_request_param(data, "t", token, sizeof(token)) || ra_user_token.compareTo(token) != 0) return false;
+  File file = LittleFS.open(LOGIN_CACHE_RESPONSE_FILE, "r");
+  if (!file) return false;
+  buf.clear();
+  if (file.size() <= buf.capacity()) {
+    buf.setLength(file.read((uint8_t*)buf.data(), file.size()));
+  }
+  bool valid = buf.length() > 0 && buf.length() == file.size();
+  file.close();
+  if (!valid) {
+    buf.clear();
+    return false;
+  }
+  Serial.println(F("LOGIN CACHE: login answered locally"));
+  return true;
+}
+
+// Save the Pico's login answer, when it is a success for the cached token
+void login_cache_store_answer(const char* data, CharBufferStream &buf)
+{
+  char token[64];
+  if (!get_request_param(data, "t", token, sizeof(token)) || ra_user_token.compareTo(token) != 0 ||
+      buf.indexOf("\"Success\":true") == -1 || !LittleFS.exists(LOGIN_CACHE_FILE)) {
+    return;
+  }
+  File file = LittleFS.open(LOGIN_CACHE_RESPONSE_FILE, "w");
+  if (!file) return;
+  size_t written = file.write((const uint8_t*)buf.data(), buf.length());
+  file.close();
+  if (written != buf.length()) LittleFS.remove(LOGIN_CACHE_RESPONSE_FILE);
+}
+
+// True when the server turned the credentials down - a 401/403 or a credentials error code.
+// A rate limit, a server error or any other answer says nothing about the token
+bool login_credentials_rejected(int ret, int status, CharBufferStream &buf)
+{
+  if (ret == HTTP_ERR_HTTP_4XX) {
+    return status == 401 || status == 403;
+  }
+  return ret >= 0 && (buf.indexOf("\"invalid_credentials\"") != -1 || buf.indexOf("\"expired_token\"") != -1);
+}
+
+// An award rejected for the credentials means the cached token is no longer valid
+void login_cache_check_award(int ret, int status, CharBufferStream &buf)
+{
+  if (login_credentials_rejected(ret, status, buf)) {
+    Serial.println(F("LOGIN CACHE: award rejected, cached login dropped"));
+    login_cache_clear();
+  }
+}
+
+// Queue the check of the cached token with the server - called from loop(), it is due
+// LOGIN_VERIFY_DELAY_MS after a boot that skipped the password login
+void login_verify_step()
+{
+  if (!login_verify_pending || WiFi.status() != WL_CONNECTED) return;
+  if ((long)(millis() - login_verify_at) < 0) return;
+  HttpJob* job = http_job_alloc(HTTP_PRIORITY_BACKGROUND);
+  if (job != NULL) {
+    login_verify_pending = false;
+    http_job_submit(job, HTTP_PRIORITY_BACKGROUND, login_verify_run, login_verify_done);
+  }
+}
+
+// Check the cached token with the server - in the HTTP worker
+void login_verify_run(HttpJob &job)
+{
+  char url[64];
+  char data[160];
+  snprintf(url, sizeof(url), "%.*s", (int)strcspn(base_url, "?"), base_url);
+  int data_len = snprintf(data, sizeof(data), "r=login2&u=%s&t=%s", ra_user_name, ra_user_token.c_str());
+  job.resp->clear();
+  int ret = perform_http_request_buffer(*job.conn, url, POST, data, data_len, *job.resp, true, 1, 5000, 500, nullptr);
+  // any other failure or unexpected answer is retried later, like a network error
+  if (login_credentials_rejected(ret, job.conn->status, *job.resp)) {
+    Serial.println(F("LOGIN CACHE: token rejected by the server"));
+    login_cache_clear();
+    job.error_state = STATE_ERROR_LOGIN_FAILED;
+  } else if (ret >= 0 && job.resp->indexOf("\"Success\":true") != -1) {
+    // refresh the score of the cached answer
+    remove_json_field_buffer(*job.resp, "AvatarUrl");
+    login_cache_store_answer(data, *job.resp);
+    Serial.println(F("LOGIN CACHE: token verified"));
+  } else {
+    login_verify_at = millis() + LOGIN_VERIFY_RETRY_MS;
+    login_verify_pending = true;
+  }
+  job.resp->clear();
+}
+
+void login_verify_done(HttpJob &job)
+{
+  if (job.error_state != STATE_UNINITIALIZED) {
+    state = job.error_state;
+  }
+}
+
+// ============================================================================
+// Patch prefetch - game ID and patch downloaded while the Pico logs in
+// ============================================================================
+
+// Start the prefetch task for the cartridge just identified. It gets the large response
+// buffer and loop() goes on with a small one until the Pico asks for the patch
+void patch_prefetch_start(const char* md5)
+{
+  // the response buffer is lent to the task - not while the HTTP worker uses it
+  if (prefetch_state == PREFETCH_RUNNING || http_workers[0].job != NULL || ra_user_token.length() == 0 ||
+      ra_user_token.length() >= sizeof(prefetch_token) || response.capacity() < SMALL_BUFFER_SIZE * 2) {
+    return;
+  }
+  strcpy(prefetch_md5, md5);
+  strcpy(prefetch_token, ra_user_token.c_str());
+  prefetch_game[0] = '\0';
+  prefetch_gameid_ready = false;
+
+  prefetch_buffer.release();
+  prefetch_buffer.swap(response);
+  if (!response.reserve(SMALL_BUFFER_SIZE)) {
+    response.swap(prefetch_buffer);
+    return;
+  }
+  prefetch_state = PREFETCH_RUNNING;
+  if (xTaskCreate(patch_prefetch_task, "prefetch", PREFETCH_TASK_STACK_SIZE, NULL, 1, NULL) != pdPASS) {
+    Serial.println(F("PREFETCH: cannot start the task"));
+    response.release();
+    response.swap(prefetch_buffer);
+    prefetch_state = PREFETCH_IDLE;
+    return;
+  }
+  Serial.println(F("PREFETCH: started"));
+}
+
+void patch_prefetch_task(void* param)
+{
+  char url[64];
+  snprintf(url, sizeof(url), "%.*s", (int)strcspn(base_url, "?"), base_url);
+  char data[192];
+  int data_len = snprintf(data, sizeof(data), "r=gameid&m=%s", prefetch_md5);
+  bool ready = false;
+
+  int ret = perform_http_request_buffer(http_prefetch, url, POST, data, data_len, prefetch_buffer, true, 1, 5000, 500, nullptr);
+  int game_pos = ret >= 0 ? prefetch_buffer.indexOf("\"GameID\":") : -1;
+  uint32_t game_id = game_pos != -1 ? strtoul(prefetch_buffer.c_str() + game_pos + 9, NULL, 10) : 0;
+  if (game_id != 0 && prefetch_buffer.length() < sizeof(prefetch_gameid_response)) {
+    strcpy(prefetch_gameid_response, prefetch_buffer.c_str());
+    snprintf(prefetch_game, sizeof(prefetch_game), "%lu", (unsigned long)game_id);
+    prefetch_gameid_ready = true;
+
+    if (ENABLE_PATCH_CACHE == 1 && patch_cache_load(prefetch_game, prefetch_buffer)) {
+      ready = true;
+    } else {
+      const char* patch_url = ENABLE_SHRINK_LAMBDA == 1 ? SHRINK_LAMBDA_URL : url;
+      data_len = snprintf(data, sizeof(data), "r=patch&u=%s&t=%s&g=%s&f=3", ra_user_name, prefetch_token, prefetch_game);
+      JsonStreamFilter* filter = nullptr;
+      if (ENABLE_STREAMING_JSON_FILTER == 1) {
+        prefetch_filter.setRules(patch_rules, sizeof(patch_rules) / sizeof(patch_rules[0]));
+        filter = &prefetch_filter;
+      }
+      prefetch_buffer.clear();
+      ret = perform_http_request_buffer(http_prefetch, patch_url, POST, data, data_len, prefetch_buffer, true, 3, 30000, 500, filter);
+      if (ret >= 0) {
+        clean_downloaded_patch(prefetch_buffer, prefetch_filter, filter != nullptr, prefetch_game);
+        ready = true;
+      }
+    }
+  }
+  close_http_connection(http_prefetch); // give the TLS session memory back
+
+  Serial.printf("PREFETCH: game %s, patch %s (%lu bytes)\n", prefetch_game[0] != '\0' ? prefetch_game : "unknown",
+                ready ? "staged" : "failed", (unsigned long)prefetch_buffer.length());
+  prefetch_state = ready ? PREFETCH_READY : PREFETCH_FAILED;
+  vTaskDelete(NULL);
+}
+
+// Answer the Pico's r=gameid with the one the prefetch task got, if it is for the same hash
+bool patch_prefetch_gameid(const char* data, CharBufferStream &buf)
+{
+  char md5[34];
+  if (!prefetch_gameid_ready || !get_request_param(data, "m", md5, sizeof(md5)) || strcasecmp(md5, prefetch_md5) != 0) {
+    return false;
+  }
+  buf.clear();
+  buf.write((const uint8_t*)prefetch_gameid_response, strlen(prefetch_gameid_response));
+  Serial.println(F("PREFETCH: game ID answered locally"));
+  return true;
+}
+
+// Take the large buffer back from the prefetch task (waiting for it to finish). Returns true
+// when it holds the patch of game, cleaned
+bool patch_prefetch_take(const char* game, CharBufferStream &buf)
+{
+  if (prefetch_state == PREFETCH_IDLE) return false;
+  if (prefetch_state == PREFETCH_RUNNING) {
+    Serial.println(F("PREFETCH: waiting for the task"));
+    while (prefetch_state == PREFETCH_RUNNING) {
+      delay(10); // the requests of the task have their own timeouts
+    }
+  }
+  buf.release();
+  buf.swap(prefetch_buffer);
+  bool ready = prefetch_state == PREFETCH_READY && strcmp(game, prefetch_game) == 0;
+  prefetch_state = PREFETCH_IDLE;
+  if (!ready) {
+    buf.clear();
+  }
+  Serial.println(ready ? F("PREFETCH: patch served from the prefetch") : F("PREFETCH: not usable, downloading"));
+  return ready;
+}
+
+// Show how many requests are waiting on the LCD and the web app
+void show_journal_status()
+{
+#ifdef ENABLE_LCD
+  if (already_showed_title_screen) {
+    char text[12] = "";
+    if (journal_pending > 0) {
+      snprintf(text, sizeof(text), "Q:%u", journal_pending);
+    }
+    tft.setTextColor(TFT_RED, TFT_YELLOW, true);
+    tft.setTextDatum(TL_DATUM);
+    tft.setTextSize(1);
+    tft.fillRect(150, 5, 60, 18, TFT_YELLOW);
+    tft.drawString(text, 150, 8, 2);
+  }
+#endif
+#ifdef ENABLE_INTERNAL_WEB_APP_SUPPORT
+  char aux[16];
+  snprintf(aux, sizeof(aux), "J=%u", journal_pending);
+  send_ws_data(aux);
+#endif
+}
+
+// Close the kept-alive connection of conn if the next request goes to another host,
+// then connect if needed. Connecting here (HTTPClient reuses a connected client) lets us count
+// and time the TLS handshakes
+bool prepare_http_connection(HttpConnection &conn, const char* url)
+{
+  char host[sizeof(conn.host)];
+  const char* start = strstr(url, "://");
+  start = (start != NULL) ? start + 3 : url;
+  size_t len = strcspn(start, "/:?");
+  if (len >= sizeof(host)) len = sizeof(host) - 1;
+  memcpy(host, start, len);
+  host[len] = '\0';
+  uint16_t port = start[len] == ':' ? atoi(start + len + 1) : 443;
+
+  if (strcmp(host, conn.host) != 0) {
+    if (conn.host[0] != '\0') {
+      Serial.print(F("Closing connection to ")); Serial.println(conn.host);
+    }
+    conn.client.stop();
+    strcpy(conn.host, host);
+  }
+
+  conn.handshake_last_ms = 0;
+  if (conn.client.connected()) {
+    return true;
+  }
+  // the server may have closed the kept-alive connection - a new handshake is needed
+  uint32_t heap_before = ESP.getFreeHeap();
+  unsigned long handshake_start = millis();
+  if (!conn.client.connect(host, port)) {
+    Serial.print(F("Connection to ")); Serial.print(host); Serial.println(F(" failed"));
+    close_http_connection(conn);
+    return false;
+  }
+  conn.handshake_last_ms = millis() - handshake_start;
+  conn.handshakes++;
+  conn.handshake_total_ms += conn.handshake_last_ms;
+  Serial.printf("TLS handshake with %s: %lu ms (heap %lu -> %lu)\n", host, (unsigned long)conn.handshake_last_ms,
+                (unsigned long)heap_before, (unsigned long)ESP.getFreeHeap());
+  return true;
+}
+
+// Log the time of a request and how often the connection had to be opened again
+void log_http_metrics(HttpConnection &conn, unsigned long request_start)
+{
+  conn.requests++;
+  Serial.printf("HTTP %s: %lu ms (%s) - %lu requests, %lu handshakes, avg handshake %lu ms\n", conn.name,
+                (unsigned long)(millis() - request_start), conn.handshake_last_ms > 0 ? "new connection" : "reused",
+                (unsigned long)conn.requests, (unsigned long)conn.handshakes,
+                (unsigned long)(conn.handshakes > 0 ? conn.handshake_total_ms / conn.handshakes : 0));
+}
+
+// Drop the kept-alive connection (after an error the connection state is unknown)
+void close_http_connection(HttpConnection &conn)
+{
+  conn.client.stop();
+  conn.host[0] = '\0';
+}
+
+// Wait up to timeoutMs for the socket of the connection to be readable, instead of polling
+// available() with fixed sleeps. Bytes already decrypted by the TLS layer are seen by
+// available() before getting here, so the socket is the only thing left to wait for
+void wait_http_data(HttpConnection &conn, uint32_t timeoutMs)
+{
+  int fd = conn.client.fd();
+  if (fd < 0) {
+    delay(1);
+    return;
+  }
+  fd_set readfds;
+  FD_ZERO(&readfds);
+  FD_SET(fd, &readfds);
+  struct timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  select(fd + 1, &readfds, NULL, NULL, &tv);
+}
+
 // ============================================================================
 // Serial Command Handlers - Functions optimized for parsing with char*
 // ============================================================================
@@ -2288,13 +3596,185 @@ int find_crlf(const char* buf, size_t len) {
   return -1;
 }
 
-/**
- * Checks if the buffer starts with a prefix
- */
-bool starts_with(const char* buf, size_t len, const char* prefix) {
-  size_t prefix_len = strlen(prefix);
-  if (len < prefix_len) return false;
-  return memcmp(buf, prefix, prefix_len) == 0;
+/**
+ * Checks if the buffer starts with a prefix
+ */
+bool starts_with(const char* buf, size_t len, const char* prefix) {
+  size_t prefix_len = strlen(prefix);
+  if (len < prefix_len) return false;
+  return memcmp(buf, prefix, prefix_len) == 0;
+}
+
+// ============================================================================
+// HTTP scheduler - worker tasks running the HTTP jobs queued by loop()
+// ============================================================================
+
+void http_worker_task(void* param)
+{
+  HttpWorker* worker = (HttpWorker*)param;
+  HttpJob* job;
+  for (;;) {
+    if (xQueueReceive(worker->queue, &job, portMAX_DELAY) != pdTRUE) continue;
+    job->run(*job);
+    xQueueSend(http_done_queue, &job, portMAX_DELAY); // never waits - there is a queue entry per slot
+  }
+}
+
+// Start the worker tasks - without the first one the jobs run in loop(), as soon as they are
+// queued. Without the award worker the first one also runs the awards
+void http_worker_start()
+{
+  http_done_queue = xQueueCreate(HTTP_JOB_SLOTS, sizeof(HttpJob*));
+  for (int i = 0; i < HTTP_WORKERS && http_done_queue != NULL; i++) {
+    HttpWorker &worker = http_workers[i];
+    if (worker.resp->capacity() == 0 && !worker.resp->reserve(AWARD_BUFFER_SIZE)) break;
+    worker.queue = xQueueCreate(1, sizeof(HttpJob*));
+    if (worker.queue == NULL ||
+        xTaskCreate(http_worker_task, worker.name, HTTP_WORKER_STACK_SIZE, &worker, 1, &worker.handle) != pdPASS) {
+      worker.handle = NULL;
+      break;
+    }
+  }
+  if (http_workers[0].handle == NULL) {
+    Serial.println(F("HTTP WORKER: cannot start the task, requests run in loop()"));
+  }
+}
+
+// A free job slot, or NULL when all of them are taken - background jobs leave
+// HTTP_JOB_SLOTS_RESERVED slots for the Pico's requests
+HttpJob* http_job_alloc(HttpPriority priority)
+{
+  int free_slots = 0;
+  HttpJob* job = NULL;
+  for (int i = 0; i < HTTP_JOB_SLOTS; i++) {
+    if (http_jobs[i].state == HTTP_JOB_FREE) {
+      free_slots++;
+      if (job == NULL) job = &http_jobs[i];
+    }
+  }
+  if (job == NULL || (priority == HTTP_PRIORITY_BACKGROUND && free_slots <= HTTP_JOB_SLOTS_RESERVED)) {
+    return NULL;
+  }
+  job->state = HTTP_JOB_QUEUED; // taken - http_job_submit() must follow
+  job->run = NULL;
+  job->priority = priority;
+  job->conn = NULL;
+  job->resp = NULL;
+  job->result = HTTP_SUCCESS;
+  job->error_state = STATE_UNINITIALIZED;
+  job->request_id[0] = '\0';
+  job->url[0] = '\0';
+  job->data[0] = '\0';
+  job->data_len = 0;
+  return job;
+}
+
+void http_job_submit(HttpJob* job, HttpPriority priority, http_job_handler_t run, http_job_handler_t done)
+{
+  job->run = run;
+  job->done = done;
+  job->priority = priority;
+  job->seq = http_job_seq++;
+  if (http_workers[0].handle == NULL) {
+    job->conn = &http_main;
+    job->resp = &response;
+    run(*job);
+    done(*job);
+    job->state = HTTP_JOB_FREE;
+  }
+  // otherwise it is given to a worker by the next http_scheduler_step()
+}
+
+// Cancel a job: a queued one is given back at once with HTTP_ERR_CANCELLED, a running one
+// stops at the next check of its connection (its run decides what is left to do)
+void http_job_cancel(HttpJob* job)
+{
+  if (job->state == HTTP_JOB_QUEUED) {
+    job->result = HTTP_ERR_CANCELLED;
+    job->done(*job);
+    job->state = HTTP_JOB_FREE;
+  } else if (job->state == HTTP_JOB_RUNNING) {
+    job->conn->cancelled = true;
+  }
+}
+
+// The queued or running job of this kind with this data, or NULL
+HttpJob* http_job_find(http_job_handler_t run, const char* data)
+{
+  for (int i = 0; i < HTTP_JOB_SLOTS; i++) {
+    if (http_jobs[i].state != HTTP_JOB_FREE && http_jobs[i].run == run && strcmp(http_jobs[i].data, data) == 0) {
+      return &http_jobs[i];
+    }
+  }
+  return NULL;
+}
+
+// Is a job of this kind queued or running?
+bool http_job_queued(http_job_handler_t run)
+{
+  for (int i = 0; i < HTTP_JOB_SLOTS; i++) {
+    if (http_jobs[i].state != HTTP_JOB_FREE && http_jobs[i].run == run) return true;
+  }
+  return false;
+}
+
+// Awards run one at a time, in order, on the award worker when there is one
+bool http_worker_accepts(HttpWorker &worker, HttpJob &job)
+{
+  bool award_worker = HTTP_WORKERS > 1 && http_workers[HTTP_WORKERS - 1].handle != NULL;
+  if (worker.awards_only) return job.priority == HTTP_PRIORITY_AWARD;
+  return job.priority != HTTP_PRIORITY_AWARD || !award_worker;
+}
+
+// Call the done callback of the jobs the workers finished and give the idle workers the most
+// urgent jobs - from loop()
+void http_scheduler_step()
+{
+  if (pico_busy && millis() - pico_busy_since >= PICO_BUSY_TIMEOUT_MS) {
+    Serial.println(F("No READY from the Pico - sending again"));
+    pico_busy = false;
+  }
+  HttpJob* job;
+  while (!pico_busy && http_done_queue != NULL && xQueueReceive(http_done_queue, &job, 0) == pdTRUE) {
+    job->done(*job);
+    job->state = HTTP_JOB_FREE;
+    for (int i = 0; i < HTTP_WORKERS; i++) {
+      if (http_workers[i].job == job) http_workers[i].job = NULL;
+    }
+  }
+
+  for (int i = 0; i < HTTP_WORKERS; i++) {
+    HttpWorker &worker = http_workers[i];
+    if (worker.handle == NULL || worker.job != NULL) continue;
+    HttpJob* next = NULL;
+    for (int j = 0; j < HTTP_JOB_SLOTS; j++) {
+      HttpJob* candidate = &http_jobs[j];
+      if (candidate->state == HTTP_JOB_QUEUED && candidate->run != NULL && http_worker_accepts(worker, *candidate) &&
+          (next == NULL || candidate->priority < next->priority ||
+           (candidate->priority == next->priority && (int32_t)(candidate->seq - next->seq) < 0))) {
+        next = candidate;
+      }
+    }
+    if (next == NULL) continue;
+    next->state = HTTP_JOB_RUNNING;
+    next->conn = worker.conn;
+    next->resp = worker.resp;
+    worker.conn->cancelled = false;
+    worker.job = next;
+    xQueueSend(worker.queue, &next, 0);
+  }
+
+  // the Pico's requests still queued or running - keep their timeout from firing
+  if (!pico_busy && millis() - http_keepalive_at >= HTTP_KEEPALIVE_MS) {
+    http_keepalive_at = millis();
+    for (int i = 0; i < HTTP_JOB_SLOTS; i++) {
+      if (http_jobs[i].state != HTTP_JOB_FREE && http_jobs[i].run == http_job_pico_request) {
+        char line[16];
+        snprintf(line, sizeof(line), "WAIT=%s\r\n", http_jobs[i].request_id);
+        send_to_pico(line);
+      }
+    }
+  }
 }
 
 /**
@@ -2378,7 +3858,42 @@ void handle_req_command(const char* cmd, size_t cmd_len) {
   if (data_len >= sizeof(data) - 16) data_len = sizeof(data) - 17; // leave space for "&f=3"
   memcpy(data, data_ptr, data_len);
   data[data_len] = '\0';
-  
+
+  HttpPriority priority = HTTP_PRIORITY_PATCH;
+  if (is_journaled_request(data)) {
+    priority = HTTP_PRIORITY_AWARD;
+  } else if (strncmp(data, "r=ping", 6) == 0) {
+    priority = HTTP_PRIORITY_BACKGROUND;
+    // a ping still waiting (e.g. behind the patch) is superseded by this one
+    for (int i = 0; i < HTTP_JOB_SLOTS; i++) {
+      if (http_jobs[i].state == HTTP_JOB_QUEUED && http_jobs[i].run == http_job_pico_request &&
+          strncmp(http_jobs[i].data, "r=ping", 6) == 0) {
+        http_job_cancel(&http_jobs[i]);
+      }
+    }
+  }
+
+  HttpJob* job = http_job_alloc(priority);
+  if (job == NULL) {
+    Serial.println(F("REQ: too many requests in flight"));
+    return;
+  }
+  strcpy(job->request_id, request_id);
+  strcpy(job->url, url);
+  memcpy(job->data, data, data_len + 1);
+  job->data_len = data_len;
+  http_job_submit(job, priority, http_job_pico_request, http_job_pico_response);
+}
+
+/**
+ * Runs a REQ command of the Pico in the HTTP worker - the answer is left in the response buffer
+ */
+void http_job_pico_request(HttpJob &job) {
+  CharBufferStream &resp = *job.resp;
+  const char* url = job.url;
+  char* data = job.data;
+  size_t data_len = job.data_len;
+
   bool is_patch_request = (strncmp(data, "r=patch", 7) == 0);
   
   // Final URL (can be lambda) - use direct pointer
@@ -2408,100 +3923,156 @@ void handle_req_command(const char* cmd, size_t cmd_len) {
     delay(50);
     yield();
   }
+
+  if (is_patch_request && ENABLE_SKIP_UNLOCKED_ACHIEVEMENTS == 1) {
+    fetch_hardcore_unlocks(url, data);
+  }
   
-  response.clear();
+  resp.clear();
+  // staged - response already has the answer (patch cache or prefetch task)
+  bool staged = false;
+  char patch_game[16] = "";
+  if (is_patch_request && get_request_param(data, "g", patch_game, sizeof(patch_game)) &&
+      strspn(patch_game, "0123456789") != strlen(patch_game)) {
+    patch_game[0] = '\0'; // only numeric IDs are used in file names
+  }
+  if (is_patch_request && ENABLE_PATCH_PREFETCH == 1) {
+    staged = patch_prefetch_take(patch_game, resp);
+  }
+  if (!staged && is_patch_request && ENABLE_PATCH_CACHE == 1 && patch_game[0] != '\0') {
+    staged = patch_cache_load(patch_game, resp);
+  }
+  if (ENABLE_PATCH_PREFETCH == 1 && strncmp(data, "r=gameid", 8) == 0) {
+    staged = patch_prefetch_gameid(data, resp);
+  }
+  bool is_login_request = strncmp(data, "r=login", 7) == 0;
+  if (ENABLE_LOGIN_CACHE == 1 && is_login_request) {
+    staged = login_cache_answer(data, resp);
+  }
   print_memory_stats("BEFORE HTTP REQUEST (REQ handler)");
   
   // Longer timeout for patch requests (30s) as the response can be large (30KB+)
   int request_timeout = is_patch_request ? 30000 : 5000;
   
-  // Execute HTTP request using char* version directly
-  int ret = perform_http_request_buffer(final_url, POST, data, data_len, response, true, 3, request_timeout, 500);
+  int ret;
+  bool journaled = ENABLE_OFFLINE_JOURNAL == 1 && is_journaled_request(data);
+  if (staged) {
+    ret = HTTP_SUCCESS;
+  } else if (journaled && journal_pending > 0) {
+    // older requests are still waiting - keep the order and queue this one behind them
+    ret = HTTP_ERR_NO_WIFI;
+  } else {
+    // Execute HTTP request using char* version directly
+    JsonStreamFilter* filter = nullptr;
+    if (is_patch_request && ENABLE_STREAMING_JSON_FILTER == 1) {
+      json_filter.setRules(patch_rules, sizeof(patch_rules) / sizeof(patch_rules[0]));
+      filter = &json_filter;
+    }
+    ret = perform_http_request_buffer(*job.conn, final_url, POST, data, data_len, resp, true, 3, request_timeout, 500, filter);
+  }
   
-  if (ret < 0) {
+  if (ret < 0 && ret != HTTP_ERR_HTTP_4XX && ret != HTTP_ERR_REPONSE_TOO_BIG && journaled && journal_append(final_url, data)) {
+    journal_local_response(data, resp);
+  }
+  else if (ret < 0 && ret != HTTP_ERR_HTTP_4XX && ret != HTTP_ERR_REPONSE_TOO_BIG && ENABLE_OFFLINE_JOURNAL == 1 && strncmp(data, "r=ping", 6) == 0) {
+    // presence pings are not worth replaying later - answer them locally
+    resp.clear();
+    resp.write((const uint8_t*)"{\"Success\":true}", 16);
+  }
+  else if (ret < 0) {
     Serial.print(F("ERROR ON RESPONSE: "));
     Serial.println(http_request_result_to_cstr(ret));
     if (ret == HTTP_ERR_REPONSE_TOO_BIG) {
-      state = STATE_ERROR_RESPONSE_TOO_BIG;
+      job.error_state = STATE_ERROR_RESPONSE_TOO_BIG;
     } else {
-      state = STATE_ERROR_CONNECTIVITY;
+      job.error_state = STATE_ERROR_CONNECTIVITY;
     }
   } else {
     // Clean JSON in-place
     if (is_patch_request) {
       Serial.print(F("PATCH LENGTH: "));
-      Serial.println(response.length());
+      Serial.println(resp.length());
       
       
-      remove_json_field_buffer(response, "Warning");
-      remove_json_field_buffer(response, "BadgeLockedURL");
-      remove_json_field_buffer(response, "BadgeURL");
-      remove_json_field_buffer(response, "ImageIconURL");
-      remove_json_field_buffer(response, "Rarity");
-      remove_json_field_buffer(response, "RarityHardcore");
-      remove_json_field_buffer(response, "Author");
-      clean_json_field_array_value_buffer(response, "Leaderboards");      
-      remove_achievements_with_flags_5_buffer(response);
-      remove_achievements_with_long_MemAddr_buffer(response, 8192); // remove achievements with MemAddr > 8KB
-      if (response.length() > SERIAL_MAX_PICO_BUFFER) {
-        remove_json_field_buffer(response, "RichPresencePatch");
-      }
-      if (response.length() > SERIAL_MAX_PICO_BUFFER) {
-        clean_json_field_str_value_buffer(response, "Description");
-      }
-      if (response.length() > SERIAL_MAX_PICO_BUFFER) {
-        Serial.println(F("removing achievements with MemAddr > 4KB"));
-        remove_achievements_with_long_MemAddr_buffer(response, 4096);
+      if (!staged) {
+        clean_downloaded_patch(resp, json_filter, ENABLE_STREAMING_JSON_FILTER == 1, patch_game);
       }
-      if (response.length() > SERIAL_MAX_PICO_BUFFER) {
-        Serial.println(F("removing achievements with MemAddr > 2KB"));
-        remove_achievements_with_long_MemAddr_buffer(response, 2048);
+      if (ENABLE_SKIP_UNLOCKED_ACHIEVEMENTS == 1) {
+        stub_unlocked_achievements_buffer(resp);
       }
-      if (response.length() > SERIAL_MAX_PICO_BUFFER) {
-        Serial.println(F("removing achievements with MemAddr > 1KB"));
-        remove_achievements_with_long_MemAddr_buffer(response, 1024);
+      if (resp.length() > SERIAL_MAX_PICO_BUFFER) {
+        Serial.println(F("removing leaderboards"));
+        clean_json_field_array_value_buffer(resp, "Leaderboards");
       }
-      if (response.length() > SERIAL_MAX_PICO_BUFFER) {
-        Serial.println(F("removing achievements with MemAddr > 768B"));
-        remove_achievements_with_long_MemAddr_buffer(response, 768);
+      if (resp.length() > SERIAL_MAX_PICO_BUFFER) {
+        remove_json_field_buffer(resp, "RichPresencePatch");
       }
-      if (response.length() > SERIAL_MAX_PICO_BUFFER) {
-        Serial.println(F("removing achievements with MemAddr > 512B"));
-        remove_achievements_with_long_MemAddr_buffer(response, 512);
+      if (resp.length() > SERIAL_MAX_PICO_BUFFER) {
+        clean_json_field_str_value_buffer(resp, "Description");
       }
+      // drop whole achievements last, as few as possible
+      reduce_patch_achievements_buffer(resp, SERIAL_MAX_PICO_BUFFER - 1, PATCH_MEMADDR_MAX_SIZE);
       
-      Serial.println(response.c_str());
+      Serial.println(resp.c_str());
       Serial.print(F("NEW PATCH LENGTH: "));
-      Serial.println(response.length());
-    } else if (strncmp(data, "r=login", 7) == 0) {
-      remove_json_field_buffer(response, "AvatarUrl");
+      Serial.println(resp.length());
+    } else if (is_login_request) {
+      remove_json_field_buffer(resp, "AvatarUrl");
+      if (ENABLE_LOGIN_CACHE == 1 && !staged) {
+        login_cache_store_answer(data, resp);
+      }
     }
   }
-  
-  if (state < 198 && response.length() < SERIAL_MAX_PICO_BUFFER) {
-    Serial0.print(F("RESP="));
-    Serial0.print(request_id);
-    Serial0.print(F(";200;"));
-    
-    const char *ptr = response.c_str();
-    uint32_t len = response.length();
-    uint32_t offset = 0;
-    
-    while (offset < len) {
-      uint32_t chunk_len = min((uint32_t)SERIAL_COMM_CHUNK_SIZE, (uint32_t)(len - offset));
-      Serial0.write((const uint8_t *)&ptr[offset], chunk_len);
-      Serial0.flush();
-      offset += chunk_len;
-      delay(SERIAL_COMM_TX_DELAY_MS);
-    }
+  if (ENABLE_LOGIN_CACHE == 1 && !staged && strncmp(data, "r=awardachievement", 18) == 0) {
+    login_cache_check_award(ret, job.conn->status, resp);
+  }
+  job.data_len = data_len;
+  job.result = ret;
+}
+
+/**
+ * Send the answer of a REQ command to the Pico
+ */
+void send_resp_to_pico(const char* request_id, const char* body, size_t body_len) {
+  char header[32];
+  sprintf(header, "RESP=%s;200;", request_id);
+  if (link_framing) {
+    send_framed_to_pico(header, strlen(header), body, body_len);
+    Serial.printf("LINK: %lu frames resent, %lu bad frames received\n", (unsigned long)link_retransmits,
+                  (unsigned long)pico_frame_decoder.errors);
+  } else {
+    Serial0.print(header);
+    send_response_to_pico(body, body_len, strlen(header));
     Serial0.print(F("\r\n"));
-    
-    Serial.print(F("RESP="));
-    Serial.print(request_id);
-    Serial.println(F(";"));
   }
   
-  response.clear();
+  Serial.print(F("RESP="));
+  Serial.print(request_id);
+  Serial.println(F(";"));
+}
+
+/**
+ * Done callback of a REQ command - sends the answer to the Pico
+ */
+void http_job_pico_response(HttpJob &job) {
+  if (job.resp == NULL) {
+    // cancelled before it ran - only pings are cancelled, superseded by a newer one
+    send_resp_to_pico(job.request_id, "{\"Success\":true}", 16);
+    return;
+  }
+  bool is_patch_request = (strncmp(job.data, "r=patch", 7) == 0);
+  if (job.error_state != STATE_UNINITIALIZED) {
+    state = job.error_state;
+  }
+  if (ENABLE_OFFLINE_JOURNAL == 1 && is_journaled_request(job.data)) {
+    show_journal_status();
+  }
+
+  if (state < 198 && job.resp->length() < SERIAL_MAX_PICO_BUFFER) {
+    send_resp_to_pico(job.request_id, job.resp->c_str(), job.resp->length());
+  }
+  
+  job.resp->clear();
   
   // After patch, release large buffer and reallocate small buffer
   if (is_patch_request) {
@@ -2517,6 +4088,240 @@ void handle_req_command(const char* cmd, size_t cmd_len) {
 }
 
 
+/**
+ * write one frame to the Pico - the payload can be given in two parts (e.g. RESP header and body)
+ */
+void write_pico_frame(uint8_t type, uint8_t seq, const char *a, size_t a_len, const char *b, size_t b_len) {
+  uint8_t header[LINK_FRAME_HEADER_SIZE];
+  uint8_t trailer[LINK_FRAME_CRC_SIZE];
+  uint32_t crc;
+  link_frame_header(header, type, seq, a_len + b_len, &crc);
+  crc = link_frame_crc32(crc, (const uint8_t *)a, a_len);
+  crc = link_frame_crc32(crc, (const uint8_t *)b, b_len);
+  link_frame_trailer(trailer, crc);
+  Serial0.write(header, LINK_FRAME_HEADER_SIZE);
+  if (a_len > 0) Serial0.write((const uint8_t *)a, a_len);
+  if (b_len > 0) Serial0.write((const uint8_t *)b, b_len);
+  Serial0.write(trailer, LINK_FRAME_CRC_SIZE);
+}
+
+/**
+ * decode the frames sent by the Pico. ACK/NAK are kept for send_framed_to_pico and each
+ * complete command is appended to serial_buffer as a line, to be handled by the loop (also
+ * when it arrives while a command is being sent)
+ */
+void poll_pico_frames() {
+  uint8_t chunk[128];
+  while (Serial0.available() > 0) {
+    size_t n = Serial0.read(chunk, min((size_t)Serial0.available(), sizeof(chunk)));
+    size_t offset = 0;
+    while (offset < n) {
+      pico_frame_decoder.setBuffer(pico_command + pico_command_len, SERIAL_BUFFER_SIZE - 3 - pico_command_len);
+      size_t consumed;
+      int result = pico_frame_decoder.decode(chunk + offset, n - offset, &consumed);
+      offset += consumed;
+      if (result == LINK_FRAME_INCOMPLETE) {
+        break;
+      }
+      if (result < 0) {
+        // frames from the Pico are not resent - a lost REQ is retried by the Pico itself
+        Serial.println(F("LINK: bad frame from the Pico"));
+        continue;
+      }
+      uint8_t type = pico_frame_decoder.type;
+      if (type == LINK_FRAME_ACK) {
+        link_ack_received = true;
+        link_ack_seq = pico_frame_decoder.seq;
+      } else if (type == LINK_FRAME_NAK) {
+        link_nak_received = true;
+        link_nak_seq = pico_frame_decoder.seq;
+      } else if (type == LINK_FRAME_CMD || type == LINK_FRAME_CMD_PART) {
+        if (result == LINK_FRAME_OVERFLOW || pico_command_discard) {
+          pico_command_len = 0;
+          pico_command_discard = type == LINK_FRAME_CMD_PART;
+          continue;
+        }
+        pico_command_len += pico_frame_decoder.len;
+        if (type == LINK_FRAME_CMD) {
+          if (serial_buffer_len + pico_command_len + 2 < SERIAL_BUFFER_SIZE) {
+            memcpy(serial_buffer + serial_buffer_len, pico_command, pico_command_len);
+            serial_buffer_len += pico_command_len;
+            serial_buffer[serial_buffer_len++] = '\r';
+            serial_buffer[serial_buffer_len++] = '\n';
+            serial_buffer[serial_buffer_len] = '\0';
+          } else {
+            Serial.println(F("BUFFER_OVERFLOW"));
+          }
+          pico_command_len = 0;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * send a command to the Pico as frames (the head and body parts are sent as one command)
+ * with go-back-N: at most LINK_FRAME_WINDOW frames without ACK, and a NAK or a timeout
+ * resends from the first frame not acknowledged
+ */
+bool send_framed_to_pico(const char *head, size_t head_len, const char *body, size_t body_len) {
+  size_t total = head_len + body_len;
+  uint32_t frames = total == 0 ? 1 : (total + LINK_FRAME_MAX_PAYLOAD - 1) / LINK_FRAME_MAX_PAYLOAD;
+  uint8_t first_seq = link_tx_seq;
+  uint32_t base = 0; // first frame not acknowledged
+  uint32_t next = 0; // next frame to send
+  int retries = 0;
+  unsigned long last_progress = millis();
+  link_ack_received = false;
+  link_nak_received = false;
+
+  while (base < frames) {
+    while (next < frames && next < base + LINK_FRAME_WINDOW) {
+      size_t start = next * LINK_FRAME_MAX_PAYLOAD;
+      size_t end = min(start + LINK_FRAME_MAX_PAYLOAD, total);
+      // the part of the frame in head, then the part in body
+      size_t a_start = min(start, head_len), a_end = min(end, head_len);
+      size_t b_start = max(start, head_len) - head_len, b_end = max(end, head_len) - head_len;
+      write_pico_frame(next == frames - 1 ? LINK_FRAME_CMD : LINK_FRAME_CMD_PART, (uint8_t)(first_seq + next),
+                       head + a_start, a_end - a_start, body + b_start, b_end - b_start);
+      next++;
+    }
+
+    poll_pico_frames();
+    if (link_ack_received) {
+      link_ack_received = false;
+      uint32_t index = (uint8_t)(link_ack_seq - first_seq);
+      if (index >= base && index < next) {
+        base = index + 1;
+        retries = 0;
+        last_progress = millis();
+      }
+    }
+    if (link_nak_received) {
+      link_nak_received = false;
+      uint32_t index = (uint8_t)(link_nak_seq - first_seq);
+      if (index >= base && index < next) {
+        base = index;
+        next = index;
+        retries++;
+        link_retransmits++;
+        last_progress = millis();
+      }
+    }
+    if (base < frames && millis() - last_progress > LINK_FRAME_ACK_TIMEOUT_MS) {
+      next = base;
+      retries++;
+      link_retransmits++;
+      last_progress = millis();
+    }
+    if (retries > LINK_FRAME_MAX_RETRIES) {
+      Serial.println(F("LINK: no ACK from the Pico - command dropped"));
+      link_tx_seq = first_seq + base; // the frame the Pico is waiting for
+      return false;
+    }
+    if (base < frames && next == base + LINK_FRAME_WINDOW) {
+      delay(1);
+    }
+  }
+  link_tx_seq = first_seq + frames;
+  return true;
+}
+
+/**
+ * send a text command (ending with \r\n) to the Pico - as frames when the link is framed
+ */
+void send_to_pico(const char *text) {
+  if (link_framing) {
+    size_t len = strlen(text);
+    if (len >= 2 && text[len - 2] == '\r' && text[len - 1] == '\n') {
+      len -= 2;
+    }
+    send_framed_to_pico(text, len, NULL, 0);
+    return;
+  }
+  Serial0.print(text);
+}
+
+/**
+ * read what the Pico sent while a response is streamed - ACK bytes are counted and anything
+ * else is appended to serial_buffer, to be handled by the loop afterwards
+ */
+uint32_t read_pico_flow_acks() {
+  uint32_t acks = 0;
+  while (Serial0.available() > 0) {
+    int c = Serial0.read();
+    if (c == LINK_FLOW_ACK) {
+      acks++;
+    } else if (serial_buffer_len < SERIAL_BUFFER_SIZE - 1) {
+      serial_buffer[serial_buffer_len++] = (char)c;
+      serial_buffer[serial_buffer_len] = '\0';
+    }
+  }
+  return acks;
+}
+
+/**
+ * stream a response body to the Pico. The Pico counts the bytes of the whole line, so
+ * line_offset is the size of the RESP header already sent
+ */
+void send_response_to_pico(const char *ptr, uint32_t len, uint32_t line_offset) {
+  uint32_t offset = 0;
+  uint32_t acked_blocks = 0;
+  unsigned long begin = millis();
+  unsigned long last_progress = begin;
+  // re-armed for every response - a stall only paces the rest of this one
+  bool credit = link_flow_ack;
+
+  // late ACKs of a previous response must not count as credit for this one
+  read_pico_flow_acks();
+
+  while (offset < len) {
+    uint32_t line_pos = line_offset + offset;
+    if (link_flow_ack) {
+      uint32_t acks = read_pico_flow_acks();
+      acked_blocks += acks;
+      if (acks > 0) {
+        link_flow_ack_seen = true;
+        last_progress = millis();
+        if (!credit) {
+          Serial.println(F("Flow ACKs from the Pico again - back to the credit window"));
+          credit = true;
+        }
+      }
+    }
+    if (credit) {
+      // no credit left - wait for the Pico to consume a block
+      if (line_pos / LINK_FLOW_BLOCK_SIZE >= acked_blocks + LINK_FLOW_WINDOW_BLOCKS) {
+        if (millis() - last_progress > LINK_FLOW_ACK_TIMEOUT_MS) {
+          Serial.println(F("No flow ACK from the Pico - using fixed pacing"));
+          credit = false;
+          // a Pico without ENABLE_LINK_FLOW_ACK - do not wait for it on every response
+          link_flow_ack = link_flow_ack_seen;
+        }
+        delay(1);
+        continue;
+      }
+      last_progress = millis();
+      // up to the end of the current block
+      uint32_t chunk_len = min(LINK_FLOW_BLOCK_SIZE - line_pos % LINK_FLOW_BLOCK_SIZE, len - offset);
+      Serial0.write((const uint8_t *)&ptr[offset], chunk_len);
+      offset += chunk_len;
+    } else {
+      uint32_t chunk_len = min((uint32_t)SERIAL_COMM_CHUNK_SIZE, (uint32_t)(len - offset));
+      Serial0.write((const uint8_t *)&ptr[offset], chunk_len);
+      Serial0.flush();
+      offset += chunk_len;
+      delay(SERIAL_COMM_TX_DELAY_MS);
+    }
+  }
+  Serial0.flush();
+  unsigned long elapsed = millis() - begin;
+  if (len > LINK_FLOW_BLOCK_SIZE && elapsed > 0) {
+    Serial.printf("Sent %lu bytes to the Pico in %lu ms (%lu bytes/s)\n", (unsigned long)len, elapsed,
+                  (unsigned long)(len * 1000UL / elapsed));
+  }
+}
+
 /**
  * Handler for READ_CRC command - Cartridge CRCs sent by Pico
  * @param cmd Pointer to data after "READ_CRC="
@@ -2524,7 +4329,7 @@ void handle_req_command(const char* cmd, size_t cmd_len) {
  */
 void handle_read_crc_command(const char* cmd, size_t cmd_len) {
   if (state != STATE_WAITING_CRC) {
-    Serial0.print(F("COMMAND_IGNORED_WRONG_STATE\r\n"));
+    send_to_pico("COMMAND_IGNORED_WRONG_STATE\r\n");
     Serial.print(F("COMMAND_IGNORED_WRONG_STATE\r\n"));
     return;
   }
@@ -2576,16 +4381,19 @@ void handle_read_crc_command(const char* cmd, size_t cmd_len) {
   }
   
   if (!found) {
-    Serial0.print(F("CRC_NOT_FOUND\r\n"));
+    send_to_pico("CRC_NOT_FOUND\r\n");
     Serial.print(F("CRC_NOT_FOUND\r\n"));
     state = STATE_ERROR_CARTRIDGE_NOT_FOUND;
   } else {
-    Serial0.print(F("CRC_FOUND_MD5="));
-    Serial0.print(md5_global);
-    Serial0.print(F("\r\n"));
+    char aux[64];
+    sprintf(aux, "CRC_FOUND_MD5=%s\r\n", md5_global);
+    send_to_pico(aux);
     Serial.print(F("CRC_FOUND_MD5="));
     Serial.println(md5_global);
     state = STATE_CRC_FOUND;
+#if ENABLE_PATCH_PREFETCH == 1
+    patch_prefetch_start(md5_global);
+#endif
   }
 }
 
@@ -2651,6 +4459,12 @@ void handle_achievement_command(const char* cmd, size_t cmd_len) {
   achievement.id = atoi(id_str);
   achievement.title = String(title_str);
   achievement.url = String(url_str);
+  achievement.queued_at = millis();
+#ifdef ENABLE_LCD
+  char file_name[64];
+  sprintf(file_name, "/achievement_%d.png", achievement.id);
+  queue_image_download(url_str, file_name);
+#endif
   
   // Increment unlocked counter
   unlocked_achievements++;
@@ -2688,6 +4502,7 @@ void handle_game_info_command(const char* cmd, size_t cmd_len) {
   // Reset achievement counters for new game
   total_achievements = 0;
   unlocked_achievements = 0;
+  rich_presence[0] = '\0';
   
   // Advance
   const char* remaining = cmd + pos1 + 1;
@@ -2732,7 +4547,7 @@ void handle_game_info_command(const char* cmd, size_t cmd_len) {
   
   char file_name[64];
   sprintf(file_name, "/title_%s.png", game_id.c_str());
-  try_download_file(game_image, file_name);
+  queue_image_download(url_str, file_name);
   
   // Extract file name from URL
   int last_slash = game_image.lastIndexOf("/");
@@ -2801,6 +4616,32 @@ void handle_ach_summary_command(const char* cmd, size_t cmd_len) {
   Serial.println(total_achievements);
 }
 
+/**
+ * Handler for RP= command - Rich presence text (sent by the Pico when it changes)
+ * @param cmd Pointer to data after "RP="
+ * @param cmd_len Length of data
+ */
+void handle_rich_presence_command(const char* cmd, size_t cmd_len) {
+  size_t len = cmd_len;
+  if (len >= sizeof(rich_presence)) len = sizeof(rich_presence) - 1;
+  memcpy(rich_presence, cmd, len);
+  rich_presence[len] = '\0';
+
+  Serial.print(F("RP="));
+  Serial.println(rich_presence);
+
+  // only redraw when the title screen is being shown (not over an achievement)
+  if (already_showed_title_screen && !go_back_to_title_screen) {
+    showRichPresence();
+  }
+
+#ifdef ENABLE_INTERNAL_WEB_APP_SUPPORT
+  char aux[sizeof(rich_presence) + 4];
+  snprintf(aux, sizeof(aux), "RP=%s", rich_presence);
+  send_ws_data(aux);
+#endif
+}
+
 /**
  * Handler for NES_RESETED command - User reset the NES
  */
@@ -2822,6 +4663,183 @@ void handle_nes_reset_command() {
   state = STATE_IDLE;
 }
 
+/**
+ * Handler for C= / P= commands (challenge and progress indicators) - forwarded to the web app
+ */
+void forward_to_web_app(const char* cmd, size_t cmd_len) {
+#ifdef ENABLE_INTERNAL_WEB_APP_SUPPORT
+  // Create temporary String only for websocket
+  char temp[256];
+  size_t temp_len = min(cmd_len, sizeof(temp) - 1);
+  memcpy(temp, cmd, temp_len);
+  temp[temp_len] = '\0';
+  send_ws_data(String(temp));
+#endif
+}
+
+/**
+ * Handler for L= / T= commands - leaderboard started/failed/submitted (L=) and tracker
+ * show/update/hide (T=)
+ */
+void handle_leaderboard_command(const char* cmd, size_t cmd_len) {
+  Serial.write(cmd, cmd_len);
+  Serial.println();
+  forward_to_web_app(cmd, cmd_len);
+}
+
+/**
+ * Handlers for BUSY / READY - the Pico stores the patch in its flash in between
+ */
+void handle_pico_busy_command(const char* cmd, size_t cmd_len) {
+  pico_busy = true;
+  pico_busy_since = millis();
+}
+
+void handle_pico_ready_command(const char* cmd, size_t cmd_len) {
+  pico_busy = false;
+}
+
+void handle_nes_reseted_command(const char* cmd, size_t cmd_len) {
+  handle_nes_reset_command();
+}
+
+typedef void (*pico_command_handler_t)(const char* cmd, size_t cmd_len);
+
+struct pico_command_t {
+  const char *prefix;
+  pico_command_handler_t handler;
+  bool whole_command; // the handler gets the command with its prefix
+};
+
+// commands sent by the Pico - the same table is used for lines and frames
+const pico_command_t pico_commands[] = {
+  {"REQ=", handle_req_command, false},
+  {"READ_CRC=", handle_read_crc_command, false},
+  {"A=", handle_achievement_command, false},
+  {"GAME_INFO=", handle_game_info_command, false},
+  {"ACH_SUMMARY=", handle_ach_summary_command, false},
+  {"NES_RESETED", handle_nes_reseted_command, false},
+  {"RP=", handle_rich_presence_command, false},
+  {"C=", forward_to_web_app, true},
+  {"P=", forward_to_web_app, true},
+  {"L=", handle_leaderboard_command, true},
+  {"T=", handle_leaderboard_command, true},
+  {"BUSY", handle_pico_busy_command, false},
+  {"READY", handle_pico_ready_command, false},
+};
+
+void dispatch_pico_command(const char* cmd, size_t cmd_len) {
+  for (size_t i = 0; i < sizeof(pico_commands) / sizeof(pico_commands[0]); i++) {
+    const pico_command_t *command = &pico_commands[i];
+    if (starts_with(cmd, cmd_len, command->prefix)) {
+      size_t prefix_len = command->whole_command ? 0 : strlen(command->prefix);
+      command->handler(cmd + prefix_len, cmd_len - prefix_len);
+      return;
+    }
+  }
+  Serial.print(F("UNKNOWN="));
+  Serial.write(cmd, cmd_len);
+  Serial.println();
+}
+
+#define LINK_DEFAULT_BAUD 115200
+#define LINK_TEST_PATTERN_SIZE 1024
+#define LINK_BAUD_TEST_TIMEOUT_MS 1000 // same as the Pico - it goes back to 115200 after it
+const uint32_t link_baud_rates[] = {2000000, 921600};
+uint32_t link_baud = LINK_DEFAULT_BAUD;
+
+// wait for a line from the Pico that starts with one of the two prefixes - returns 1 or 2 (0 on timeout)
+int wait_pico_line(const char *expected, const char *failure, unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while (millis() - start < timeoutMs) {
+    if (Serial0.available() > 0) {
+      String line = Serial0.readStringUntil('\n');
+      line.trim();
+      if (line.startsWith(expected)) {
+        return 1;
+      }
+      if (failure != NULL && line.startsWith(failure)) {
+        return 2;
+      }
+    }
+    delay(1);
+  }
+  return 0;
+}
+
+// try each rate of link_baud_rates - returns true when the Pico verified one of them
+bool negotiate_link_baud() {
+  uint8_t pattern[LINK_TEST_PATTERN_SIZE];
+  // printable bytes only (no ';', '\r' or '\n'), so the line goes through the normal command parser
+  for (int i = 0; i < LINK_TEST_PATTERN_SIZE; i++) {
+    pattern[i] = 0x3C + ((i * 7 + i / 67) % 67);
+  }
+  uint32_t crc = link_frame_crc32(0xFFFFFFFF, pattern, LINK_TEST_PATTERN_SIZE) ^ 0xFFFFFFFF;
+  char aux[32];
+
+  for (size_t i = 0; i < sizeof(link_baud_rates) / sizeof(link_baud_rates[0]); i++) {
+    uint32_t rate = link_baud_rates[i];
+    while (Serial0.available() > 0) Serial0.read();
+    sprintf(aux, "BAUD=%lu\r\n", (unsigned long)rate);
+    Serial0.print(aux);
+    Serial0.flush();
+    int ack = wait_pico_line("BAUD_ACK", "BAUD_NAK", 500);
+    if (ack == 2) {
+      continue;
+    }
+    Serial0.updateBaudRate(rate);
+    if (ack == 0) {
+      // the ACK may have been lost after the Pico switched - let it time out and go back
+      Serial0.updateBaudRate(LINK_DEFAULT_BAUD);
+      delay(LINK_BAUD_TEST_TIMEOUT_MS + 100);
+      continue;
+    }
+    delay(2);
+    while (Serial0.available() > 0) Serial0.read();
+
+    // the leading \r\n discards anything the Pico got while the rates did not match
+    unsigned long start = millis();
+    Serial0.print(F("\r\nBAUD_TEST="));
+    Serial0.write(pattern, LINK_TEST_PATTERN_SIZE);
+    sprintf(aux, ";%08lX\r\n", (unsigned long)crc);
+    Serial0.print(aux);
+    int result = wait_pico_line("BAUD_OK", "BAUD_FAIL", LINK_BAUD_TEST_TIMEOUT_MS);
+    unsigned long elapsed = millis() - start;
+    if (result == 1) {
+      link_baud = rate;
+      Serial.printf("Link at %lu baud - test pattern %d bytes in %lu ms (%lu bytes/s)\n", (unsigned long)rate,
+                    LINK_TEST_PATTERN_SIZE, elapsed, elapsed > 0 ? (unsigned long)(LINK_TEST_PATTERN_SIZE * 1000UL / elapsed) : 0UL);
+      return true;
+    }
+    Serial.printf("Link test at %lu baud failed\n", (unsigned long)rate);
+    Serial0.updateBaudRate(LINK_DEFAULT_BAUD);
+    if (result == 0) {
+      // the Pico may not have seen the test - wait until it goes back to the default rate
+      delay(LINK_BAUD_TEST_TIMEOUT_MS + 100);
+    }
+  }
+  link_baud = LINK_DEFAULT_BAUD;
+  Serial.println(F("Link stays at 115200 baud"));
+  return false;
+}
+
+// switch the link to frames - FRAMING_ACK is the last text line from the Pico
+bool negotiate_link_framing() {
+  while (Serial0.available() > 0) Serial0.read();
+  Serial0.print(F("FRAMING=1\r\n"));
+  Serial0.flush();
+  if (wait_pico_line("FRAMING_ACK", NULL, 500) != 1) {
+    Serial.println(F("Link framing not supported by the Pico"));
+    return false;
+  }
+  link_framing = true;
+  link_tx_seq = 0;
+  pico_command_len = 0;
+  pico_frame_decoder.reset();
+  Serial.println(F("Link framing enabled"));
+  return true;
+}
+
 // Sync with Pico - sends SYNC command and waits for SYNC_ACK or PICO_READY
 // Returns true if sync successful, false if failed after maxRetries
 bool syncWithPico(int maxRetries = 3) {
@@ -2852,6 +4870,23 @@ bool syncWithPico(int maxRetries = 3) {
     Serial.println(i + 1);
     Serial0.print(F("RESET\r\n"));
     Serial0.flush();
+#if ENABLE_FAST_LINK == 1
+    // the Pico may still be at a negotiated rate (only the ESP32 restarted) - reset it at each one
+    for (size_t r = 0; r < sizeof(link_baud_rates) / sizeof(link_baud_rates[0]); r++) {
+      Serial0.updateBaudRate(link_baud_rates[r]);
+      Serial0.print(F("\r\nRESET\r\n"));
+#if ENABLE_LINK_FRAMING == 1
+      write_pico_frame(LINK_FRAME_RESET, 0, NULL, 0, NULL, 0);
+#endif
+      Serial0.flush();
+    }
+    Serial0.updateBaudRate(LINK_DEFAULT_BAUD);
+#endif
+#if ENABLE_LINK_FRAMING == 1
+    // or still framed
+    write_pico_frame(LINK_FRAME_RESET, 0, NULL, 0, NULL, 0);
+    Serial0.flush();
+#endif
     delay(500); // Wait for Pico to reboot
   }
   
@@ -2917,6 +4952,7 @@ void setup()
       Serial.println(F("FATAL: Could not allocate response buffer!"));
     }
   }
+  http_worker_start();
   
   // print_memory_stats("AFTER LARGE BUFFER ALLOCATION");
 
@@ -2968,15 +5004,26 @@ void setup()
       delay(1000);
     }
   }
+#if ENABLE_FAST_LINK == 1
+  negotiate_link_baud();
+#endif
+#if ENABLE_LINK_FRAMING == 1
+  negotiate_link_framing();
+#endif
 
   // check if the reset button is pressed and handle the reset routine
   handle_reset();
 
 
   // Pré-inicializar o cliente SSL global (configura os buffers SSL)
-  globalSecureClient.setInsecure();
-  globalSecureClient.setTimeout(15);
+  http_main.client.setInsecure();
+  http_main.client.setTimeout(15);
+  http_main.http.setReuse(true); // keep-alive between requests to the same host
   httpClientInitialized = true;
+
+#if ENABLE_OFFLINE_JOURNAL == 1
+  journal_init();
+#endif
   
   Serial.println(F("Global HTTP client initialized"));
   // print_memory_stats("AFTER SSL CLIENT INIT");
@@ -3093,7 +5140,16 @@ void setup()
     read_ra_pass_from_eeprom(ra_pass, sizeof(ra_pass));
     
     print_line("Logging in RA...", 1, 1);
-    ra_user_token = try_login_RA(String(ra_user), String(ra_pass));
+    if (ENABLE_LOGIN_CACHE == 1 && login_cache_load(ra_user, ra_user_token)) {
+      // checked with the server once the adapter is up
+      login_verify_pending = true;
+      login_verify_at = millis() + LOGIN_VERIFY_DELAY_MS;
+    } else {
+      ra_user_token = try_login_RA(String(ra_user), String(ra_pass));
+      if (ENABLE_LOGIN_CACHE == 1 && ra_user_token.compareTo("") != 0 && ra_user_token.compareTo("null") != 0) {
+        login_cache_save(ra_user, ra_user_token.c_str(), 0);
+      }
+    }
     if (ra_user_token.compareTo("") != 0)
     {
       setSemaphore(LED_BLINK_MEDIUM, LED_GREEN);
@@ -3125,13 +5181,14 @@ void setup()
   // Ler user para buffer fixo antes de liberar EEPROM
   char ra_user_for_pico[64];
   read_ra_user_from_eeprom(ra_user_for_pico, sizeof(ra_user_for_pico));
+  strcpy(ra_user_name, ra_user_for_pico);
   
   char token_and_user[128];
   sprintf(token_and_user, "TOKEN_AND_USER=%s,%s\r\n", ra_user_token.c_str(), ra_user_for_pico);
 
   delay(250);                   // make sure pico restarted
   Serial.print(token_and_user); // debug
-  Serial0.print(token_and_user);  
+  send_to_pico(token_and_user);
   state = STATE_IDENTIFY_CARTRIDGE;
 
   // modem sleep
@@ -3184,6 +5241,9 @@ void loop()
     }
   }
 
+  // answer the Pico's requests the HTTP workers finished and start the next ones
+  http_scheduler_step();
+
   // handle errors during the cartridge identification - unified error handling
   if (isErrorState(state))
   {
@@ -3200,13 +5260,23 @@ void loop()
     state = STATE_IDLE; // do nothing - it will not enable the BUS, so the game will not boot
   }
 
+#if ENABLE_OFFLINE_JOURNAL == 1
+  // replay award requests saved while offline
+  journal_replay_step();
+#endif
+
+#if ENABLE_LOGIN_CACHE == 1
+  // check the token of a cached login
+  login_verify_step();
+#endif
+
   // handle the cartridge identification
   if (state == STATE_IDENTIFY_CARTRIDGE)
   {
     setSemaphore(LED_BLINK_FAST, LED_GREEN);
     print_line("Identifying cartridge...", 1, 1);
 
-    Serial0.print(F("READ_CRC\r\n")); // send command to read cartridge crc
+    send_to_pico("READ_CRC\r\n");   // send command to read cartridge crc
     Serial.print(F("READ_CRC\r\n"));  // send command to read cartridge crc
     delay(250);
     state = STATE_WAITING_CRC;
@@ -3219,13 +5289,16 @@ void loop()
   // inform the pico to start the process to watch the BUS for memory writes
   if (state == STATE_CRC_FOUND)
   {
-    Serial0.print(F("START_WATCH\r\n"));
+    send_to_pico("START_WATCH\r\n");
     Serial.print(F("START_WATCH\r\n"));
     state = STATE_WATCHING;
   }
 
   // if there is some achievement to be shown, show it
-  if (fifo_is_empty(&achievements_fifo) == false && Serial.available() == 0 && go_back_to_title_screen == false) // show achievements
+  // lines from the Pico (e.g. award REQs of a burst of unlocks) are handled before an
+  // achievement is shown, as showing it blocks for the image download and sounds
+  if (fifo_is_empty(&achievements_fifo) == false && Serial.available() == 0 && Serial0.available() == 0 && go_back_to_title_screen == false &&
+      achievement_image_ready(fifo_peek(&achievements_fifo))) // show achievements
   {
     achievements_t achievement;
     fifo_dequeue(&achievements_fifo, &achievement);
@@ -3237,9 +5310,19 @@ void loop()
   {
     // Read only up to available space
     size_t available_space = SERIAL_BUFFER_SIZE - serial_buffer_len - 1;
-    if (available_space > 0) {
+    if (link_framing) {
+      // commands taken from the frames are appended to serial_buffer as lines
+      poll_pico_frames();
+    } else if (available_space > 0) {
       size_t bytes_read = Serial0.readBytes(serial_buffer + serial_buffer_len, available_space);
-      serial_buffer_len += bytes_read;
+      // drop flow ACKs that arrived after the response was sent
+      size_t kept = serial_buffer_len;
+      for (size_t i = serial_buffer_len; i < serial_buffer_len + bytes_read; i++) {
+        if (serial_buffer[i] != LINK_FLOW_ACK) {
+          serial_buffer[kept++] = serial_buffer[i];
+        }
+      }
+      serial_buffer_len = kept;
       serial_buffer[serial_buffer_len] = '\0'; // null-terminate
     }
     
@@ -3248,7 +5331,7 @@ void loop()
     {
       serial_buffer_len = 0;
       serial_buffer[0] = '\0';
-      Serial0.print(F("BUFFER_OVERFLOW\r\n"));
+      send_to_pico("BUFFER_OVERFLOW\r\n");
       Serial.print(F("BUFFER_OVERFLOW\r\n"));
       continue;
     }
@@ -3260,49 +5343,7 @@ void loop()
       // We have a complete command
       size_t cmd_len = crlf_pos; // does not include \r\n
       
-      // Dispatch to the appropriate handler
-      if (starts_with(serial_buffer, cmd_len, "REQ=")) {
-        handle_req_command(serial_buffer + 4, cmd_len - 4);
-      }
-      else if (starts_with(serial_buffer, cmd_len, "READ_CRC=")) {
-        handle_read_crc_command(serial_buffer + 9, cmd_len - 9);
-      }
-      else if (starts_with(serial_buffer, cmd_len, "A=")) {
-        handle_achievement_command(serial_buffer + 2, cmd_len - 2);
-      }
-      else if (starts_with(serial_buffer, cmd_len, "GAME_INFO=")) {
-        handle_game_info_command(serial_buffer + 10, cmd_len - 10);
-      }
-      else if (starts_with(serial_buffer, cmd_len, "ACH_SUMMARY=")) {
-        handle_ach_summary_command(serial_buffer + 12, cmd_len - 12);
-      }
-      else if (starts_with(serial_buffer, cmd_len, "NES_RESETED")) {
-        handle_nes_reset_command();
-      }
-      else if (starts_with(serial_buffer, cmd_len, "C=")) {
-#ifdef ENABLE_INTERNAL_WEB_APP_SUPPORT
-        // Create temporary String only for websocket
-        char temp[256];
-        size_t temp_len = min(cmd_len, sizeof(temp) - 1);
-        memcpy(temp, serial_buffer, temp_len);
-        temp[temp_len] = '\0';
-        send_ws_data(String(temp));
-#endif
-      }
-      else if (starts_with(serial_buffer, cmd_len, "P=")) {
-#ifdef ENABLE_INTERNAL_WEB_APP_SUPPORT
-        char temp[256];
-        size_t temp_len = min(cmd_len, sizeof(temp) - 1);
-        memcpy(temp, serial_buffer, temp_len);
-        temp[temp_len] = '\0';
-        send_ws_data(String(temp));
-#endif
-      }
-      else {
-        Serial.print(F("UNKNOWN="));
-        Serial.write(serial_buffer, cmd_len);
-        Serial.println();
-      }
+      dispatch_pico_command(serial_buffer, cmd_len);
       
       // Remove processed command from buffer (including \r\n)      
       size_t remove_len = crlf_pos + 2;
@@ -0,0 +1,158 @@
+#include "event_queue.h"
+
+#include <string.h>
+
+void event_queue_init(event_queue_t *queue)
+{
+    memset(queue, 0, sizeof(event_queue_t));
+}
+
+bool event_queue_is_empty(const event_queue_t *queue)
+{
+    // spilled entries are only kept while the queue is full
+    return queue->count == 0;
+}
+
+uint8_t event_queue_depth(const event_queue_t *queue)
+{
+    return queue->count + queue->spill_count;
+}
+
+static void event_queue_remove_at(event_queue_t *queue, int index)
+{
+    queue->count--;
+    // keep the array compact - order does not matter, seq keeps the arrival order
+    queue->entries[index] = queue->entries[queue->count];
+}
+
+// index of the entry to evict to make room for an entry with the given priority, or -1
+static int event_queue_find_victim(const event_queue_t *queue, uint8_t priority)
+{
+    int victim = -1;
+    for (int i = 0; i < queue->count; i++)
+    {
+        const event_queue_entry_t *entry = &queue->entries[i];
+        if (entry->priority <= priority)
+        {
+            continue;
+        }
+        if (victim == -1)
+        {
+            victim = i;
+            continue;
+        }
+        const event_queue_entry_t *current = &queue->entries[victim];
+        // prefer coalescible entries (only the latest value matters), then the lowest
+        // priority, then the newest one
+        if (entry->coalesce != current->coalesce)
+        {
+            if (entry->coalesce)
+            {
+                victim = i;
+            }
+        }
+        else if (entry->priority != current->priority)
+        {
+            if (entry->priority > current->priority)
+            {
+                victim = i;
+            }
+        }
+        else if (entry->seq > current->seq)
+        {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+bool event_queue_push(event_queue_t *queue, const achievement_t *data, uint8_t priority, uint8_t kind, bool coalesce)
+{
+    if (coalesce)
+    {
+        // only the newest pending entry of this id can be overwritten - otherwise an update
+        // would jump ahead of a hide that came after it
+        int newest = -1;
+        for (int i = 0; i < queue->count; i++)
+        {
+            if (queue->entries[i].data.id == data->id && (newest == -1 || queue->entries[i].seq > queue->entries[newest].seq))
+            {
+                newest = i;
+            }
+        }
+        if (newest != -1 && queue->entries[newest].coalesce && queue->entries[newest].kind == kind)
+        {
+            queue->entries[newest].data = *data;
+            queue->coalesced++;
+            return true;
+        }
+    }
+
+    event_queue_entry_t *entry;
+    if (queue->count == EVENT_QUEUE_SIZE)
+    {
+        int victim = event_queue_find_victim(queue, priority);
+        if (victim != -1)
+        {
+            event_queue_remove_at(queue, victim);
+            queue->dropped++;
+            entry = &queue->entries[queue->count++];
+        }
+        else if (priority == 0 && queue->spill_count < EVENT_QUEUE_SPILL_SIZE)
+        {
+            // no victim means the queue only holds priority 0 entries, and it stays that way
+            // while the spill has entries (pop refills the freed slot from it), so the spill
+            // keeps the arrival order
+            entry = &queue->spill[(queue->spill_head + queue->spill_count) % EVENT_QUEUE_SPILL_SIZE];
+            queue->spill_count++;
+            queue->spilled++;
+        }
+        else
+        {
+            queue->rejected++;
+            return false;
+        }
+    }
+    else
+    {
+        entry = &queue->entries[queue->count++];
+    }
+
+    entry->data = *data;
+    entry->seq = queue->next_seq++;
+    entry->priority = priority;
+    entry->kind = kind;
+    entry->coalesce = coalesce;
+    if (event_queue_depth(queue) > queue->high_water)
+    {
+        queue->high_water = event_queue_depth(queue);
+    }
+    return true;
+}
+
+bool event_queue_pop(event_queue_t *queue, achievement_t *data)
+{
+    if (queue->count == 0)
+    {
+        return false;
+    }
+    int best = 0;
+    for (int i = 1; i < queue->count; i++)
+    {
+        const event_queue_entry_t *entry = &queue->entries[i];
+        const event_queue_entry_t *current = &queue->entries[best];
+        if (entry->priority < current->priority || (entry->priority == current->priority && entry->seq < current->seq))
+        {
+            best = i;
+        }
+    }
+    *data = queue->entries[best].data;
+    event_queue_remove_at(queue, best);
+    if (queue->spill_count > 0)
+    {
+        queue->entries[queue->count++] = queue->spill[queue->spill_head];
+        queue->spill_head = (queue->spill_head + 1) % EVENT_QUEUE_SPILL_SIZE;
+        queue->spill_count--;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+/**
+ * Priority queue for the events sent to the ESP32 (achievements, leaderboards, indicators).
+ *
+ *  * entries are popped by priority (0 = highest), in arrival order inside the same priority
+ *  * an entry can be coalesced: it overwrites the newest pending entry of the same id when
+ *    that entry has the same kind (e.g. progress updates of one achievement), so a value
+ *    that changes every frame takes a single slot
+ *  * when the queue is full, a new entry evicts the newest entry with a lower priority
+ *    (coalescible ones first), so unlocks are never dropped to make room for indicators
+ *  * a priority 0 entry (unlock) that finds the queue full of priority 0 entries goes to a
+ *    spill FIFO and is moved back into the queue, in arrival order, as entries are popped.
+ *    Up to EVENT_QUEUE_SIZE + EVENT_QUEUE_SPILL_SIZE unlocks can be pending - past that
+ *    limit push rejects the unlock
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EVENT_QUEUE_SIZE 16
+#define EVENT_QUEUE_SPILL_SIZE 48
+
+// event payload - the same data the old achievements FIFO kept
+typedef struct
+{
+    uint32_t id;
+    uint8_t event;
+    char measured_progress[24]; // measured progress, leaderboard score or tracker display
+} achievement_t;
+
+typedef struct
+{
+    achievement_t data;
+    uint32_t seq;     // arrival order
+    uint8_t priority; // 0 = highest
+    uint8_t kind;     // entries with the same id and kind can be coalesced
+    bool coalesce;
+} event_queue_entry_t;
+
+typedef struct
+{
+    event_queue_entry_t entries[EVENT_QUEUE_SIZE];
+    uint8_t count;
+    uint32_t next_seq;
+
+    // priority 0 entries waiting for a free slot, oldest at spill_head
+    event_queue_entry_t spill[EVENT_QUEUE_SPILL_SIZE];
+    uint8_t spill_head;
+    uint8_t spill_count;
+
+    // counters
+    uint8_t high_water; // max depth seen (queue + spill)
+    uint32_t coalesced; // entries merged into a pending one
+    uint32_t spilled;   // entries that went through the spill FIFO
+    uint32_t dropped;   // entries evicted to make room for a higher priority one
+    uint32_t rejected;  // entries not queued because there was no room for them
+} event_queue_t;
+
+void event_queue_init(event_queue_t *queue);
+bool event_queue_is_empty(const event_queue_t *queue);
+uint8_t event_queue_depth(const event_queue_t *queue);
+
+// returns false if the entry was rejected - queue full of entries with the same or higher
+// priority and, for priority 0 entries, the spill FIFO full as well
+bool event_queue_push(event_queue_t *queue, const achievement_t *data, uint8_t priority, uint8_t kind, bool coalesce);
+
+// pops the oldest entry with the highest priority and refills its slot from the spill FIFO
+bool event_queue_pop(event_queue_t *queue, achievement_t *data);
+
+#endif
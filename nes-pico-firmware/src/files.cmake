@@ -1,2 +1,5 @@
 set(SRC_FILES 
-)
\ No newline at end of file
+    ${CMAKE_CURRENT_LIST_DIR}/event_queue.c
+    ${CMAKE_CURRENT_LIST_DIR}/ring_buffer.c
+    ${CMAKE_CURRENT_LIST_DIR}/link_frame.c
+)
@@ -0,0 +1,143 @@
+#include "link_frame.h"
+
+#include <string.h>
+
+enum
+{
+    LINK_FRAME_STATE_SOF,
+    LINK_FRAME_STATE_HEADER,
+    LINK_FRAME_STATE_PAYLOAD,
+    LINK_FRAME_STATE_TRAILER
+};
+
+// CRC32 (IEEE, reflected) four bits at a time - 64 bytes of table instead of 1KB
+static const uint32_t crc32_nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+uint32_t link_frame_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+    }
+    return crc;
+}
+
+uint32_t link_frame_encode(uint8_t *out, uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len)
+{
+    out[0] = LINK_FRAME_SOF;
+    out[1] = type;
+    out[2] = seq;
+    out[3] = (uint8_t)(len & 0xFF);
+    out[4] = (uint8_t)(len >> 8);
+    memcpy(out + LINK_FRAME_HEADER_SIZE, payload, len);
+    uint32_t crc = ~link_frame_crc32(0xFFFFFFFF, out + 1, LINK_FRAME_HEADER_SIZE - 1 + len);
+    uint8_t *trailer = out + LINK_FRAME_HEADER_SIZE + len;
+    trailer[0] = (uint8_t)crc;
+    trailer[1] = (uint8_t)(crc >> 8);
+    trailer[2] = (uint8_t)(crc >> 16);
+    trailer[3] = (uint8_t)(crc >> 24);
+    return LINK_FRAME_OVERHEAD + len;
+}
+
+void link_frame_decoder_init(link_frame_decoder_t *decoder)
+{
+    memset(decoder, 0, sizeof(link_frame_decoder_t));
+    decoder->state = LINK_FRAME_STATE_SOF;
+}
+
+void link_frame_decoder_set_buffer(link_frame_decoder_t *decoder, uint8_t *buffer, uint16_t buffer_size)
+{
+    decoder->buffer = buffer;
+    decoder->buffer_size = buffer_size;
+}
+
+int link_frame_decode(link_frame_decoder_t *decoder, const uint8_t *data, uint32_t len, uint32_t *consumed)
+{
+    uint32_t i = 0;
+    while (i < len)
+    {
+        switch (decoder->state)
+        {
+        case LINK_FRAME_STATE_SOF:
+            if (data[i++] == LINK_FRAME_SOF)
+            {
+                decoder->state = LINK_FRAME_STATE_HEADER;
+                decoder->pos = 0;
+            }
+            else
+            {
+                decoder->skipped_bytes++;
+            }
+            break;
+
+        case LINK_FRAME_STATE_HEADER:
+            decoder->header[decoder->pos++] = data[i++];
+            if (decoder->pos == sizeof(decoder->header))
+            {
+                decoder->len = (uint16_t)(decoder->header[2] | (decoder->header[3] << 8));
+                if (decoder->len > LINK_FRAME_MAX_PAYLOAD)
+                {
+                    decoder->state = LINK_FRAME_STATE_SOF;
+                    decoder->errors++;
+                    *consumed = i;
+                    return LINK_FRAME_BAD_HEADER;
+                }
+                decoder->crc = link_frame_crc32(0xFFFFFFFF, decoder->header, sizeof(decoder->header));
+                decoder->pos = 0;
+                decoder->state = decoder->len > 0 ? LINK_FRAME_STATE_PAYLOAD : LINK_FRAME_STATE_TRAILER;
+            }
+            break;
+
+        case LINK_FRAME_STATE_PAYLOAD:
+        {
+            // take as much of the payload as there is in data at once
+            uint32_t count = decoder->len - decoder->pos;
+            if (count > len - i)
+            {
+                count = len - i;
+            }
+            decoder->crc = link_frame_crc32(decoder->crc, data + i, count);
+            // bytes that do not fit are only checked, not stored
+            if (decoder->pos < decoder->buffer_size)
+            {
+                uint32_t room = decoder->buffer_size - decoder->pos;
+                memcpy(decoder->buffer + decoder->pos, data + i, count < room ? count : room);
+            }
+            decoder->pos += count;
+            i += count;
+            if (decoder->pos == decoder->len)
+            {
+                decoder->pos = 0;
+                decoder->state = LINK_FRAME_STATE_TRAILER;
+            }
+            break;
+        }
+
+        case LINK_FRAME_STATE_TRAILER:
+            decoder->trailer[decoder->pos++] = data[i++];
+            if (decoder->pos == LINK_FRAME_CRC_SIZE)
+            {
+                decoder->state = LINK_FRAME_STATE_SOF;
+                *consumed = i;
+                uint32_t crc = (uint32_t)decoder->trailer[0] | ((uint32_t)decoder->trailer[1] << 8) |
+                               ((uint32_t)decoder->trailer[2] << 16) | ((uint32_t)decoder->trailer[3] << 24);
+                if (crc != ~decoder->crc)
+                {
+                    decoder->errors++;
+                    return LINK_FRAME_BAD_CRC;
+                }
+                decoder->type = decoder->header[0];
+                decoder->seq = decoder->header[1];
+                decoder->frames++;
+                return decoder->len > decoder->buffer_size ? LINK_FRAME_OVERFLOW : LINK_FRAME_OK;
+            }
+            break;
+        }
+    }
+    *consumed = i;
+    return LINK_FRAME_INCOMPLETE;
+}
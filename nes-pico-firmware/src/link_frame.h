@@ -0,0 +1,73 @@
+#ifndef LINK_FRAME_H
+#define LINK_FRAME_H
+
+/**
+ * Framing of the Pico <-> ESP32 link (used after FRAMING is negotiated at sync).
+ *
+ *   SOF (0xA5) | type | seq | len (2 bytes, little endian) | payload | crc32 (4 bytes, little endian)
+ *
+ * The CRC32 covers type, seq, len and payload. A command (e.g. a RESP with the whole patch)
+ * is split in CMD_PART frames and ends with a CMD frame. The ESP32 keeps the same format in
+ * LinkFrame.h - both must be changed together.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LINK_FRAME_SOF 0xA5
+#define LINK_FRAME_HEADER_SIZE 5 // SOF, type, seq, len
+#define LINK_FRAME_CRC_SIZE 4
+#define LINK_FRAME_OVERHEAD (LINK_FRAME_HEADER_SIZE + LINK_FRAME_CRC_SIZE)
+#define LINK_FRAME_MAX_PAYLOAD 1024
+
+// frame types
+#define LINK_FRAME_CMD 0x01      // last (or only) part of a command
+#define LINK_FRAME_CMD_PART 0x02 // more parts of the command follow
+#define LINK_FRAME_ACK 0x10      // seq = last frame received in order
+#define LINK_FRAME_NAK 0x11      // seq = frame expected - resend from it
+#define LINK_FRAME_RESET 0x20    // reset the receiver, whatever the seq
+
+// link_frame_decode results
+#define LINK_FRAME_INCOMPLETE 0
+#define LINK_FRAME_OK 1
+#define LINK_FRAME_OVERFLOW 2    // valid frame, but the payload did not fit the buffer
+#define LINK_FRAME_BAD_CRC -1
+#define LINK_FRAME_BAD_HEADER -2 // length above LINK_FRAME_MAX_PAYLOAD
+
+typedef struct
+{
+    uint8_t state;
+    uint8_t header[4]; // type, seq, len
+    uint8_t trailer[LINK_FRAME_CRC_SIZE];
+    uint16_t pos;
+    uint16_t len;
+    uint32_t crc;
+
+    // where the payload of the next frame goes
+    uint8_t *buffer;
+    uint16_t buffer_size;
+
+    // last frame decoded
+    uint8_t type;
+    uint8_t seq;
+
+    // counters
+    uint32_t frames;
+    uint32_t errors;        // bad CRC or header
+    uint32_t skipped_bytes; // bytes outside a frame
+} link_frame_decoder_t;
+
+uint32_t link_frame_crc32(uint32_t crc, const uint8_t *data, uint32_t len); // start with 0xFFFFFFFF, invert at the end
+
+// writes the whole frame in out (LINK_FRAME_OVERHEAD + len bytes) and returns its size
+uint32_t link_frame_encode(uint8_t *out, uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len);
+
+void link_frame_decoder_init(link_frame_decoder_t *decoder);
+// set before each frame - the payload is written straight there, so an accepted frame needs no copy
+void link_frame_decoder_set_buffer(link_frame_decoder_t *decoder, uint8_t *buffer, uint16_t buffer_size);
+
+// consumes bytes until a frame ends (or data ends) - returns a LINK_FRAME_* result and the
+// number of bytes used in consumed. type/seq/len of the decoder describe the frame
+int link_frame_decode(link_frame_decoder_t *decoder, const uint8_t *data, uint32_t len, uint32_t *consumed);
+
+#endif
@@ -68,8 +68,14 @@
 #include "hardware/i2c.h"
 #include "hardware/adc.h"
 #include "hardware/watchdog.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/irq.h"
 
 #include "memory-bus.pio.h"
+#include "event_queue.h"
+#include "ring_buffer.h"
+#include "link_frame.h"
 
 #include "rc_runtime_types.h"
 #include "rc_client.h"
@@ -91,8 +97,18 @@
 #define BUS_SM 0
 
 #define UART_ID uart0
+#define UART_IRQ UART0_IRQ
 #define BAUD_RATE 115200
 
+// messages to the ESP32 are queued here and sent by the UART TX interrupt, so core 0 does not
+// wait ~87us per byte (a 300 bytes line would block longer than a frame)
+#define UART_TX_RING_SIZE 4096 // power of two
+// bytes from the ESP32 are moved out of the 32 bytes FIFO by the UART RX interrupt, so the
+// link keeps the wire rate while the main loop is busy in rc_client_do_frame. There is no
+// RTS/CTS wiring to the ESP32 - what keeps the ring from overflowing is the ESP32 sending
+// at most its credit window (or frame window) of unacknowledged data, which fits in the ring
+#define UART_RX_RING_SIZE 4096 // power of two
+
 #define NES_D0 0
 #define NES_D1 1
 #define NES_D2 2
@@ -140,6 +156,61 @@
 
 #define ENABLE_INTERNAL_WEB_APP_SUPPORT
 
+/**
+ * enable leaderboards - rcheevos keeps the start/cancel/submit/value conditions of each
+ * leaderboard and formats the tracker value only when it changes. Started/failed/submitted
+ * events are sent as L= messages and trackers as T= messages. The ESP32 only strips the
+ * Leaderboards array when the patch does not fit the serial buffer (comment to disable)
+ */
+
+#define ENABLE_LEADERBOARD_SUPPORT
+
+/**
+ * send the rich presence text to the ESP32 (RP= message) once per second when it changes.
+ * rcheevos keeps the parsed lookups/display conditions; the string is only built here
+ * (comment to disable)
+ */
+
+#define ENABLE_RICH_PRESENCE_REPORT
+#define RICH_PRESENCE_INTERVAL_MS 1000
+
+/**
+ * let the ESP32 raise the UART baud rate after SYNC: BAUD=<rate> is answered with
+ * BAUD_ACK=<rate> at the current rate, then the ESP32 sends BAUD_TEST=<pattern>;<crc32>
+ * at the new one. A wrong CRC or no test in LINK_BAUD_TEST_TIMEOUT_MS goes back to
+ * BAUD_RATE (comment to disable)
+ */
+
+#define ENABLE_LINK_BAUD_NEGOTIATION
+#define LINK_BAUD_MAX 3000000
+#define LINK_BAUD_TEST_TIMEOUT_MS 1000
+
+/**
+ * send one ACK byte (0x06) to the ESP32 for every LINK_FLOW_BLOCK_SIZE bytes of a RESP line
+ * taken from the RX ring. The ESP32 keeps at most 2 blocks unacknowledged, so the response
+ * is streamed as fast as the Pico consumes it, instead of with a fixed delay (comment to disable)
+ */
+
+#define ENABLE_LINK_FLOW_ACK
+#define LINK_FLOW_BLOCK_SIZE 1024 // must match the ESP32
+#define LINK_FLOW_ACK "\x06"
+
+/**
+ * switch the link to CRC32 checked frames (link_frame.h) when the ESP32 sends FRAMING=1 at
+ * sync. Each frame of a command is acknowledged once taken from the RX ring and a bad frame
+ * is answered with a NAK, so the ESP32 resends only from that frame (comment to disable)
+ */
+
+#define ENABLE_LINK_FRAMING
+
+/**
+ * keep the achievement patch in a flash scratch region and let rcheevos parse it
+ * straight from XIP flash, so the serial buffer can be freed before parsing
+ * (comment to disable)
+ */
+
+#define ENABLE_XIP_PATCH_STORAGE
+
 const uint16_t NES_D[8] = {NES_D0, NES_D1, NES_D2, NES_D3, NES_D4, NES_D5, NES_D6, NES_D7};
 const uint16_t NES_A[15] = {NES_A00, NES_A01, NES_A02, NES_A03, NES_A04, NES_A05, NES_A06, NES_A07, NES_A08, NES_A09, NES_A10, NES_A11, NES_A12, NES_A13, NES_A14};
 const uint16_t NES_F[3] = {NES_ROMSEL, NES_M2, NES_RW};
@@ -237,6 +308,23 @@ u_char *serial_buffer = NULL;
 u_char *serial_buffer_head = NULL;
 uint32_t serial_buffer_size = 0;
 
+/*
+ * Flash scratch region for the achievement patch (XIP patch storage)
+ *
+ * The last sectors of the flash hold a copy of the patch while rcheevos parses
+ * it. rcheevos only reads the response body, so it can be served from XIP and
+ * the serial buffer (and its tight copy) never has to coexist with the parsed
+ * runtime in SRAM. The region is rewritten on every game load.
+ */
+#define PATCH_FLASH_SCRATCH_SIZE (((SERIAL_BUFFER_INITIAL_SIZE + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE)
+#define PATCH_FLASH_SCRATCH_OFFSET (PICO_FLASH_SIZE_BYTES - PATCH_FLASH_SCRATCH_SIZE)
+// time given to the ESP32 to see BUSY and stop sending before the first erase - what it
+// sends before that still lands in the RX ring
+#define PATCH_FLASH_QUIET_MS 100
+
+// end of the firmware image in flash, provided by the pico-sdk linker script
+extern char __flash_binary_end;
+
 /*
  * Dynamic arrays for NES RAM and PRG-RAM/SRAM mirroring.
  * Allocated only when the game starts (right before core 1 is launched),
@@ -295,38 +383,56 @@ async_callback_data async_data;
 typedef struct
 {
     uint8_t id;
+    bool in_use;      // waiting for its RESP
+    uint32_t sent_at; // when the REQ was sent - used for the per-request timeout
     async_callback_data async_data;
 } async_callback_data_id;
 
-#define MAX_ASYNC_CALLBACKS 5
+// several requests can be in flight (e.g. a burst of awards) - each one is matched by its
+// request id when the RESP arrives, or failed with a retryable error after the timeout. The
+// ESP32 sends WAIT=<request id> every few seconds while a request is queued or running there
+// (a patch download can take minutes), so the timeout only fires when the ESP32 lost it
+#define MAX_ASYNC_CALLBACKS 8
+#define ASYNC_REQUEST_TIMEOUT_MS 30000
 async_callback_data_id async_handlers[MAX_ASYNC_CALLBACKS];
-uint8_t async_handlers_index = 0;
 
 uint8_t request_id = 0; // last request id used - used to identify the response of async requests
 
 /*
- * FIFO for achievements the user won - he can earn more than one achievement at a time,
- * but we will send them one by one to the ESP32 to be shown on the screen
+ * queue for achievements the user won - he can earn more than one achievement at a time,
+ * but we will send them one by one to the ESP32 to be shown on the screen. Unlocks go out
+ * first and indicator/tracker updates of the same id are coalesced (see event_queue.h)
  */
 
-#define FIFO_SIZE 15
-
-typedef struct
-{
-    uint32_t id;
-    u_int8_t event;
-    char measured_progress[24];
-} achievement_t;
-
-typedef struct
-{
-    achievement_t buffer[FIFO_SIZE];
-    int head;
-    int tail;
-    int count;
-} FIFO_t;
+#define EVENT_PRIORITY_UNLOCK 0
+#define EVENT_PRIORITY_LEADERBOARD 1
+#define EVENT_PRIORITY_INDICATOR 2
+
+event_queue_t achievements_queue;
+
+// UART TX ring - filled by the main loop, drained by the UART interrupt
+uint8_t uart_tx_storage[UART_TX_RING_SIZE];
+ring_buffer_t uart_tx_ring;
+
+// UART RX ring - filled by the UART interrupt, drained by the main loop
+uint8_t uart_rx_storage[UART_RX_RING_SIZE];
+ring_buffer_t uart_rx_ring;
+volatile bool uart_rx_paused = false; // RX ring full - bytes wait in the FIFO (lost if it fills)
+
+#ifdef ENABLE_LINK_FRAMING
+bool link_framing = false;
+link_frame_decoder_t link_rx_decoder;
+uint8_t link_rx_seq = 0;       // next frame expected from the ESP32
+uint8_t link_tx_seq = 0;       // next frame sent to the ESP32
+bool link_rx_discard = false;  // dropping the frames of a command that does not fit serial_buffer
+uint8_t link_rx_chunk[256];    // bytes taken from the RX ring for the decoder
+uint8_t link_tx_frame[LINK_FRAME_OVERHEAD + LINK_FRAME_MAX_PAYLOAD];
+#endif
 
-FIFO_t achievements_fifo;
+#ifdef ENABLE_LINK_BAUD_NEGOTIATION
+uint32_t link_baud_rate = BAUD_RATE;
+uint32_t link_baud_test_deadline = 0; // != 0 while the new rate is not verified
+#endif
 
 /*
  * states and general variables
@@ -341,12 +447,15 @@ int nes_reseted = 0;
 // how many requests are in flight
 uint8_t request_ongoing = 0;
 
-// timestamp of the last request to control timeout
-uint32_t last_request = 0;
-
 // timestamp of the last frame processed
 uint64_t last_frame_processed = 0;
 
+#ifdef ENABLE_RICH_PRESENCE_REPORT
+// last rich presence sent to the ESP32 and when it was evaluated
+char last_rich_presence[128];
+uint32_t last_rich_presence_check = 0;
+#endif
+
 // keeps the MD5 of the game (or RA Hash)
 char md5[33];
 
@@ -356,6 +465,160 @@ char ra_token[32];
 // keeps the user name to authenticate on RetroAchievements
 char ra_user[256];
 
+/*
+ * functions to send data to the ESP32 without blocking core 0
+ */
+
+// the RX interrupt is on while there is room in the RX ring, the TX interrupt only while
+// there is something left to send
+static void uart_update_irq_enables()
+{
+    uart_set_irq_enables(UART_ID, !uart_rx_paused, !ring_buffer_is_empty(&uart_tx_ring));
+}
+
+// move bytes from the TX ring to the UART FIFO - with interrupts disabled when called
+// outside the handler, since both sides consume the ring
+static void uart_tx_fill_fifo()
+{
+    uint8_t value;
+    while (uart_is_writable(UART_ID) && ring_buffer_get(&uart_tx_ring, &value))
+    {
+        uart_get_hw(UART_ID)->dr = value;
+    }
+    uart_update_irq_enables();
+}
+
+// move bytes from the UART FIFO to the RX ring - stops when the ring is full, leaving the
+// rest in the FIFO. Nothing pauses the ESP32, so bytes past the 32 bytes of the FIFO are lost
+static void uart_rx_drain_fifo()
+{
+    while (uart_is_readable(UART_ID))
+    {
+        if (ring_buffer_free(&uart_rx_ring) == 0)
+        {
+            uart_rx_paused = true;
+            return;
+        }
+        ring_buffer_put(&uart_rx_ring, (uint8_t)uart_get_hw(UART_ID)->dr);
+    }
+}
+
+static void __not_in_flash_func(uart_irq_handler)()
+{
+    uart_rx_drain_fifo();
+    uart_tx_fill_fifo();
+}
+
+// queue bytes to the ESP32 - returns right away unless the ring is full
+static void uart_tx_write(const uint8_t *data, uint32_t len)
+{
+    if (len <= UART_TX_RING_SIZE)
+    {
+        // a request must not be lost - if the ring is full, wait for the interrupt to make room
+        while (ring_buffer_free(&uart_tx_ring) < len)
+        {
+            tight_loop_contents();
+        }
+    }
+    if (!ring_buffer_write(&uart_tx_ring, data, len))
+    {
+        printf("UART TX message too big - dropped\n");
+        return;
+    }
+    // the TX interrupt only fires when the FIFO level drops, so start the transfer here
+    uint32_t interrupts = save_and_disable_interrupts();
+    uart_tx_fill_fifo();
+    restore_interrupts(interrupts);
+}
+
+#ifdef ENABLE_LINK_FRAMING
+void uart_tx_link_frame(uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len)
+{
+    uart_tx_write(link_tx_frame, link_frame_encode(link_tx_frame, type, seq, payload, len));
+}
+#endif
+
+// queue a message to the ESP32 - returns right away unless the ring is full
+void uart_tx_puts(const char *message)
+{
+    uint32_t len = strlen(message);
+#ifdef ENABLE_LINK_FRAMING
+    if (link_framing)
+    {
+        // the frame gives the length - the \r\n is not sent
+        if (len >= 2 && message[len - 2] == '\r' && message[len - 1] == '\n')
+        {
+            len -= 2;
+        }
+        const uint8_t *part = (const uint8_t *)message;
+        do
+        {
+            uint16_t part_len = len > LINK_FRAME_MAX_PAYLOAD ? LINK_FRAME_MAX_PAYLOAD : len;
+            len -= part_len;
+            uart_tx_link_frame(len > 0 ? LINK_FRAME_CMD_PART : LINK_FRAME_CMD, link_tx_seq++, part, part_len);
+            part += part_len;
+        } while (len > 0);
+        return;
+    }
+#endif
+    uart_tx_write((const uint8_t *)message, len);
+}
+
+void uart_tx_init()
+{
+    ring_buffer_init(&uart_tx_ring, uart_tx_storage, UART_TX_RING_SIZE);
+    ring_buffer_init(&uart_rx_ring, uart_rx_storage, UART_RX_RING_SIZE);
+    irq_set_exclusive_handler(UART_IRQ, uart_irq_handler);
+    irq_set_enabled(UART_IRQ, true);
+    uart_update_irq_enables();
+}
+
+// wait until everything queued was sent - used before changing the baud rate
+void uart_tx_drain()
+{
+    while (!ring_buffer_is_empty(&uart_tx_ring))
+    {
+        tight_loop_contents();
+    }
+    uart_tx_wait_blocking(UART_ID);
+}
+
+// bytes were taken from the RX ring - resume the RX interrupt if it was paused (it also picks
+// up what waited in the FIFO)
+static void uart_rx_resume()
+{
+    if (uart_rx_paused)
+    {
+        uint32_t interrupts = save_and_disable_interrupts();
+        uart_rx_paused = false;
+        uart_rx_drain_fifo();
+        uart_update_irq_enables();
+        restore_interrupts(interrupts);
+    }
+}
+
+// take the next bytes of the current line from the RX ring into dst - stops after '\n'
+uint32_t uart_rx_read_line(uint8_t *dst, uint32_t max_len)
+{
+    uint32_t len = ring_buffer_read_until(&uart_rx_ring, dst, max_len, '\n');
+    if (len > 0)
+    {
+        uart_rx_resume();
+    }
+    return len;
+}
+
+// take up to max_len bytes from the RX ring into dst
+uint32_t uart_rx_read(uint8_t *dst, uint32_t max_len)
+{
+    uint32_t len = ring_buffer_read(&uart_rx_ring, dst, max_len);
+    if (len > 0)
+    {
+        uart_rx_resume();
+    }
+    return len;
+}
+
 /*
  * GPIO configuration functions
  */
@@ -772,7 +1035,7 @@ void calculate_CRC32_to_idenfity_cartridge()
 
         sleep_ms(250);
     }
-    uart_puts(UART_ID, command);
+    uart_tx_puts(command);
     end_GPIO_for_CRC32();
 
     // after reading, dominate the bus with pull-ups to prevent the console
@@ -786,52 +1049,6 @@ bool prefix(const char *pre, const char *str)
     return strncmp(pre, str, strlen(pre)) == 0;
 }
 
-/*
- * functions to handle the FIFO for achievements the user won and need to be sent to the ESP32
- * to be shown on the screen
- */
-
-void fifo_init(FIFO_t *fifo)
-{
-    fifo->head = 0;
-    fifo->tail = 0;
-    fifo->count = 0;
-}
-
-bool fifo_is_empty(FIFO_t *fifo)
-{
-    return fifo->count == 0;
-}
-
-bool fifo_is_full(FIFO_t *fifo)
-{
-    return fifo->count == FIFO_SIZE;
-}
-
-bool fifo_enqueue(FIFO_t *fifo, achievement_t value)
-{
-    if (fifo_is_full(fifo))
-    {
-        return false; // FIFO cheia
-    }
-    fifo->buffer[fifo->tail] = value;
-    fifo->tail = (fifo->tail + 1) % FIFO_SIZE;
-    fifo->count++;
-    return true;
-}
-
-bool fifo_dequeue(FIFO_t *fifo, achievement_t *value)
-{
-    if (fifo_is_empty(fifo))
-    {
-        return false; // FIFO vazia
-    }
-    *value = fifo->buffer[fifo->head];
-    fifo->head = (fifo->head + 1) % FIFO_SIZE;
-    fifo->count--;
-    return true;
-}
-
 // Max MemAddr length before an achievement is silently stubbed to "0=0".
 // Merchandise Madness (FF1) has a ~51 KB MemAddr that exhausts SRAM during
 // rcheevos parse. Achievements stubbed this way never trigger on-device.
@@ -885,6 +1102,97 @@ static size_t filter_large_memaddr(char *json, size_t len)
     return len;
 }
 
+#ifdef ENABLE_XIP_PATCH_STORAGE
+/**
+ * Copy a response body (including its null terminator) to the flash scratch
+ * region and return the XIP address of the copy, or NULL if it could not be
+ * stored. Only safe while core 1 is not running: erasing/programming stalls
+ * XIP for the whole chip. Sectors are erased one at a time so interrupts are
+ * never disabled for more than a single sector erase.
+ *
+ * A sector erase (tens of ms) runs with interrupts disabled, far longer than
+ * the 32 bytes UART RX FIFO can hold, so the ESP32 is asked to stop sending
+ * (BUSY) before the first erase and to go on (READY) after the last program.
+ * Only a response the ESP32 was already streaming when it got BUSY can still
+ * lose bytes.
+ */
+static const char *store_patch_in_flash(const char *body, size_t body_len)
+{
+    size_t total = body_len + 1;
+    const char *xip_patch = (const char *)(XIP_BASE + PATCH_FLASH_SCRATCH_OFFSET);
+
+    if (total > PATCH_FLASH_SCRATCH_SIZE)
+    {
+        printf("XIP: patch too big for scratch region (%u bytes)\n", (unsigned)total);
+        return NULL;
+    }
+    if (xip_patch < &__flash_binary_end)
+    {
+        printf("XIP: scratch region overlaps the firmware image\n");
+        return NULL;
+    }
+
+    uart_tx_puts("BUSY\r\n");
+    uart_tx_drain();
+    sleep_ms(PATCH_FLASH_QUIET_MS);
+
+    uint32_t begin = to_ms_since_boot(get_absolute_time());
+    size_t erase_len = ((total + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
+    for (size_t offset = 0; offset < erase_len; offset += FLASH_SECTOR_SIZE)
+    {
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_erase(PATCH_FLASH_SCRATCH_OFFSET + offset, FLASH_SECTOR_SIZE);
+        restore_interrupts(ints);
+    }
+
+    // program whole pages straight from the buffer, then pad the last one
+    size_t full_pages_len = (total / FLASH_PAGE_SIZE) * FLASH_PAGE_SIZE;
+    for (size_t offset = 0; offset < full_pages_len; offset += FLASH_PAGE_SIZE)
+    {
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_program(PATCH_FLASH_SCRATCH_OFFSET + offset, (const uint8_t *)body + offset, FLASH_PAGE_SIZE);
+        restore_interrupts(ints);
+    }
+    if (total > full_pages_len)
+    {
+        uint8_t page[FLASH_PAGE_SIZE];
+        memset(page, 0xFF, FLASH_PAGE_SIZE);
+        memcpy(page, body + full_pages_len, total - full_pages_len);
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_program(PATCH_FLASH_SCRATCH_OFFSET + full_pages_len, page, FLASH_PAGE_SIZE);
+        restore_interrupts(ints);
+    }
+    uart_tx_puts("READY\r\n");
+
+    if (memcmp(xip_patch, body, total) != 0)
+    {
+        printf("XIP: verify failed\n");
+        return NULL;
+    }
+    printf("XIP: stored %u bytes in %lu ms\n", (unsigned)total,
+           (unsigned long)(to_ms_since_boot(get_absolute_time()) - begin));
+    return xip_patch;
+}
+#endif
+
+/**
+ * Allocate the small serial buffer used during the in-game phase.
+ */
+static bool allocate_runtime_serial_buffer()
+{
+    serial_buffer = (u_char *)malloc(SERIAL_BUFFER_RUNTIME_SIZE);
+    if (!serial_buffer)
+    {
+        serial_buffer_head = NULL;
+        serial_buffer_size = 0;
+        return false;
+    }
+    serial_buffer_size = SERIAL_BUFFER_RUNTIME_SIZE;
+    serial_buffer_head = serial_buffer;
+    memset(serial_buffer, '\0', serial_buffer_size);
+    return true;
+}
+
 /**
  * Allocate the NES RAM/SRAM mirrors and their snapshots. Called from the
  * load-game callback before do_frame so read_memory_ingame has buffers to
@@ -917,19 +1225,15 @@ static bool swap_to_runtime_serial_and_dma_buffers()
     serial_buffer_head = NULL;
     serial_buffer_size = 0;
 
-    serial_buffer = (u_char *)malloc(SERIAL_BUFFER_RUNTIME_SIZE);
+    bool serial_ok = allocate_runtime_serial_buffer();
     buffer_a = (volatile uint32_t *)calloc(BUFFER_SIZE, sizeof(uint32_t));
     buffer_b = (volatile uint32_t *)calloc(BUFFER_SIZE, sizeof(uint32_t));
 
-    if (!serial_buffer || !buffer_a || !buffer_b)
+    if (!serial_ok || !buffer_a || !buffer_b)
     {
         printf("FATAL: failed to allocate runtime buffers\r\n");
         return false;
     }
-
-    serial_buffer_size = SERIAL_BUFFER_RUNTIME_SIZE;
-    serial_buffer_head = serial_buffer;
-    memset(serial_buffer, '\0', serial_buffer_size);
     return true;
 }
 
@@ -988,7 +1292,7 @@ static void rc_client_load_game_callback(int result, const char *error_message,
             // send game info to ESP32
             sprintf(aux, "GAME_INFO=%lu;%s;%s\r\n", (unsigned long)game->id, game->title, url);
             printf(aux);
-            uart_puts(UART_ID, aux);
+            uart_tx_puts(aux);
         }
 
         // Patch is fully parsed by rcheevos at this point. Allocate the NES
@@ -998,13 +1302,16 @@ static void rc_client_load_game_callback(int result, const char *error_message,
         // current serial_buffer.
         if (!allocate_nes_mirror_buffers())
         {
-            uart_puts(UART_ID, "FATAL_OOM\r\n");
+            uart_tx_puts("FATAL_OOM\r\n");
             while (1) tight_loop_contents();
         }
 
         // Use the ingame memory reader directly since we have a full RAM mirror
         rc_client_set_read_memory_function(g_client, read_memory_ingame);
         rc_client_do_frame(g_client); // to trigger initial state evaluation
+#ifdef ENABLE_RICH_PRESENCE_REPORT
+        last_rich_presence[0] = '\0';
+#endif
 
         // send achievement summary to ESP32 (after do_frame so unlocks are processed)
         if (rc_client_is_game_loaded(g_client))
@@ -1014,7 +1321,7 @@ static void rc_client_load_game_callback(int result, const char *error_message,
             char aux[64];
             sprintf(aux, "ACH_SUMMARY=%u;%u\r\n", summary.num_unlocked_achievements, summary.num_core_achievements);
             printf(aux);
-            uart_puts(UART_ID, aux);
+            uart_tx_puts(aux);
         }
 
         // Defer serial buffer shrink + DMA buffer alloc + core 1 launch to the
@@ -1031,7 +1338,7 @@ static void rc_client_load_game_callback(int result, const char *error_message,
         // send game info to ESP32 when we coudn't load the game
         sprintf(aux, "GAME_INFO=%lu;%s;%s\r\n", (unsigned long)0, "No Title", "No URL");
         printf(aux);
-        uart_puts(UART_ID, aux);
+        uart_tx_puts(aux);
     }
 }
 
@@ -1041,7 +1348,11 @@ static void achievement_triggered(const rc_client_achievement_t *achievement)
     achievement_t achievement_data;
     achievement_data.id = achievement->id;
     achievement_data.event = RC_CLIENT_EVENT_ACHIEVEMENT_TRIGGERED;
-    fifo_enqueue(&achievements_fifo, achievement_data);
+    achievement_data.measured_progress[0] = '\0';
+    if (!event_queue_push(&achievements_queue, &achievement_data, EVENT_PRIORITY_UNLOCK, achievement_data.event, false))
+    {
+        printf("event queue and spill full of unlocks - achievement %lu not shown\n", (unsigned long)achievement_data.id);
+    }
 }
 
 // send the achievements status to the ESP32
@@ -1063,9 +1374,56 @@ static void achievement_status(const rc_client_event_t *event)
         }
     }
 
-    fifo_enqueue(&achievements_fifo, achievement_data);
+    // progress show/update only matter for the latest value, so they are coalesced
+    bool is_progress = event->type == RC_CLIENT_EVENT_ACHIEVEMENT_PROGRESS_INDICATOR_SHOW || event->type == RC_CLIENT_EVENT_ACHIEVEMENT_PROGRESS_INDICATOR_UPDATE;
+    event_queue_push(&achievements_queue, &achievement_data, EVENT_PRIORITY_INDICATOR,
+                     is_progress ? RC_CLIENT_EVENT_ACHIEVEMENT_PROGRESS_INDICATOR_UPDATE : achievement_data.event, is_progress);
 }
 
+#ifdef ENABLE_LEADERBOARD_SUPPORT
+// copy a server text into a field of a ';' separated line - it is cut to the field size, so the
+// line always ends with \r\n, and ';' or line breaks would shift the fields on the ESP32 and
+// web app side, so they are replaced
+static void copy_line_field(char *dst, size_t size, const char *src)
+{
+    size_t i = 0;
+    for (; src != NULL && src[i] != '\0' && i < size - 1; i++)
+    {
+        dst[i] = src[i] == ';' ? ',' : (src[i] == '\r' || src[i] == '\n') ? ' ' : src[i];
+    }
+    dst[i] = '\0';
+}
+
+// enqueue leaderboard started/failed/submitted events - the score is copied now because the
+// tracker value of the leaderboard is reused by rcheevos when it is started again
+static void leaderboard_status(const rc_client_event_t *event)
+{
+    achievement_t leaderboard_data;
+    leaderboard_data.id = event->leaderboard->id;
+    leaderboard_data.event = event->type;
+    leaderboard_data.measured_progress[0] = '\0';
+    if (event->leaderboard->tracker_value)
+    {
+        strncpy(leaderboard_data.measured_progress, event->leaderboard->tracker_value, sizeof(leaderboard_data.measured_progress) - 1);
+        leaderboard_data.measured_progress[sizeof(leaderboard_data.measured_progress) - 1] = '\0';
+    }
+    event_queue_push(&achievements_queue, &leaderboard_data, EVENT_PRIORITY_LEADERBOARD, leaderboard_data.event, false);
+}
+
+// enqueue tracker show/hide/update events - show/updates of the same tracker are coalesced
+static void leaderboard_tracker_status(const rc_client_event_t *event)
+{
+    achievement_t tracker_data;
+    tracker_data.id = event->leaderboard_tracker->id;
+    tracker_data.event = event->type;
+    strncpy(tracker_data.measured_progress, event->leaderboard_tracker->display, sizeof(tracker_data.measured_progress) - 1);
+    tracker_data.measured_progress[sizeof(tracker_data.measured_progress) - 1] = '\0';
+    bool is_value = event->type != RC_CLIENT_EVENT_LEADERBOARD_TRACKER_HIDE;
+    event_queue_push(&achievements_queue, &tracker_data, EVENT_PRIORITY_INDICATOR,
+                     is_value ? RC_CLIENT_EVENT_LEADERBOARD_TRACKER_UPDATE : tracker_data.event, is_value);
+}
+#endif
+
 // rcheevos event handler - used to enqueue the achievements the user won to be sent to the ESP32
 static void event_handler(const rc_client_event_t *event, rc_client_t *client)
 {
@@ -1082,6 +1440,18 @@ static void event_handler(const rc_client_event_t *event, rc_client_t *client)
     case RC_CLIENT_EVENT_ACHIEVEMENT_CHALLENGE_INDICATOR_HIDE:
         achievement_status(event);
         break;
+#endif
+#ifdef ENABLE_LEADERBOARD_SUPPORT
+    case RC_CLIENT_EVENT_LEADERBOARD_STARTED:
+    case RC_CLIENT_EVENT_LEADERBOARD_FAILED:
+    case RC_CLIENT_EVENT_LEADERBOARD_SUBMITTED:
+        leaderboard_status(event);
+        break;
+    case RC_CLIENT_EVENT_LEADERBOARD_TRACKER_SHOW:
+    case RC_CLIENT_EVENT_LEADERBOARD_TRACKER_HIDE:
+    case RC_CLIENT_EVENT_LEADERBOARD_TRACKER_UPDATE:
+        leaderboard_tracker_status(event);
+        break;
 #endif
     default:
         // printf("Unhandled event %d\n", event->type); //debug
@@ -1115,6 +1485,29 @@ static void http_callback(int status_code, const char *content, size_t content_s
     async_data->callback(&server_response, async_data->callback_data);
 }
 
+// release a request slot and report a retryable error to its rc_client callback
+static void fail_async_request(int slot, const char *error_message)
+{
+    async_callback_data async_data = async_handlers[slot].async_data;
+    async_handlers[slot].in_use = false;
+    request_ongoing -= 1;
+    http_callback(0, NULL, 0, &async_data, error_message);
+}
+
+// fail the requests that did not get a RESP in time
+static void check_async_request_timeouts()
+{
+    uint32_t current_time = to_ms_since_boot(get_absolute_time());
+    for (int i = 0; i < MAX_ASYNC_CALLBACKS; i += 1)
+    {
+        if (async_handlers[i].in_use && current_time - async_handlers[i].sent_at > ASYNC_REQUEST_TIMEOUT_MS)
+        {
+            printf("request %02X timeout\n", async_handlers[i].id);
+            fail_async_request(i, "request timeout");
+        }
+    }
+}
+
 // get the current time in milliseconds
 rc_clock_t get_pico_millisecs(const rc_client_t *client)
 {
@@ -1139,17 +1532,48 @@ static void server_call(const rc_api_request_t *request,
         strcpy(method, "GET");
     }
     sprintf(buffer, "REQ=%02hhX;M:%s;U:%s;D:%s\r\n", request_id, method, request->url, request->post_data);
-    async_handlers[async_handlers_index].id = request_id;
-    async_handlers[async_handlers_index].async_data.callback = callback;
-    async_handlers[async_handlers_index].async_data.callback_data = callback_data;
-    async_handlers_index = (async_handlers_index + 1) % MAX_ASYNC_CALLBACKS;
+
+    // take a free slot - if all of them are waiting, take the oldest one and fail its request
+    // so its callback is not lost (rc_client retries retryable errors)
+    int slot = -1;
+    for (int i = 0; i < MAX_ASYNC_CALLBACKS; i += 1)
+    {
+        if (!async_handlers[i].in_use)
+        {
+            slot = i;
+            break;
+        }
+        if (slot == -1 || (int32_t)(async_handlers[i].sent_at - async_handlers[slot].sent_at) < 0)
+        {
+            slot = i;
+        }
+    }
+    bool evicted = async_handlers[slot].in_use;
+    async_callback_data evicted_data = async_handlers[slot].async_data;
+    if (evicted)
+    {
+        printf("async handlers full - failing request %02X\n", async_handlers[slot].id);
+        request_ongoing -= 1;
+    }
+
+    // the slot and the request id are taken before the failed callback runs - it may call
+    // server_call again, which must not get the same slot or id
+    async_handlers[slot].id = request_id;
+    async_handlers[slot].in_use = true;
+    async_handlers[slot].sent_at = to_ms_since_boot(get_absolute_time());
+    async_handlers[slot].async_data.callback = callback;
+    async_handlers[slot].async_data.callback_data = callback_data;
     request_id += 1;
     printf("REQ=%s\n", request->post_data); // DEBUG
     request_ongoing += 1;
-    last_request = to_ms_since_boot(get_absolute_time());
 
     // send request to ESP32
-    uart_puts(UART_ID, buffer);
+    uart_tx_puts(buffer);
+
+    if (evicted)
+    {
+        http_callback(0, NULL, 0, &evicted_data, "too many requests in flight");
+    }
 }
 
 // rcheevos log message handler
@@ -1182,6 +1606,446 @@ void shutdown_retroachievements_client(rc_client_t *g_client)
     }
 }
 
+/*
+ * handlers of the commands sent by the ESP32 - each one gets a view of the line in
+ * serial_buffer (without the \r\n, '\0' terminated) and its length
+ */
+
+// RESP=<request id>;<http code>;<body> - response of a request sent by server_call
+static void handle_resp_command(char *command, uint32_t len)
+{
+    // handle a http response from the ESP32
+    printf("L:RESP\n");
+    if (len < 12)
+    {
+        return;
+    }
+    char *response_ptr = command + 5;
+    char aux[8];
+    strncpy(aux, response_ptr, 2);
+    aux[2] = '\0';
+    uint8_t request_id = (uint8_t)strtol(aux, NULL, 16);
+    response_ptr += 3;
+    strncpy(aux, response_ptr, 3);
+    aux[3] = '\0';
+    response_ptr += 4;
+    uint16_t http_code = (uint16_t)strtol(aux, NULL, 16);
+    for (int i = 0; i < MAX_ASYNC_CALLBACKS; i += 1)
+    {
+        if (async_handlers[i].in_use && async_handlers[i].id == request_id)
+        {
+            // release the slot before the callback - rc_client may send a new request from it
+            async_handlers[i].in_use = false;
+            request_ongoing -= 1;
+            // if (request_id == 2) // debug to print the response
+            // {
+            //     printf("RESP=%s\n", response_ptr);
+            // }
+            async_callback_data async_data = async_handlers[i].async_data;
+            size_t body_len = len - (response_ptr - command);
+
+            // Strip any MemAddr values that would OOM rcheevos parse (e.g. FF1).
+            // Must run before the shrink so the tight buffer is correctly sized.
+            // if (serial_buffer_size > SERIAL_BUFFER_RUNTIME_SIZE)
+            //     body_len = filter_large_memaddr(response_ptr, body_len);
+
+#ifdef ENABLE_XIP_PATCH_STORAGE
+            // Large response (the achievement patch) while the serial buffer is
+            // still at its initial size: move it to the flash scratch region and
+            // release the whole serial buffer, so rcheevos parses from XIP with
+            // all the SRAM available for its runtime. Falls back to the tight
+            // SRAM copy below if the flash copy fails.
+            if (body_len > 8192 && serial_buffer_size > SERIAL_BUFFER_RUNTIME_SIZE)
+            {
+                const char *xip_body = store_patch_in_flash(response_ptr, body_len);
+                if (xip_body != NULL)
+                {
+                    free(serial_buffer);
+                    serial_buffer = NULL;
+                    serial_buffer_head = NULL;
+                    serial_buffer_size = 0;
+                    response_ptr = (char *)xip_body;
+
+                    struct mallinfo mi_after = mallinfo();
+                    printf("HEAP after XIP move: used=%d free=%d\n",
+                           mi_after.uordblks, mi_after.fordblks);
+                }
+            }
+#endif
+
+            // Large response (likely the achievement patch — FF1 hits ~60KB)
+            // while the serial buffer is still at the initial 100KB+. Free the
+            // oversized buffer and malloc a tight one BEFORE invoking rcheevos.
+            // realloc(shrink) in newlib-nano does NOT return the unused tail to
+            // the heap, so we must malloc+memcpy+free to guarantee reclamation.
+            if (body_len > 8192 && serial_buffer_size > SERIAL_BUFFER_RUNTIME_SIZE)
+            {
+                struct mallinfo mi_before = mallinfo();
+                printf("HEAP before shrink: used=%d free=%d\n",
+                       mi_before.uordblks, mi_before.fordblks);
+
+                u_char *tight = (u_char *)malloc(body_len + 1);
+                if (tight != NULL)
+                {
+                    memcpy(tight, response_ptr, body_len + 1);
+                    free(serial_buffer); // guarantees 100KB returned to heap
+                    serial_buffer = tight;
+                    serial_buffer_size = body_len + 1;
+                    response_ptr = (char *)serial_buffer;
+                    serial_buffer_head = serial_buffer;
+
+                    struct mallinfo mi_after = mallinfo();
+                    printf("HEAP after shrink:  used=%d free=%d\n",
+                           mi_after.uordblks, mi_after.fordblks);
+                }
+                else
+                {
+                    printf("HEAP shrink malloc failed, body_len=%u\n",
+                           (unsigned)body_len);
+                }
+            }
+
+            struct mallinfo mi_pre = mallinfo();
+            printf("HEAP before http_callback: used=%d free=%d\n",
+                   mi_pre.uordblks, mi_pre.fordblks);
+            http_callback(http_code, response_ptr, body_len, &async_data, NULL);
+            struct mallinfo mi_post = mallinfo();
+            printf("HEAP after  http_callback: used=%d free=%d\n",
+                   mi_post.uordblks, mi_post.fordblks);
+            break;
+        }
+    }
+}
+
+// WAIT=<request id> - the request is still queued or running in the ESP32, re-arm its timeout
+static void handle_wait_command(char *command, uint32_t len)
+{
+    if (len < 7)
+    {
+        return;
+    }
+    char aux[3] = {command[5], command[6], '\0'};
+    uint8_t request_id = (uint8_t)strtol(aux, NULL, 16);
+    for (int i = 0; i < MAX_ASYNC_CALLBACKS; i += 1)
+    {
+        if (async_handlers[i].in_use && async_handlers[i].id == request_id)
+        {
+            async_handlers[i].sent_at = to_ms_since_boot(get_absolute_time());
+            break;
+        }
+    }
+}
+
+// TOKEN_AND_USER=<token>,<user>
+static void handle_token_and_user_command(char *command, uint32_t len)
+{
+    // handle the token and user sent by the ESP32
+    printf("L:TOKEN_AND_USER\n");
+    if (len < 15)
+    {
+        return;
+    }
+    char *token_ptr = command + 15;
+    uint32_t token_len = len - 15;
+    uint32_t comma_index = 0;
+    for (uint32_t i = 0; i < token_len; i += 1)
+    {
+        if (token_ptr[i] == ',')
+        {
+            comma_index = i;
+            break;
+        }
+    }
+    uint32_t user_len = token_len - comma_index - 1;
+    memset(ra_token, '\0', 32);
+    memset(ra_user, '\0', 256);
+    strncpy(ra_token, token_ptr, comma_index < 31 ? comma_index : 31);
+    strncpy(ra_user, token_ptr + comma_index + 1, user_len < 255 ? user_len : 255);
+    printf("USER=%s\r\n", ra_user);
+    printf("TOKEN=%s\r\n", ra_token);
+}
+
+// CRC_FOUND_MD5=<md5>
+static void handle_crc_found_md5_command(char *command, uint32_t len)
+{
+    // handle the MD5 found by the ESP32 using the CRC we sent
+    // we will use it to identify the game in rcheevos
+    printf("L:CRC_FOUND_MD5\n");
+    if (len < 14 + 32)
+    {
+        return;
+    }
+    char *md5_ptr = command + 14;
+    memcpy(md5, md5_ptr, 32);
+    md5[32] = '\0';
+    printf("MD5=%s\r\n", md5);
+}
+
+static void handle_reset_command(char *command, uint32_t len)
+{
+    // handle a reset command from ESP32 - reinit all states and clear memory
+    printf("L:RESET\r\n");
+    // force pico reset - need to wait a while in the esp32
+    watchdog_reboot(0, 0, 0); // TODO: maybe let esp32 know PICO restarted
+}
+
+// SYNC - handshake with ESP32
+static void handle_sync_command(char *command, uint32_t len)
+{
+    printf("L:SYNC\r\n");
+    uart_tx_puts("SYNC_ACK\r\n");
+}
+
+static void handle_read_crc_command(char *command, uint32_t len)
+{
+    printf("L:READ_CRC\n");
+    state = 1;
+    printf("STATE=%d\r\n", state);
+}
+
+static void handle_start_watch_command(char *command, uint32_t len)
+{
+    // start watch the bus for memory writes
+    printf("L:START_WATCH\n");
+
+    // init rcheevos
+    g_client = initialize_retroachievements_client(g_client, read_memory_ingame, server_call);
+    rc_client_get_user_agent_clause(g_client, rcheevos_userdata, sizeof(rcheevos_userdata)); // TODO: send to esp32 before doing requests
+    printf("USER_AGENT=%s\r\n", rcheevos_userdata);
+    rc_client_set_event_handler(g_client, event_handler);
+    rc_client_set_get_time_millisecs_function(g_client, get_pico_millisecs);
+    rc_client_begin_login_with_token(g_client, ra_user, ra_token, rc_client_login_callback, g_callback_userdata);
+    state = 5;
+}
+
+#ifdef ENABLE_LINK_BAUD_NEGOTIATION
+static void set_link_baud_rate(uint32_t rate)
+{
+    uint32_t actual = uart_set_baudrate(UART_ID, rate);
+    link_baud_rate = rate;
+    printf("LINK: baud rate %lu (actual %lu)\n", (unsigned long)rate, (unsigned long)actual);
+}
+
+// BAUD=<rate> - the ESP32 switches right after BAUD_ACK arrives
+static void handle_baud_command(char *command, uint32_t len)
+{
+    printf("L:BAUD\n");
+    uint32_t rate = (uint32_t)strtoul(command + 5, NULL, 10);
+    if (rate < BAUD_RATE || rate > LINK_BAUD_MAX)
+    {
+        uart_tx_puts("BAUD_NAK\r\n");
+        return;
+    }
+    char aux[32];
+    sprintf(aux, "BAUD_ACK=%lu\r\n", (unsigned long)rate);
+    uart_tx_puts(aux);
+    uart_tx_drain();
+    set_link_baud_rate(rate);
+    link_baud_test_deadline = to_ms_since_boot(get_absolute_time()) + LINK_BAUD_TEST_TIMEOUT_MS;
+}
+
+// BAUD_TEST=<pattern>;<crc32 in hex> - first line at the new rate
+static void handle_baud_test_command(char *command, uint32_t len)
+{
+    printf("L:BAUD_TEST\n");
+    char *separator = strrchr(command, ';');
+    bool ok = false;
+    if (link_baud_test_deadline != 0 && separator != NULL)
+    {
+        uint32_t crc = 0xFFFFFFFF;
+        for (char *c = command + 10; c < separator; c += 1)
+        {
+            crc = update_crc32((uint8_t)*c, crc);
+        }
+        crc = ~crc;
+        ok = crc == (uint32_t)strtoul(separator + 1, NULL, 16);
+    }
+    link_baud_test_deadline = 0;
+    if (ok)
+    {
+        char aux[32];
+        sprintf(aux, "BAUD_OK=%lu\r\n", (unsigned long)link_baud_rate);
+        uart_tx_puts(aux);
+        return;
+    }
+    uart_tx_puts("BAUD_FAIL\r\n");
+    uart_tx_drain();
+    set_link_baud_rate(BAUD_RATE);
+}
+
+// no valid BAUD_TEST at the new rate - the ESP32 goes back to BAUD_RATE as well
+static void check_link_baud_test_timeout()
+{
+    if (link_baud_test_deadline != 0 && (int32_t)(to_ms_since_boot(get_absolute_time()) - link_baud_test_deadline) > 0)
+    {
+        link_baud_test_deadline = 0;
+        printf("LINK: no BAUD_TEST - back to the default rate\n");
+        set_link_baud_rate(BAUD_RATE);
+    }
+}
+#endif
+
+#ifdef ENABLE_LINK_FRAMING
+// FRAMING=1 - the answer is the last text line, everything after it is framed
+static void handle_framing_command(char *command, uint32_t len)
+{
+    printf("L:FRAMING\n");
+    uart_tx_puts("FRAMING_ACK\r\n");
+    link_framing = true;
+    link_rx_seq = 0;
+    link_tx_seq = 0;
+    link_rx_discard = false;
+    link_frame_decoder_init(&link_rx_decoder);
+}
+#endif
+
+typedef void (*command_handler_t)(char *command, uint32_t len);
+
+typedef struct
+{
+    const char *name; // prefix of the command
+    command_handler_t handler;
+} command_entry_t;
+
+// commands sent by the ESP32 - the same table is used for lines and frames
+static const command_entry_t command_table[] = {
+    {"RESP=", handle_resp_command},
+    {"WAIT=", handle_wait_command},
+    {"TOKEN_AND_USER", handle_token_and_user_command},
+    {"CRC_FOUND_MD5", handle_crc_found_md5_command},
+    {"RESET", handle_reset_command},
+    {"SYNC", handle_sync_command},
+    {"READ_CRC", handle_read_crc_command},
+    {"START_WATCH", handle_start_watch_command},
+#ifdef ENABLE_LINK_BAUD_NEGOTIATION
+    {"BAUD_TEST=", handle_baud_test_command},
+    {"BAUD=", handle_baud_command},
+#endif
+#ifdef ENABLE_LINK_FRAMING
+    {"FRAMING=", handle_framing_command},
+#endif
+};
+
+// handle a complete command received from the ESP32
+static void dispatch_command(char *command, uint32_t len)
+{
+    // printf("CMD=%s\r\n", command);
+    for (uint32_t i = 0; i < sizeof(command_table) / sizeof(command_table[0]); i += 1)
+    {
+        if (prefix(command_table[i].name, command))
+        {
+            command_table[i].handler(command, len);
+            return;
+        }
+    }
+}
+
+// after a command was handled - the load-game callback (triggered via http_callback)
+// sets pending_runtime_swap to request the serial buffer shrink + DMA alloc + core 1
+// launch. We do it here, after the command has been fully consumed.
+static void finish_command()
+{
+    if (pending_runtime_swap)
+    {
+        pending_runtime_swap = false;
+        if (!swap_to_runtime_serial_and_dma_buffers())
+        {
+            uart_tx_puts("FATAL_OOM\r\n");
+            while (1) tight_loop_contents();
+        }
+        multicore_launch_core1(handle_bus_to_detect_memory_writes);
+    }
+    else if (serial_buffer == NULL)
+    {
+        // the patch was moved to flash but the game did not load -
+        // we still need a buffer to keep talking to the ESP32
+        if (!allocate_runtime_serial_buffer())
+        {
+            uart_tx_puts("FATAL_OOM\r\n");
+            while (1) tight_loop_contents();
+        }
+    }
+}
+
+#ifdef ENABLE_LINK_FRAMING
+// decode the frames received from the ESP32. The payload of each frame is written by the
+// decoder right after the part of the command already received, so a command is put
+// together in serial_buffer without copies
+static void handle_link_frames()
+{
+    uint32_t len = uart_rx_read(link_rx_chunk, sizeof(link_rx_chunk));
+    uint32_t offset = 0;
+    while (offset < len)
+    {
+        uint32_t room = serial_buffer_size - (serial_buffer_head - serial_buffer) - 1; // one byte for the '\0'
+        link_frame_decoder_set_buffer(&link_rx_decoder, serial_buffer_head, room < LINK_FRAME_MAX_PAYLOAD ? room : LINK_FRAME_MAX_PAYLOAD);
+        uint32_t consumed;
+        int result = link_frame_decode(&link_rx_decoder, link_rx_chunk + offset, len - offset, &consumed);
+        offset += consumed;
+        if (result == LINK_FRAME_INCOMPLETE)
+        {
+            break;
+        }
+        if (result < 0)
+        {
+            // corrupted frame - ask for everything from the frame we are waiting for
+            printf("LINK: bad frame, NAK %u\n", link_rx_seq);
+            uart_tx_link_frame(LINK_FRAME_NAK, link_rx_seq, NULL, 0);
+            continue;
+        }
+        uint8_t type = link_rx_decoder.type;
+        if (type == LINK_FRAME_RESET)
+        {
+            handle_reset_command(NULL, 0);
+        }
+        if (type != LINK_FRAME_CMD && type != LINK_FRAME_CMD_PART)
+        {
+            continue;
+        }
+        if (link_rx_decoder.seq != link_rx_seq)
+        {
+            if ((uint8_t)(link_rx_seq - link_rx_decoder.seq) < 128)
+            {
+                // already taken (the ACK was lost) - acknowledge it again
+                uart_tx_link_frame(LINK_FRAME_ACK, link_rx_seq - 1, NULL, 0);
+            }
+            else
+            {
+                // a frame before it was lost
+                uart_tx_link_frame(LINK_FRAME_NAK, link_rx_seq, NULL, 0);
+            }
+            continue;
+        }
+        uart_tx_link_frame(LINK_FRAME_ACK, link_rx_seq, NULL, 0);
+        link_rx_seq++;
+
+        if (result == LINK_FRAME_OVERFLOW || link_rx_discard)
+        {
+            // the command does not fit serial_buffer - drop it up to its last frame
+            if (!link_rx_discard)
+            {
+                printf("BUFFER_OVERFLOW\r\n");
+            }
+            serial_buffer_head = serial_buffer;
+            link_rx_discard = type == LINK_FRAME_CMD_PART;
+            continue;
+        }
+        serial_buffer_head += link_rx_decoder.len;
+        if (type == LINK_FRAME_CMD)
+        {
+            uint32_t command_len = serial_buffer_head - serial_buffer;
+            serial_buffer[command_len] = '\0';
+            serial_buffer_head = serial_buffer;
+            if (command_len > 0)
+            {
+                dispatch_command((char *)serial_buffer, command_len);
+            }
+            finish_command();
+        }
+    }
+}
+#endif
+
 void save_energy()
 {
     set_sys_clock_khz(48000, true);
@@ -1219,6 +2083,8 @@ int main()
     serial_buffer_head = serial_buffer;
     memset(serial_buffer, '\0', serial_buffer_size);
 
+    event_queue_init(&achievements_queue);
+
     uart_init(UART_ID, BAUD_RATE);
 
     // config GPIO pins for UART
@@ -1229,12 +2095,13 @@ int main()
     uart_set_hw_flow(UART_ID, true, true);
     uart_set_format(UART_ID, 8, 1, UART_PARITY_NONE);
     uart_set_fifo_enabled(UART_ID, true);
+    uart_tx_init();
 
     const char nes_pico_firmaware_version[] = "PICO_FIRMWARE_VERSION=%s\r\n";
     printf(nes_pico_firmaware_version, FIRMWARE_VERSION);
 
     // Notify ESP32 that Pico is ready for communication
-    uart_puts(UART_ID, "PICO_READY\r\n");
+    uart_tx_puts("PICO_READY\r\n");
 
     // debug info
     unsigned int frame_counter = 0;
@@ -1243,24 +2110,19 @@ int main()
     // main loop for core 0 - handle UART communication and rcheevos processing
     while (true)
     {
-        // handle on going requests and timeout - wait 30 seconds for a response before send a new achievement request
-        // necessary to send multiples achievements got in a row
+        // handle the timeout of each request in flight
         if (request_ongoing > 0)
         {
-            uint32_t current_time = to_ms_since_boot(get_absolute_time());
-            if (current_time - last_request > 30000)
-            {
-                printf("request timeout\n");
-                request_ongoing = 0;
-            }
+            check_async_request_timeouts();
         }
 
-        // if there is no request on the fly and there is an achievement to be sent, go for it
-        if (request_ongoing == 0 && fifo_is_empty(&achievements_fifo) == false)
+        // if there is an achievement to be sent, go for it - requests in flight do not block it,
+        // the ESP32 handles the lines in order, so an award REQ sent before it is not delayed
+        if (event_queue_is_empty(&achievements_queue) == false)
         {
             achievement_t achievement_data;
             uint32_t achievement_id;
-            fifo_dequeue(&achievements_fifo, &achievement_data);
+            event_queue_pop(&achievements_queue, &achievement_data);
             achievement_id = achievement_data.id;
             if (achievement_data.event == RC_CLIENT_EVENT_ACHIEVEMENT_TRIGGERED)
             {
@@ -1272,7 +2134,7 @@ int main()
                 char aux[512];
                 memset(aux, 0, 512);
                 sprintf(aux, "A=%lu;%s;%s\r\n", (unsigned long)achievement_id, title, url);
-                uart_puts(UART_ID, aux);
+                uart_tx_puts(aux);
                 printf(aux);
             }
             else if (achievement_data.event == RC_CLIENT_EVENT_ACHIEVEMENT_PROGRESS_INDICATOR_SHOW || achievement_data.event == RC_CLIENT_EVENT_ACHIEVEMENT_CHALLENGE_INDICATOR_SHOW || achievement_data.event == RC_CLIENT_EVENT_ACHIEVEMENT_PROGRESS_INDICATOR_UPDATE)
@@ -1293,22 +2155,68 @@ int main()
                 rc_client_achievement_get_image_url(achievement, achievement_data.event, url, sizeof(url));
                 sprintf(aux, "%sS;%u;%s;%s;%s\r\n", command, (unsigned int)achievement->id, achievement->title, url, achievement->measured_progress);
                 printf(aux);
-                uart_puts(UART_ID, aux);
+                uart_tx_puts(aux);
             }
             else if (achievement_data.event == RC_CLIENT_EVENT_ACHIEVEMENT_PROGRESS_INDICATOR_HIDE)
             {
                 char aux[128];
                 sprintf(aux, "P=H;%u\r\n", achievement_id);
                 printf(aux);
-                uart_puts(UART_ID, aux);
+                uart_tx_puts(aux);
             }
             else if (achievement_data.event == RC_CLIENT_EVENT_ACHIEVEMENT_CHALLENGE_INDICATOR_HIDE)
             {
                 char aux[128];
                 sprintf(aux, "C=H;%u\r\n", achievement_id);
                 printf(aux);
-                uart_puts(UART_ID, aux);
+                uart_tx_puts(aux);
+            }
+#ifdef ENABLE_LEADERBOARD_SUPPORT
+            else if (achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_STARTED || achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_FAILED || achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_SUBMITTED)
+            {
+                // L=S;id;title;description / L=F;id;title / L=D;id;title;score
+                const rc_client_leaderboard_t *leaderboard = rc_client_get_leaderboard_info(g_client, achievement_id);
+                if (leaderboard)
+                {
+                    // the fields are cut so the longest line still fits in aux with its \r\n
+                    char title[96];
+                    char text[128]; // description or score
+                    char aux[256];
+                    copy_line_field(title, sizeof(title), leaderboard->title);
+                    if (achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_STARTED)
+                    {
+                        copy_line_field(text, sizeof(text), leaderboard->description);
+                        snprintf(aux, sizeof(aux), "L=S;%lu;%s;%s\r\n", (unsigned long)achievement_id, title, text);
+                    }
+                    else if (achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_FAILED)
+                    {
+                        snprintf(aux, sizeof(aux), "L=F;%lu;%s\r\n", (unsigned long)achievement_id, title);
+                    }
+                    else
+                    {
+                        copy_line_field(text, sizeof(text), achievement_data.measured_progress);
+                        snprintf(aux, sizeof(aux), "L=D;%lu;%s;%s\r\n", (unsigned long)achievement_id, title, text);
+                    }
+                    printf("%s", aux);
+                    uart_tx_puts(aux);
+                }
             }
+            else if (achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_TRACKER_SHOW || achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_TRACKER_UPDATE)
+            {
+                // T=S;tracker id;display / T=U;tracker id;display
+                char aux[64];
+                sprintf(aux, "T=%c;%lu;%s\r\n", achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_TRACKER_SHOW ? 'S' : 'U', (unsigned long)achievement_id, achievement_data.measured_progress);
+                printf("%s", aux);
+                uart_tx_puts(aux);
+            }
+            else if (achievement_data.event == RC_CLIENT_EVENT_LEADERBOARD_TRACKER_HIDE)
+            {
+                char aux[32];
+                sprintf(aux, "T=H;%lu\r\n", (unsigned long)achievement_id);
+                printf("%s", aux);
+                uart_tx_puts(aux);
+            }
+#endif
         }
 
         if (state == 1)
@@ -1332,7 +2240,7 @@ int main()
             if (nes_reseted == 0 && flag_internal_ram_written)
             {
                 nes_reseted = 1;
-                uart_puts(UART_ID, "NES_RESETED\r\n");
+                uart_tx_puts("NES_RESETED\r\n");
             }
 
             // if OAMDMA was written, we can assume a frame is being processed
@@ -1354,10 +2262,37 @@ int main()
                     frame_counter += 1;
                     if (frame_counter % 1800 == 0) //~ 30 seconds in 60hz
                     {
-                        printf("F: %d\n", frame_counter);
+                        printf("F: %d - EQ depth=%u hw=%u coalesced=%lu spilled=%lu dropped=%lu rejected=%lu - TX hw=%lu dropped=%lu - RX hw=%lu\n", frame_counter,
+                               event_queue_depth(&achievements_queue), achievements_queue.high_water,
+                               (unsigned long)achievements_queue.coalesced, (unsigned long)achievements_queue.spilled,
+                               (unsigned long)achievements_queue.dropped, (unsigned long)achievements_queue.rejected,
+                               (unsigned long)uart_tx_ring.high_water, (unsigned long)uart_tx_ring.dropped,
+                               (unsigned long)uart_rx_ring.high_water);
+                    }
+                }
+            }
+
+#ifdef ENABLE_RICH_PRESENCE_REPORT
+            // build the rich presence text at a low cadence and send it only when it changes
+            uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+            if (now_ms - last_rich_presence_check >= RICH_PRESENCE_INTERVAL_MS)
+            {
+                last_rich_presence_check = now_ms;
+                if (rc_client_has_rich_presence(g_client))
+                {
+                    char rich_presence[sizeof(last_rich_presence)];
+                    rc_client_get_rich_presence_message(g_client, rich_presence, sizeof(rich_presence));
+                    if (strcmp(rich_presence, last_rich_presence) != 0)
+                    {
+                        char aux[sizeof(rich_presence) + 8];
+                        strcpy(last_rich_presence, rich_presence);
+                        sprintf(aux, "RP=%s\r\n", rich_presence);
+                        printf("%s", aux);
+                        uart_tx_puts(aux);
                     }
                 }
             }
+#endif
 
             // simulate a frame every 16750ms (for 60hz) if we cannot detect any frame using the OAMDMA address monitoring
             // example of need: punchout / chip n dale rescue rangers
@@ -1387,210 +2322,54 @@ int main()
             }
 
         }
-        // handle UART communication, byte by byte
-        if (uart_is_readable(UART_ID))
+#ifdef ENABLE_LINK_BAUD_NEGOTIATION
+        check_link_baud_test_timeout();
+#endif
+#ifdef ENABLE_LINK_FRAMING
+        if (link_framing && !ring_buffer_is_empty(&uart_rx_ring))
         {
-
-            char received_char = uart_getc(UART_ID);
-            serial_buffer_head[0] = received_char;
-            serial_buffer_head += 1;
-            // if a command is too big, we clear the buffer
-            if ((uint32_t)(serial_buffer_head - serial_buffer) == serial_buffer_size)
-            {
-                memset(serial_buffer, 0, serial_buffer_size);
-                serial_buffer_head = serial_buffer;
-                printf("BUFFER_OVERFLOW\r\n");
-                continue;
-            }
-            char *pos = NULL;
-            char *current_char = serial_buffer_head - 1;
-            // try detect \r\n
-            if (current_char[0] == '\n')
+            handle_link_frames();
+            continue;
+        }
+#endif
+        // handle UART communication - take what the RX interrupt received, up to the end of the line
+        if (!ring_buffer_is_empty(&uart_rx_ring))
+        {
+            uint32_t used = serial_buffer_head - serial_buffer;
+            // keep one byte for the '\0'
+            uint32_t len = uart_rx_read_line(serial_buffer_head, serial_buffer_size - used - 1);
+            serial_buffer_head += len;
+            used += len;
+#ifdef ENABLE_LINK_FLOW_ACK
+            // the bytes left the ring - give the ESP32 credit for each block completed
+            if (used >= 5 && memcmp(serial_buffer, "RESP=", 5) == 0)
             {
-                char *previous_char = current_char - 1;
-                if (previous_char[0] == '\r')
+                for (uint32_t block = (used - len) / LINK_FLOW_BLOCK_SIZE; block < used / LINK_FLOW_BLOCK_SIZE; block++)
                 {
-                    pos = previous_char;
+                    uart_tx_puts(LINK_FLOW_ACK);
                 }
             }
-
-            // if we detect \r\n, we may have a command
-            if (pos != NULL)
+#endif
+            // a command ends with \r\n
+            if (used < 2 || serial_buffer_head[-1] != '\n' || serial_buffer_head[-2] != '\r')
             {
-                // if the command is empty, we clear the buffer and continue
-                if (((unsigned char *)pos) - serial_buffer == 0)
+                // if a command is too big, we drop it
+                if (used == serial_buffer_size - 1)
                 {
-                    memset(serial_buffer, 0, 2); // Clear the buffer since we are reading char by char
                     serial_buffer_head = serial_buffer;
-                    continue;
-                }
-
-                int len = serial_buffer_head - serial_buffer;
-                serial_buffer_head[0] = '\0';
-                char *command;
-                command = serial_buffer;
-
-                // printf("CMD=%s\r\n", command);
-
-                // handle possible commands
-                if (prefix("RESP=", command))
-                {
-                    // handle a http response from the ESP32
-                    printf("L:RESP\n");
-                    request_ongoing -= 1;
-                    char *response_ptr = command + 5;
-                    char aux[8];
-                    strncpy(aux, response_ptr, 2);
-                    aux[2] = '\0';
-                    uint8_t request_id = (uint8_t)strtol(aux, NULL, 16);
-                    response_ptr += 3;
-                    strncpy(aux, response_ptr, 3);
-                    aux[3] = '\0';
-                    response_ptr += 4;
-                    uint16_t http_code = (uint16_t)strtol(aux, NULL, 16);
-                    for (int i = 0; i < MAX_ASYNC_CALLBACKS; i += 1)
-                    {
-                        if (async_handlers[i].id == request_id)
-                        {
-                            // if (request_id == 2) // debug to print the response
-                            // {
-                            //     printf("RESP=%s\n", response_ptr);
-                            // }
-                            async_callback_data async_data = async_handlers[i].async_data;
-                            size_t body_len = strlen(response_ptr);
-
-                            // Strip any MemAddr values that would OOM rcheevos parse (e.g. FF1).
-                            // Must run before the shrink so the tight buffer is correctly sized.
-                            // if (serial_buffer_size > SERIAL_BUFFER_RUNTIME_SIZE)
-                            //     body_len = filter_large_memaddr(response_ptr, body_len);
-
-                            // Large response (likely the achievement patch — FF1 hits ~60KB)
-                            // while the serial buffer is still at the initial 100KB+. Free the
-                            // oversized buffer and malloc a tight one BEFORE invoking rcheevos.
-                            // realloc(shrink) in newlib-nano does NOT return the unused tail to
-                            // the heap, so we must malloc+memcpy+free to guarantee reclamation.
-                            if (body_len > 8192 && serial_buffer_size > SERIAL_BUFFER_RUNTIME_SIZE)
-                            {
-                                struct mallinfo mi_before = mallinfo();
-                                printf("HEAP before shrink: used=%d free=%d\n",
-                                       mi_before.uordblks, mi_before.fordblks);
-
-                                u_char *tight = (u_char *)malloc(body_len + 1);
-                                if (tight != NULL)
-                                {
-                                    memcpy(tight, response_ptr, body_len + 1);
-                                    free(serial_buffer); // guarantees 100KB returned to heap
-                                    serial_buffer = tight;
-                                    serial_buffer_size = body_len + 1;
-                                    response_ptr = (char *)serial_buffer;
-                                    serial_buffer_head = serial_buffer;
-                                    len = 0; // skip the post-command memset below
-
-                                    struct mallinfo mi_after = mallinfo();
-                                    printf("HEAP after shrink:  used=%d free=%d\n",
-                                           mi_after.uordblks, mi_after.fordblks);
-                                }
-                                else
-                                {
-                                    printf("HEAP shrink malloc failed, body_len=%u\n",
-                                           (unsigned)body_len);
-                                }
-                            }
-
-                            struct mallinfo mi_pre = mallinfo();
-                            printf("HEAP before http_callback: used=%d free=%d\n",
-                                   mi_pre.uordblks, mi_pre.fordblks);
-                            http_callback(http_code, response_ptr, body_len, &async_data, NULL);
-                            struct mallinfo mi_post = mallinfo();
-                            printf("HEAP after  http_callback: used=%d free=%d\n",
-                                   mi_post.uordblks, mi_post.fordblks);
-                            break;
-                        }
-                    }
-                }
-                else if (prefix("TOKEN_AND_USER", command))
-                {
-                    // handle the token and user sent by the ESP32
-                    // example TOKEN_AND_USER=odelot,token
-                    printf("L:TOKEN_AND_USER\n");
-                    char *token_ptr = command + 15;
-                    int comma_index = 0;
-                    len = strlen(token_ptr);
-                    for (int i = 0; i < len; i += 1)
-                    {
-                        if (token_ptr[i] == ',')
-                        {
-                            comma_index = i;
-                            break;
-                        }
-                    }
-                    memset(ra_token, '\0', 32);
-                    memset(ra_user, '\0', 256);
-                    strncpy(ra_token, token_ptr, comma_index);
-                    strncpy(ra_user, token_ptr + comma_index + 1, len - comma_index - 1 - 2);
-                    printf("USER=%s\r\n", ra_user);
-                    printf("TOKEN=%s\r\n", ra_token);
-                }
-                else if (prefix("CRC_FOUND_MD5", command))
-                {
-                    // handle the MD5 found by the ESP32 using the CRC we sent
-                    // we will use it to identify the game in rcheevos
-                    printf("L:CRC_FOUND_MD5\n");
-                    char *md5_ptr = command + 14;
-                    strncpy(md5, md5_ptr, 32);
-                    md5[32] = '\0';
-                    printf("MD5=%s\r\n", md5);
-                }
-                else if (prefix("RESET", command)) // RESET
-                {
-                    // handle a reset command from ESP32 - reinit all states and clear memory
-                    printf("L:RESET\r\n");
-                    // force pico reset - need to wait a while in the esp32
-                    watchdog_reboot(0, 0, 0); // TODO: maybe let esp32 know PICO restarted
-                }
-                else if (prefix("SYNC", command)) // SYNC - handshake with ESP32
-                {
-                    printf("L:SYNC\r\n");
-                    uart_puts(UART_ID, "SYNC_ACK\r\n");
-                }
-                else if (prefix("READ_CRC", command))
-                {
-                    printf("L:READ_CRC\n");
-                    state = 1;
-                    printf("STATE=%d\r\n", state);
-                }
-                else if (prefix("START_WATCH", command))
-                {
-                    // start watch the bus for memory writes
-                    printf("L:START_WATCH\n");
-
-                    // init rcheevos
-                    g_client = initialize_retroachievements_client(g_client, read_memory_ingame, server_call);
-                    rc_client_get_user_agent_clause(g_client, rcheevos_userdata, sizeof(rcheevos_userdata)); // TODO: send to esp32 before doing requests
-                    printf("USER_AGENT=%s\r\n", rcheevos_userdata);
-                    rc_client_set_event_handler(g_client, event_handler);
-                    rc_client_set_get_time_millisecs_function(g_client, get_pico_millisecs);
-                    rc_client_begin_login_with_token(g_client, ra_user, ra_token, rc_client_login_callback, g_callback_userdata);
-                    state = 5;
-                }
-                memset(serial_buffer, 0, len); // Clear the buffer since we are reading char by char
-                serial_buffer_head = serial_buffer;
-
-                // The load-game callback (triggered above via http_callback) sets
-                // this flag to request the serial buffer shrink + DMA alloc + core 1
-                // launch. We do it here, after the current command has been fully
-                // consumed and the cleanup above used the old (large) buffer safely.
-                if (pending_runtime_swap)
-                {
-                    pending_runtime_swap = false;
-                    if (!swap_to_runtime_serial_and_dma_buffers())
-                    {
-                        uart_puts(UART_ID, "FATAL_OOM\r\n");
-                        while (1) tight_loop_contents();
-                    }
-                    multicore_launch_core1(handle_bus_to_detect_memory_writes);
+                    printf("BUFFER_OVERFLOW\r\n");
                 }
+                continue;
+            }
+            // the command is handled in place - no copy and no clearing of the buffer
+            uint32_t command_len = used - 2;
+            serial_buffer[command_len] = '\0';
+            serial_buffer_head = serial_buffer;
+            if (command_len > 0)
+            {
+                dispatch_command((char *)serial_buffer, command_len);
             }
+            finish_command();
         }
     }
 }
\ No newline at end of file
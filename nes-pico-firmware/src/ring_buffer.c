@@ -0,0 +1,137 @@
+#include "ring_buffer.h"
+
+#include <string.h>
+
+bool ring_buffer_init(ring_buffer_t *ring, uint8_t *storage, uint32_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+    {
+        return false;
+    }
+    ring->data = storage;
+    ring->size = size;
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->high_water = 0;
+    ring->dropped = 0;
+    return true;
+}
+
+uint32_t ring_buffer_used(const ring_buffer_t *ring)
+{
+    return ring->head - ring->tail;
+}
+
+uint32_t ring_buffer_free(const ring_buffer_t *ring)
+{
+    return ring->size - ring_buffer_used(ring);
+}
+
+bool ring_buffer_is_empty(const ring_buffer_t *ring)
+{
+    return ring->head == ring->tail;
+}
+
+bool ring_buffer_write(ring_buffer_t *ring, const uint8_t *src, uint32_t len)
+{
+    if (len > ring_buffer_free(ring))
+    {
+        ring->dropped += len;
+        return false;
+    }
+    uint32_t head = ring->head;
+    uint32_t index = head & ring->mask;
+    uint32_t first = ring->size - index;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(ring->data + index, src, first);
+    memcpy(ring->data, src + first, len - first);
+
+    // the data must be in place before the consumer sees the new head
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring->head = head + len;
+
+    uint32_t used = ring_buffer_used(ring);
+    if (used > ring->high_water)
+    {
+        ring->high_water = used;
+    }
+    return true;
+}
+
+bool ring_buffer_put(ring_buffer_t *ring, uint8_t value)
+{
+    return ring_buffer_write(ring, &value, 1);
+}
+
+uint32_t ring_buffer_read(ring_buffer_t *ring, uint8_t *dst, uint32_t max_len)
+{
+    uint32_t tail = ring->tail;
+    uint32_t len = ring->head - tail;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (len > max_len)
+    {
+        len = max_len;
+    }
+    uint32_t index = tail & ring->mask;
+    uint32_t first = ring->size - index;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(dst, ring->data + index, first);
+    memcpy(dst + first, ring->data, len - first);
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring->tail = tail + len;
+    return len;
+}
+
+uint32_t ring_buffer_read_until(ring_buffer_t *ring, uint8_t *dst, uint32_t max_len, uint8_t delimiter)
+{
+    uint32_t tail = ring->tail;
+    uint32_t len = ring->head - tail;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (len > max_len)
+    {
+        len = max_len;
+    }
+    uint32_t index = tail & ring->mask;
+    uint32_t first = ring->size - index;
+    if (first > len)
+    {
+        first = len;
+    }
+    // stop right after the delimiter - search the two contiguous parts
+    const uint8_t *found = memchr(ring->data + index, delimiter, first);
+    if (found != NULL)
+    {
+        len = (uint32_t)(found - (ring->data + index)) + 1;
+    }
+    else
+    {
+        found = memchr(ring->data, delimiter, len - first);
+        if (found != NULL)
+        {
+            len = first + (uint32_t)(found - ring->data) + 1;
+        }
+    }
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(dst, ring->data + index, first);
+    memcpy(dst + first, ring->data, len - first);
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring->tail = tail + len;
+    return len;
+}
+
+bool ring_buffer_get(ring_buffer_t *ring, uint8_t *value)
+{
+    return ring_buffer_read(ring, value, 1) == 1;
+}
@@ -0,0 +1,45 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+/**
+ * Byte ring buffer for one producer and one consumer (e.g. main loop and UART IRQ).
+ *
+ * head and tail are free-running counters (only the producer writes head, only the consumer
+ * writes tail), so no lock is needed as long as each side stays on its own end. The size
+ * must be a power of two.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct
+{
+    uint8_t *data;
+    uint32_t size; // power of two
+    uint32_t mask;
+    volatile uint32_t head; // next write - producer only
+    volatile uint32_t tail; // next read - consumer only
+
+    // counters (updated by the producer)
+    uint32_t high_water; // max bytes stored at once
+    uint32_t dropped;    // bytes rejected because there was no room
+} ring_buffer_t;
+
+// storage must have size bytes; returns false if size is not a power of two
+bool ring_buffer_init(ring_buffer_t *ring, uint8_t *storage, uint32_t size);
+
+uint32_t ring_buffer_used(const ring_buffer_t *ring);
+uint32_t ring_buffer_free(const ring_buffer_t *ring);
+bool ring_buffer_is_empty(const ring_buffer_t *ring);
+
+// producer side - all or nothing: a message is never split, it is dropped (and counted) whole
+bool ring_buffer_write(ring_buffer_t *ring, const uint8_t *src, uint32_t len);
+bool ring_buffer_put(ring_buffer_t *ring, uint8_t value);
+
+// consumer side
+uint32_t ring_buffer_read(ring_buffer_t *ring, uint8_t *dst, uint32_t max_len);
+bool ring_buffer_get(ring_buffer_t *ring, uint8_t *value);
+// like ring_buffer_read, but stops right after the first delimiter (e.g. '\n' to take one line)
+uint32_t ring_buffer_read_until(ring_buffer_t *ring, uint8_t *dst, uint32_t max_len, uint8_t delimiter);
+
+#endif
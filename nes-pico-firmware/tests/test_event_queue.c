@@ -0,0 +1,168 @@
+#include "test_event_queue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// same priorities/kinds used by main.c
+#define PRIORITY_UNLOCK 0
+#define PRIORITY_INDICATOR 2
+#define KIND_UNLOCK 1
+#define KIND_PROGRESS 9
+#define KIND_HIDE 8
+
+static achievement_t make_event(uint32_t id, uint8_t event, const char *progress)
+{
+    achievement_t data;
+    data.id = id;
+    data.event = event;
+    strcpy(data.measured_progress, progress);
+    return data;
+}
+
+// progress updates of the same achievement take a single slot and keep the latest value
+static void test_event_queue_coalesce(void)
+{
+    event_queue_t queue;
+    event_queue_init(&queue);
+    for (int i = 0; i < 100; i++)
+    {
+        char progress[24];
+        sprintf(progress, "%d/100", i);
+        achievement_t data = make_event(10, KIND_PROGRESS, progress);
+        TEST_ASSERT_TRUE(event_queue_push(&queue, &data, PRIORITY_INDICATOR, KIND_PROGRESS, true));
+    }
+    TEST_ASSERT_EQUAL_UINT8(1, event_queue_depth(&queue));
+    TEST_ASSERT_EQUAL_UINT32(99, queue.coalesced);
+
+    achievement_t out;
+    TEST_ASSERT_TRUE(event_queue_pop(&queue, &out));
+    TEST_ASSERT_EQUAL_STRING("99/100", out.measured_progress);
+    TEST_ASSERT_TRUE(event_queue_is_empty(&queue));
+}
+
+// an update after a hide of the same id must not jump ahead of the hide
+static void test_event_queue_keeps_order_after_hide(void)
+{
+    event_queue_t queue;
+    event_queue_init(&queue);
+    achievement_t show = make_event(10, KIND_PROGRESS, "1/3");
+    achievement_t hide = make_event(10, KIND_HIDE, "");
+    achievement_t show_again = make_event(10, KIND_PROGRESS, "2/3");
+    event_queue_push(&queue, &show, PRIORITY_INDICATOR, KIND_PROGRESS, true);
+    event_queue_push(&queue, &hide, PRIORITY_INDICATOR, KIND_HIDE, false);
+    event_queue_push(&queue, &show_again, PRIORITY_INDICATOR, KIND_PROGRESS, true);
+    TEST_ASSERT_EQUAL_UINT8(3, event_queue_depth(&queue));
+
+    achievement_t out;
+    event_queue_pop(&queue, &out);
+    TEST_ASSERT_EQUAL_STRING("1/3", out.measured_progress);
+    event_queue_pop(&queue, &out);
+    TEST_ASSERT_EQUAL_UINT8(KIND_HIDE, out.event);
+    event_queue_pop(&queue, &out);
+    TEST_ASSERT_EQUAL_STRING("2/3", out.measured_progress);
+}
+
+// unlocks go out first and evict indicators when the queue is full
+static void test_event_queue_unlocks_first(void)
+{
+    event_queue_t queue;
+    event_queue_init(&queue);
+    for (uint32_t i = 0; i < EVENT_QUEUE_SIZE; i++)
+    {
+        achievement_t data = make_event(100 + i, KIND_PROGRESS, "0");
+        TEST_ASSERT_TRUE(event_queue_push(&queue, &data, PRIORITY_INDICATOR, KIND_PROGRESS, true));
+    }
+    TEST_ASSERT_EQUAL_UINT8(EVENT_QUEUE_SIZE, queue.high_water);
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        achievement_t data = make_event(1 + i, KIND_UNLOCK, "");
+        TEST_ASSERT_TRUE(event_queue_push(&queue, &data, PRIORITY_UNLOCK, KIND_UNLOCK, false));
+    }
+    TEST_ASSERT_EQUAL_UINT8(EVENT_QUEUE_SIZE, event_queue_depth(&queue));
+    TEST_ASSERT_EQUAL_UINT32(3, queue.dropped);
+
+    achievement_t out;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        event_queue_pop(&queue, &out);
+        TEST_ASSERT_EQUAL_UINT8(KIND_UNLOCK, out.event);
+        TEST_ASSERT_EQUAL_UINT32(1 + i, out.id);
+    }
+    // the oldest indicators are kept, in arrival order
+    event_queue_pop(&queue, &out);
+    TEST_ASSERT_EQUAL_UINT32(100, out.id);
+}
+
+// a queue full of unlocks rejects indicators instead of evicting an unlock
+static void test_event_queue_never_drops_unlocks(void)
+{
+    event_queue_t queue;
+    event_queue_init(&queue);
+    for (uint32_t i = 0; i < EVENT_QUEUE_SIZE; i++)
+    {
+        achievement_t data = make_event(i, KIND_UNLOCK, "");
+        event_queue_push(&queue, &data, PRIORITY_UNLOCK, KIND_UNLOCK, false);
+    }
+    achievement_t data = make_event(500, KIND_PROGRESS, "1");
+    TEST_ASSERT_FALSE(event_queue_push(&queue, &data, PRIORITY_INDICATOR, KIND_PROGRESS, true));
+    TEST_ASSERT_EQUAL_UINT32(0, queue.dropped);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.rejected);
+
+    achievement_t out;
+    for (uint32_t i = 0; i < EVENT_QUEUE_SIZE; i++)
+    {
+        TEST_ASSERT_TRUE(event_queue_pop(&queue, &out));
+        TEST_ASSERT_EQUAL_UINT32(i, out.id);
+    }
+    TEST_ASSERT_FALSE(event_queue_pop(&queue, &out));
+}
+
+// unlocks that find the queue full of unlocks wait in the spill, in arrival order, up to
+// EVENT_QUEUE_SIZE + EVENT_QUEUE_SPILL_SIZE pending unlocks
+static void test_event_queue_spills_unlocks(void)
+{
+    event_queue_t queue;
+    event_queue_init(&queue);
+    const uint32_t limit = EVENT_QUEUE_SIZE + EVENT_QUEUE_SPILL_SIZE;
+    for (uint32_t i = 0; i < limit; i++)
+    {
+        achievement_t data = make_event(i, KIND_UNLOCK, "");
+        TEST_ASSERT_TRUE(event_queue_push(&queue, &data, PRIORITY_UNLOCK, KIND_UNLOCK, false));
+    }
+    TEST_ASSERT_EQUAL_UINT8(limit, event_queue_depth(&queue));
+    TEST_ASSERT_EQUAL_UINT8(limit, queue.high_water);
+    TEST_ASSERT_EQUAL_UINT32(EVENT_QUEUE_SPILL_SIZE, queue.spilled);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.dropped);
+
+    // past the limit the unlock is rejected
+    achievement_t data = make_event(limit, KIND_UNLOCK, "");
+    TEST_ASSERT_FALSE(event_queue_push(&queue, &data, PRIORITY_UNLOCK, KIND_UNLOCK, false));
+    TEST_ASSERT_EQUAL_UINT32(1, queue.rejected);
+
+    // a pop frees a slot for the oldest spilled unlock, so a new one goes behind the spill
+    achievement_t out;
+    TEST_ASSERT_TRUE(event_queue_pop(&queue, &out));
+    TEST_ASSERT_EQUAL_UINT32(0, out.id);
+    data = make_event(limit + 1, KIND_UNLOCK, "");
+    TEST_ASSERT_TRUE(event_queue_push(&queue, &data, PRIORITY_UNLOCK, KIND_UNLOCK, false));
+
+    for (uint32_t i = 1; i < limit; i++)
+    {
+        TEST_ASSERT_TRUE(event_queue_pop(&queue, &out));
+        TEST_ASSERT_EQUAL_UINT32(i, out.id);
+    }
+    TEST_ASSERT_TRUE(event_queue_pop(&queue, &out));
+    TEST_ASSERT_EQUAL_UINT32(limit + 1, out.id);
+    TEST_ASSERT_TRUE(event_queue_is_empty(&queue));
+    TEST_ASSERT_EQUAL_UINT8(0, event_queue_depth(&queue));
+}
+
+void test_event_queue(void)
+{
+    test_event_queue_coalesce();
+    test_event_queue_keeps_order_after_hide();
+    test_event_queue_unlocks_first();
+    test_event_queue_never_drops_unlocks();
+    test_event_queue_spills_unlocks();
+}
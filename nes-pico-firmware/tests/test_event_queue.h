@@ -0,0 +1,9 @@
+#ifndef TEST_EVENT_QUEUE_H
+#define TEST_EVENT_QUEUE_H
+
+#include "unity.h"
+#include "event_queue.h"
+
+void test_event_queue(void);
+
+#endif
@@ -0,0 +1,97 @@
+#include "test_link_frame.h"
+
+#include <string.h>
+
+static void test_link_frame_crc(void)
+{
+    const char *check = "123456789";
+    TEST_ASSERT_EQUAL_UINT32(0xCBF43926, ~link_frame_crc32(0xFFFFFFFF, (const uint8_t *)check, 9));
+}
+
+// a frame fed one byte at a time comes out whole, with the payload in the given buffer
+static void test_link_frame_round_trip(void)
+{
+    const char *command = "RESP=01;200;{\"Success\":true}";
+    uint8_t frame[LINK_FRAME_OVERHEAD + 64];
+    uint32_t frame_len = link_frame_encode(frame, LINK_FRAME_CMD, 7, (const uint8_t *)command, strlen(command));
+    TEST_ASSERT_EQUAL_UINT32(LINK_FRAME_OVERHEAD + strlen(command), frame_len);
+
+    link_frame_decoder_t decoder;
+    link_frame_decoder_init(&decoder);
+    uint8_t payload[64];
+    link_frame_decoder_set_buffer(&decoder, payload, sizeof(payload));
+
+    int result = LINK_FRAME_INCOMPLETE;
+    for (uint32_t i = 0; i < frame_len; i++)
+    {
+        uint32_t consumed;
+        result = link_frame_decode(&decoder, frame + i, 1, &consumed);
+        TEST_ASSERT_EQUAL_UINT32(1, consumed);
+        if (i < frame_len - 1)
+        {
+            TEST_ASSERT_EQUAL_INT(LINK_FRAME_INCOMPLETE, result);
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(LINK_FRAME_OK, result);
+    TEST_ASSERT_EQUAL_UINT8(LINK_FRAME_CMD, decoder.type);
+    TEST_ASSERT_EQUAL_UINT8(7, decoder.seq);
+    TEST_ASSERT_EQUAL_UINT32(strlen(command), decoder.len);
+    TEST_ASSERT_EQUAL_MEMORY(command, payload, strlen(command));
+}
+
+// a corrupted frame is reported and the next one in the same data is still decoded
+static void test_link_frame_corrupted(void)
+{
+    uint8_t data[2 * (LINK_FRAME_OVERHEAD + 8) + 3];
+    uint32_t len = 0;
+    data[len++] = 'x'; // noise before the first frame
+    len += link_frame_encode(data + len, LINK_FRAME_CMD_PART, 1, (const uint8_t *)"ABCDEFGH", 8);
+    data[8] ^= 0x20; // one bit flipped in the payload
+    len += link_frame_encode(data + len, LINK_FRAME_CMD, 2, (const uint8_t *)"IJKLMNOP", 8);
+
+    link_frame_decoder_t decoder;
+    link_frame_decoder_init(&decoder);
+    uint8_t payload[8];
+    link_frame_decoder_set_buffer(&decoder, payload, sizeof(payload));
+
+    uint32_t consumed;
+    TEST_ASSERT_EQUAL_INT(LINK_FRAME_BAD_CRC, link_frame_decode(&decoder, data, len, &consumed));
+    uint32_t offset = consumed;
+    TEST_ASSERT_EQUAL_INT(LINK_FRAME_OK, link_frame_decode(&decoder, data + offset, len - offset, &consumed));
+    TEST_ASSERT_EQUAL_UINT32(len, offset + consumed);
+    TEST_ASSERT_EQUAL_UINT8(2, decoder.seq);
+    TEST_ASSERT_EQUAL_MEMORY("IJKLMNOP", payload, 8);
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.errors);
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.skipped_bytes);
+}
+
+// a payload bigger than the buffer is verified but not written past the buffer
+static void test_link_frame_overflow(void)
+{
+    uint8_t frame[LINK_FRAME_OVERHEAD + 16];
+    uint32_t frame_len = link_frame_encode(frame, LINK_FRAME_CMD, 3, (const uint8_t *)"0123456789ABCDEF", 16);
+
+    link_frame_decoder_t decoder;
+    link_frame_decoder_init(&decoder);
+    uint8_t payload[10];
+    payload[8] = 0x55;
+    payload[9] = 0x55;
+    link_frame_decoder_set_buffer(&decoder, payload, 8);
+
+    uint32_t consumed;
+    TEST_ASSERT_EQUAL_INT(LINK_FRAME_OVERFLOW, link_frame_decode(&decoder, frame, frame_len, &consumed));
+    TEST_ASSERT_EQUAL_UINT8(0x55, payload[8]);
+    TEST_ASSERT_EQUAL_UINT8(0x55, payload[9]);
+
+    // a length above the maximum is rejected on the header
+    uint8_t bad[] = {LINK_FRAME_SOF, LINK_FRAME_CMD, 0, 0xFF, 0xFF};
+    TEST_ASSERT_EQUAL_INT(LINK_FRAME_BAD_HEADER, link_frame_decode(&decoder, bad, sizeof(bad), &consumed));
+}
+
+void test_link_frame(void)
+{
+    test_link_frame_crc();
+    test_link_frame_round_trip();
+    test_link_frame_corrupted();
+    test_link_frame_overflow();
+}
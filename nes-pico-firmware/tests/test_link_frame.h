@@ -0,0 +1,9 @@
+#ifndef TEST_LINK_FRAME_H
+#define TEST_LINK_FRAME_H
+
+#include "unity.h"
+#include "link_frame.h"
+
+void test_link_frame(void);
+
+#endif
@@ -1,6 +1,9 @@
 #include "unity.h"
 #include "test_rcheevos.h"
 #include "test_search.h"
+#include "test_event_queue.h"
+#include "test_ring_buffer.h"
+#include "test_link_frame.h"
 
 
 // Defina setUp e tearDown como funções vazias
@@ -40,5 +43,8 @@ int main(void)
     RUN_TEST(test_handle_response);
     RUN_TEST(test_rcheevos_client);
     RUN_TEST(test_search_method);
+    RUN_TEST(test_event_queue);
+    RUN_TEST(test_ring_buffer);
+    RUN_TEST(test_link_frame);
     return UNITY_END();
 }
@@ -0,0 +1,89 @@
+#include "test_ring_buffer.h"
+
+#include <string.h>
+
+#define TEST_RING_SIZE 16
+
+// messages are copied across the end of the storage and come back in order
+static void test_ring_buffer_wrap_around(void)
+{
+    uint8_t storage[TEST_RING_SIZE];
+    ring_buffer_t ring;
+    TEST_ASSERT_TRUE(ring_buffer_init(&ring, storage, TEST_RING_SIZE));
+
+    char out[TEST_RING_SIZE + 1];
+    for (int i = 0; i < 10; i++)
+    {
+        const char *message = "REQ=01;abc\r\n"; // 12 bytes - wraps on every other write
+        TEST_ASSERT_TRUE(ring_buffer_write(&ring, (const uint8_t *)message, strlen(message)));
+        TEST_ASSERT_EQUAL_UINT32(12, ring_buffer_used(&ring));
+
+        // the consumer takes it in small pieces, like the UART FIFO does
+        uint32_t len = ring_buffer_read(&ring, (uint8_t *)out, 5);
+        len += ring_buffer_read(&ring, (uint8_t *)out + len, TEST_RING_SIZE);
+        out[len] = '\0';
+        TEST_ASSERT_EQUAL_STRING(message, out);
+        TEST_ASSERT_TRUE(ring_buffer_is_empty(&ring));
+    }
+    TEST_ASSERT_EQUAL_UINT32(12, ring.high_water);
+    TEST_ASSERT_EQUAL_UINT32(0, ring.dropped);
+}
+
+// a message that does not fit is rejected whole, never split
+static void test_ring_buffer_all_or_nothing(void)
+{
+    uint8_t storage[TEST_RING_SIZE];
+    ring_buffer_t ring;
+    ring_buffer_init(&ring, storage, TEST_RING_SIZE);
+
+    TEST_ASSERT_TRUE(ring_buffer_write(&ring, (const uint8_t *)"0123456789", 10));
+    TEST_ASSERT_FALSE(ring_buffer_write(&ring, (const uint8_t *)"abcdefg", 7));
+    TEST_ASSERT_EQUAL_UINT32(7, ring.dropped);
+    TEST_ASSERT_EQUAL_UINT32(6, ring_buffer_free(&ring));
+    TEST_ASSERT_TRUE(ring_buffer_write(&ring, (const uint8_t *)"abcdef", 6));
+    TEST_ASSERT_FALSE(ring_buffer_put(&ring, 'x'));
+    TEST_ASSERT_EQUAL_UINT32(TEST_RING_SIZE, ring.high_water);
+
+    uint8_t value;
+    TEST_ASSERT_TRUE(ring_buffer_get(&ring, &value));
+    TEST_ASSERT_EQUAL_UINT8('0', value);
+    TEST_ASSERT_FALSE(ring_buffer_init(&ring, storage, 12));
+}
+
+// lines are taken one at a time, also when the delimiter is past the end of the storage
+static void test_ring_buffer_read_until(void)
+{
+    uint8_t storage[TEST_RING_SIZE];
+    ring_buffer_t ring;
+    ring_buffer_init(&ring, storage, TEST_RING_SIZE);
+
+    char out[TEST_RING_SIZE + 1];
+    ring_buffer_write(&ring, (const uint8_t *)"0123456789", 10);
+    ring_buffer_read(&ring, (uint8_t *)out, 10);
+
+    // starts at index 10 - "SYNC\r\n" fits before the end, "RESET\r\n" wraps
+    const char *lines = "SYNC\r\nRESET\r\nRE";
+    TEST_ASSERT_TRUE(ring_buffer_write(&ring, (const uint8_t *)lines, strlen(lines)));
+
+    uint32_t len = ring_buffer_read_until(&ring, (uint8_t *)out, TEST_RING_SIZE, '\n');
+    out[len] = '\0';
+    TEST_ASSERT_EQUAL_STRING("SYNC\r\n", out);
+    len = ring_buffer_read_until(&ring, (uint8_t *)out, TEST_RING_SIZE, '\n');
+    out[len] = '\0';
+    TEST_ASSERT_EQUAL_STRING("RESET\r\n", out);
+
+    // no delimiter yet - everything available (or max_len) is taken
+    len = ring_buffer_read_until(&ring, (uint8_t *)out, 1, '\n');
+    TEST_ASSERT_EQUAL_UINT32(1, len);
+    len = ring_buffer_read_until(&ring, (uint8_t *)out, TEST_RING_SIZE, '\n');
+    TEST_ASSERT_EQUAL_UINT32(1, len);
+    TEST_ASSERT_EQUAL_UINT8('E', out[0]);
+    TEST_ASSERT_TRUE(ring_buffer_is_empty(&ring));
+}
+
+void test_ring_buffer(void)
+{
+    test_ring_buffer_wrap_around();
+    test_ring_buffer_all_or_nothing();
+    test_ring_buffer_read_until();
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_RING_BUFFER_H
+#define TEST_RING_BUFFER_H
+
+#include "unity.h"
+#include "ring_buffer.h"
+
+void test_ring_buffer(void);
+
+#endif